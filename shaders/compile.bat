@@ -1,15 +1,21 @@
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe shader.vert -o vert.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe shader.frag -o frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe flat_color.frag -o flat_color_frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe shadow.vert -o shadow.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe sky.frag -o sky_frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe sky.vert -o sky_vert.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe framebuffer.vert -o framebuffer_vert.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe grading.frag -o grading_frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe pbrLit.frag -o pbr_lit_frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe ssao.frag -o ssao_frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe toonShader.vert -o toon_vert.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe toonShader.frag -o toon_frag.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe ui.vert -o ui_vert.spv
-C:/VulkanSDK/1.2.135.0/Bin32/glslc.exe ui.frag -o ui_frag.spv
+@echo off
+rem glslc comes with the Vulkan SDK, its installer sets VULKAN_SDK. Otherwise glslc has to be on the PATH
+set GLSLC=glslc
+if defined VULKAN_SDK set GLSLC="%VULKAN_SDK%/Bin/glslc.exe"
+cd /d "%~dp0"
+
+%GLSLC% shader.vert -o vert.spv
+%GLSLC% shader.frag -o frag.spv
+%GLSLC% flat_color.frag -o flat_color_frag.spv
+%GLSLC% shadow.vert -o shadow.spv
+%GLSLC% sky.frag -o sky_frag.spv
+%GLSLC% sky.vert -o sky_vert.spv
+%GLSLC% framebuffer.vert -o framebuffer_vert.spv
+%GLSLC% grading.frag -o grading_frag.spv
+%GLSLC% pbrLit.frag -o pbr_lit_frag.spv
+%GLSLC% ssao.frag -o ssao_frag.spv
+%GLSLC% toonShader.vert -o toon_vert.spv
+%GLSLC% toonShader.frag -o toon_frag.spv
+%GLSLC% ui.vert -o ui_vert.spv
+%GLSLC% ui.frag -o ui_frag.spv
 pause
\ No newline at end of file
@@ -0,0 +1,23 @@
+#!/bin/sh
+# Same as compile.bat. glslc comes with the Vulkan SDK, or set GLSLC to point to it
+set -e
+GLSLC=${GLSLC:-glslc}
+if ! command -v "$GLSLC" > /dev/null && [ -n "$VULKAN_SDK" ]; then
+    GLSLC="$VULKAN_SDK/bin/glslc"
+fi
+cd "$(dirname "$0")"
+
+"$GLSLC" shader.vert -o vert.spv
+"$GLSLC" shader.frag -o frag.spv
+"$GLSLC" flat_color.frag -o flat_color_frag.spv
+"$GLSLC" shadow.vert -o shadow.spv
+"$GLSLC" sky.frag -o sky_frag.spv
+"$GLSLC" sky.vert -o sky_vert.spv
+"$GLSLC" framebuffer.vert -o framebuffer_vert.spv
+"$GLSLC" grading.frag -o grading_frag.spv
+"$GLSLC" pbrLit.frag -o pbr_lit_frag.spv
+"$GLSLC" ssao.frag -o ssao_frag.spv
+"$GLSLC" toonShader.vert -o toon_vert.spv
+"$GLSLC" toonShader.frag -o toon_frag.spv
+"$GLSLC" ui.vert -o ui_vert.spv
+"$GLSLC" ui.frag -o ui_frag.spv
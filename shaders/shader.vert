@@ -21,9 +21,9 @@ layout(binding = 1) uniform LightingData
 	vec4 mainLightColor;
 } lightingData;
 
-layout(binding = 2) uniform PerInstanceData
+layout(std430, binding = 2) readonly buffer PerInstanceData
 {
-	mat4 model;
+	mat3x4 model[]; //top three rows of the model matrix
 } perInstanceData;
 
 layout(location = 0) out vec2 v_uv;
@@ -34,14 +34,15 @@ layout(location = 4) out vec3 v_bitangent;
 layout(location = 5) out vec3 v_tangent;
 
 void main() {
-    gl_Position = globalMatrices.proj * globalMatrices.view * perInstanceData.model * vec4(app_pos, 1.0);
+	mat4 model = mat4(transpose(perInstanceData.model[gl_InstanceIndex]));
+    gl_Position = globalMatrices.proj * globalMatrices.view * model * vec4(app_pos, 1.0);
     v_uv = app_uv;
 	
-	mat4 normalMatrix = transpose(inverse(perInstanceData.model));
+	mat4 normalMatrix = transpose(inverse(model));
 	v_normal = (normalMatrix * vec4(app_normal, 0.0)).xyz;
 	v_tangent = (normalMatrix * vec4(app_tangent.xyz, 0.0)).xyz;
 	vec3 bitangent = cross(app_normal, app_tangent.xyz) * app_tangent.w;
 	v_bitangent	= (normalMatrix * vec4(bitangent, 0.0)).xyz;
-	v_worldPos = (perInstanceData.model * vec4(app_pos, 1.0)).xyz;
+	v_worldPos = (model * vec4(app_pos, 1.0)).xyz;
 	v_lightSpacePos = lightingData.mainLightProjMat * lightingData.mainLightMat * vec4(v_worldPos, 1.0);
 }
\ No newline at end of file
@@ -17,11 +17,12 @@ layout(binding = 1) uniform LightingData
 	vec4 mainLightColor;
 } lightingData;
 
-layout(binding = 2) uniform PerInstanceData
+layout(std430, binding = 2) readonly buffer PerInstanceData
 {
-	mat4 model;
+	mat3x4 model[]; //top three rows of the model matrix
 } perInstanceData;
 
 void main() {
-    gl_Position = lightingData.mainLightProjMat * lightingData.mainLightMat * perInstanceData.model * app_pos;
+	mat4 model = mat4(transpose(perInstanceData.model[gl_InstanceIndex]));
+    gl_Position = lightingData.mainLightProjMat * lightingData.mainLightMat * model * app_pos;
 }
\ No newline at end of file
@@ -10,9 +10,9 @@ layout(binding = 0) uniform GlobalMatrices
 	vec3 camPos;
 } globalMatrices;
 
-layout(binding = 2) uniform PerInstanceData
+layout(std430, binding = 2) readonly buffer PerInstanceData
 {
-	mat4 model;
+	mat3x4 model[]; //top three rows of the model matrix
 } perInstanceData;
 
 layout(location = 0) out vec3 v_uv;
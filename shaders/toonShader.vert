@@ -21,9 +21,9 @@ layout(binding = 1) uniform LightingData
 	vec4 mainLightColor;
 } lightingData;
 
-layout(binding = 2) uniform PerInstanceData
+layout(std430, binding = 2) readonly buffer PerInstanceData
 {
-	mat4 model;
+	mat3x4 model[]; //top three rows of the model matrix
 } perInstanceData;
 
 layout(location = 0) out vec2 v_uv;
@@ -37,15 +37,16 @@ layout(location = 7) out float v_shadowThreshold;
 
 void main() 
 {
+	mat4 model = mat4(transpose(perInstanceData.model[gl_InstanceIndex]));
     v_uv = app_uv;
 	
-	mat4 normalMatrix = transpose(inverse(perInstanceData.model));
+	mat4 normalMatrix = transpose(inverse(model));
 	v_normalWS = (normalMatrix * vec4(app_normal, 0.0)).xyz;
 	v_tangentWS = (normalMatrix * vec4(app_tangent.xyz, 0.0)).xyz;
 	vec3 bitangent = cross(app_normal, app_tangent.xyz) * app_tangent.w;
 	v_bitangentWS	= (normalMatrix * vec4(bitangent, 0.0)).xyz;
 
-	vec4 positionWS = perInstanceData.model * vec4(app_pos, 1.0);
+	vec4 positionWS = model * vec4(app_pos, 1.0);
 	gl_Position = globalMatrices.proj * globalMatrices.view * positionWS;
 	v_positionWS = positionWS.xyz;
 
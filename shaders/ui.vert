@@ -12,16 +12,17 @@ layout(binding = 0) uniform GlobalMatrices
 	vec3 camPos;
 } globalMatrices;
 
-layout(binding = 2) uniform PerInstanceData
+layout(std430, binding = 2) readonly buffer PerInstanceData
 {
-	mat4 model;
+	mat3x4 model[]; //top three rows of the model matrix
 } perInstanceData;
 
 layout(location = 0) out vec2 v_uv;
 layout(location = 1) out vec4 v_color;
 
 void main() {
-    gl_Position = globalMatrices.proj * globalMatrices.view * perInstanceData.model * vec4(app_pos, 1.0);
+	mat4 model = mat4(transpose(perInstanceData.model[gl_InstanceIndex]));
+    gl_Position = globalMatrices.proj * globalMatrices.view * model * vec4(app_pos, 1.0);
     v_uv = app_uv;
 	v_color = app_color;
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "asteroid_pool.h"
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MOTION_SSE
+#include <emmintrin.h>
+#endif
+
+#ifdef MOTION_SSE
+// sin and cos of x, using the polynomials up to x^9 and x^10. Accurate to ~1e-6 for |x| <= pi/2
+static inline void sincos_ps(__m128 x, __m128 *outSin, __m128 *outCos)
+{
+    const __m128 x2 = _mm_mul_ps(x, x);
+
+    __m128 s = _mm_set1_ps(1.f / 362880.f);
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.f / 5040.f));
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.f / 120.f));
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(-1.f / 6.f));
+    s = _mm_add_ps(_mm_mul_ps(s, x2), _mm_set1_ps(1.f));
+    *outSin = _mm_mul_ps(s, x);
+
+    __m128 c = _mm_set1_ps(-1.f / 3628800.f);
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.f / 40320.f));
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.f / 720.f));
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.f / 24.f));
+    c = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(-1.f / 2.f));
+    *outCos = _mm_add_ps(_mm_mul_ps(c, x2), _mm_set1_ps(1.f));
+}
+#endif
+
+void integrate_motion(MotionStreams s, u32 count, r32 deltaTime)
+{
+#ifdef MOTION_SSE
+    const __m128 dt = _mm_set1_ps(deltaTime);
+    const __m128 halfDt = _mm_set1_ps(deltaTime * 0.5f);
+    const __m128 pi = _mm_set1_ps(3.14159265f);
+    const __m128 invPi = _mm_set1_ps(1.f / 3.14159265f);
+
+    for (u32 i = 0; i < count; i += 4)
+    {
+        // Position
+        __m128 px = _mm_load_ps(s.positionX + i);
+        __m128 py = _mm_load_ps(s.positionY + i);
+        __m128 pz = _mm_load_ps(s.positionZ + i);
+        px = _mm_add_ps(px, _mm_mul_ps(_mm_load_ps(s.velocityX + i), dt));
+        py = _mm_add_ps(py, _mm_mul_ps(_mm_load_ps(s.velocityY + i), dt));
+        pz = _mm_add_ps(pz, _mm_mul_ps(_mm_load_ps(s.velocityZ + i), dt));
+        _mm_store_ps(s.positionX + i, px);
+        _mm_store_ps(s.positionY + i, py);
+        _mm_store_ps(s.positionZ + i, pz);
+
+        // Delta rotation is (axis * sin(h), cos(h)) with h = angle / 2. Wrapping h into [-pi/2, pi/2]
+        // may flip the sign of both sin and cos, but -q is the same rotation as q so it doesn't matter
+        __m128 h = _mm_mul_ps(_mm_load_ps(s.angularVelocity + i), halfDt);
+        __m128 k = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_mul_ps(h, invPi)));
+        h = _mm_sub_ps(h, _mm_mul_ps(k, pi));
+
+        __m128 sinH, cosH;
+        sincos_ps(h, &sinH, &cosH);
+
+        const __m128 ax = _mm_mul_ps(_mm_load_ps(s.axisX + i), sinH);
+        const __m128 ay = _mm_mul_ps(_mm_load_ps(s.axisY + i), sinH);
+        const __m128 az = _mm_mul_ps(_mm_load_ps(s.axisZ + i), sinH);
+        const __m128 aw = cosH;
+
+        const __m128 bx = _mm_load_ps(s.rotationX + i);
+        const __m128 by = _mm_load_ps(s.rotationY + i);
+        const __m128 bz = _mm_load_ps(s.rotationZ + i);
+        const __m128 bw = _mm_load_ps(s.rotationW + i);
+
+        // Hamilton product delta * rotation, same as Quaternion operator*
+        __m128 rx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bx), _mm_mul_ps(ax, bw)), _mm_sub_ps(_mm_mul_ps(ay, bz), _mm_mul_ps(az, by)));
+        __m128 ry = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(aw, by), _mm_mul_ps(ax, bz)), _mm_add_ps(_mm_mul_ps(ay, bw), _mm_mul_ps(az, bx)));
+        __m128 rz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(aw, bz), _mm_mul_ps(ax, by)), _mm_sub_ps(_mm_mul_ps(az, bw), _mm_mul_ps(ay, bx)));
+        __m128 rw = _mm_sub_ps(_mm_sub_ps(_mm_mul_ps(aw, bw), _mm_mul_ps(ax, bx)), _mm_add_ps(_mm_mul_ps(ay, by), _mm_mul_ps(az, bz)));
+
+        _mm_store_ps(s.rotationX + i, rx);
+        _mm_store_ps(s.rotationY + i, ry);
+        _mm_store_ps(s.rotationZ + i, rz);
+        _mm_store_ps(s.rotationW + i, rw);
+    }
+#else
+    for (u32 i = 0; i < count; i++)
+    {
+        s.positionX[i] += s.velocityX[i] * deltaTime;
+        s.positionY[i] += s.velocityY[i] * deltaTime;
+        s.positionZ[i] += s.velocityZ[i] * deltaTime;
+
+        r32 h = s.angularVelocity[i] * deltaTime * 0.5f;
+        r32 sinH = std::sin(h);
+        Quaternion delta(s.axisX[i] * sinH, s.axisY[i] * sinH, s.axisZ[i] * sinH, std::cos(h));
+        Quaternion rot(s.rotationX[i], s.rotationY[i], s.rotationZ[i], s.rotationW[i]);
+        rot = delta * rot;
+
+        s.rotationX[i] = rot.x;
+        s.rotationY[i] = rot.y;
+        s.rotationZ[i] = rot.z;
+        s.rotationW[i] = rot.w;
+    }
+#endif
+}
@@ -0,0 +1,225 @@
+#ifndef ASTEROID_POOL_H
+#define ASTEROID_POOL_H
+
+#include <cstring>
+#include <glm/glm.hpp>
+#include "../util/typedef.h"
+#include "../util/quaternion.h"
+#include "../util/resource_pool.h"
+
+// Pointers into the structure-of-arrays motion data, one stream per component
+struct MotionStreams
+{
+    r32 *positionX, *positionY, *positionZ;
+    r32 *velocityX, *velocityY, *velocityZ;
+    r32 *rotationX, *rotationY, *rotationZ, *rotationW;
+    r32 *axisX, *axisY, *axisZ;
+    r32 *angularVelocity;
+};
+
+// Advances position by velocity and rotates by angular velocity around the (normalized) axis
+// for streams[0..count). With SSE, count must be a multiple of 4 and the streams 16-byte aligned.
+void integrate_motion(MotionStreams streams, u32 count, r32 deltaTime);
+
+// Resource pool that keeps the per-tick motion data of its objects in separate 32-byte aligned streams
+// indexed by handle, so it can be integrated several objects at a time. Everything else stays in T.
+// Position and rotation from before the latest integration are kept for interpolating between ticks.
+template <class T, u32 poolSize>
+struct MotionPool
+{
+    static_assert(poolSize % 8 == 0, "Pool size must be a multiple of 8");
+
+private:
+    ResourcePool<T, poolSize> records;
+    u32 slotCount; //highest handle in use + 1
+
+    alignas(32) r32 positionX[poolSize];
+    alignas(32) r32 positionY[poolSize];
+    alignas(32) r32 positionZ[poolSize];
+    alignas(32) r32 velocityX[poolSize];
+    alignas(32) r32 velocityY[poolSize];
+    alignas(32) r32 velocityZ[poolSize];
+    alignas(32) r32 rotationX[poolSize];
+    alignas(32) r32 rotationY[poolSize];
+    alignas(32) r32 rotationZ[poolSize];
+    alignas(32) r32 rotationW[poolSize];
+    alignas(32) r32 axisX[poolSize];
+    alignas(32) r32 axisY[poolSize];
+    alignas(32) r32 axisZ[poolSize];
+    alignas(32) r32 angularVelocity[poolSize];
+
+    r32 prevPositionX[poolSize];
+    r32 prevPositionY[poolSize];
+    r32 prevPositionZ[poolSize];
+    r32 prevRotationX[poolSize];
+    r32 prevRotationY[poolSize];
+    r32 prevRotationZ[poolSize];
+    r32 prevRotationW[poolSize];
+
+    void store_previous(u32 first, u32 count)
+    {
+        const u32 size = count * sizeof(r32);
+        memcpy(prevPositionX + first, positionX + first, size);
+        memcpy(prevPositionY + first, positionY + first, size);
+        memcpy(prevPositionZ + first, positionZ + first, size);
+        memcpy(prevRotationX + first, rotationX + first, size);
+        memcpy(prevRotationY + first, rotationY + first, size);
+        memcpy(prevRotationZ + first, rotationZ + first, size);
+        memcpy(prevRotationW + first, rotationW + first, size);
+    }
+public:
+    MotionPool() : slotCount(0)
+    {
+        for (u32 i = 0; i < poolSize; i++)
+        {
+            positionX[i] = positionY[i] = positionZ[i] = 0;
+            velocityX[i] = velocityY[i] = velocityZ[i] = 0;
+            rotationX[i] = rotationY[i] = rotationZ[i] = 0;
+            rotationW[i] = 1;
+            axisX[i] = axisZ[i] = 0;
+            axisY[i] = 1;
+            angularVelocity[i] = 0;
+        }
+        store_previous(0, poolSize);
+    }
+
+    T *create(s32 *outHandle)
+    {
+        T *obj = records.create(outHandle);
+        if (obj != nullptr && (u32)*outHandle >= slotCount)
+            slotCount = *outHandle + 1;
+
+        return obj;
+    }
+
+    T &operator[](const u32 handle)
+    {
+        return records[handle];
+    }
+
+    s32 get_handle(u32 i)
+    {
+        return records.get_handle(i);
+    }
+
+    u32 get_count() const
+    {
+        return records.get_count();
+    }
+
+    void mark_for_destruction(T *obj, void (*callback)(T*,u32) = nullptr)
+    {
+        records.mark_for_destruction(obj, callback);
+    }
+
+    void destroy_objs()
+    {
+        records.destroy_objs();
+    }
+
+    glm::vec3 get_position(u32 handle) const
+    {
+        return {positionX[handle], positionY[handle], positionZ[handle]};
+    }
+    void set_position(u32 handle, glm::vec3 pos)
+    {
+        positionX[handle] = pos.x;
+        positionY[handle] = pos.y;
+        positionZ[handle] = pos.z;
+    }
+
+    glm::vec3 get_velocity(u32 handle) const
+    {
+        return {velocityX[handle], velocityY[handle], velocityZ[handle]};
+    }
+    void set_velocity(u32 handle, glm::vec3 vel)
+    {
+        velocityX[handle] = vel.x;
+        velocityY[handle] = vel.y;
+        velocityZ[handle] = vel.z;
+    }
+
+    Quaternion get_rotation(u32 handle) const
+    {
+        return {rotationX[handle], rotationY[handle], rotationZ[handle], rotationW[handle]};
+    }
+    void set_rotation(u32 handle, Quaternion rot)
+    {
+        rotationX[handle] = rot.x;
+        rotationY[handle] = rot.y;
+        rotationZ[handle] = rot.z;
+        rotationW[handle] = rot.w;
+    }
+
+    r32 get_angular_velocity(u32 handle) const
+    {
+        return angularVelocity[handle];
+    }
+    // Position and rotation blended from the previous tick (alpha 0) to the current one (alpha 1)
+    glm::vec3 get_interpolated_position(u32 handle, r32 alpha) const
+    {
+        glm::vec3 prev = {prevPositionX[handle], prevPositionY[handle], prevPositionZ[handle]};
+        return prev + (get_position(handle) - prev) * alpha;
+    }
+    Quaternion get_interpolated_rotation(u32 handle, r32 alpha) const
+    {
+        Quaternion prev(prevRotationX[handle], prevRotationY[handle], prevRotationZ[handle], prevRotationW[handle]);
+        return Quaternion::nlerp(prev, get_rotation(handle), alpha);
+    }
+
+    // Call after placing a new object so it doesn't get interpolated from whatever was in its slot before
+    void reset_interpolation(u32 handle)
+    {
+        store_previous(handle, 1);
+    }
+
+    void set_angular_velocity(u32 handle, glm::vec3 axis, r32 velocity)
+    {
+        glm::vec3 n = glm::normalize(axis);
+        axisX[handle] = n.x;
+        axisY[handle] = n.y;
+        axisZ[handle] = n.z;
+        angularVelocity[handle] = velocity;
+    }
+
+    // Integrates every slot up to the highest handle in use. Free slots inside that range get integrated too,
+    // which is cheaper than gathering live objects and harmless since create() overwrites them.
+    void integrate(r32 deltaTime)
+    {
+        integrate_range(0, get_slot_count(), deltaTime);
+    }
+
+    // Same as integrate() for the slot range [first, first + count), both must be multiples of 8
+    void integrate_range(u32 first, u32 count, r32 deltaTime)
+    {
+        store_previous(first, count);
+        integrate_motion(get_streams(first), count, deltaTime);
+    }
+
+    u32 get_slot_count() const
+    {
+        return (slotCount + 7) & ~7u;
+    }
+
+    MotionStreams get_streams(u32 first)
+    {
+        MotionStreams streams;
+        streams.positionX = positionX + first;
+        streams.positionY = positionY + first;
+        streams.positionZ = positionZ + first;
+        streams.velocityX = velocityX + first;
+        streams.velocityY = velocityY + first;
+        streams.velocityZ = velocityZ + first;
+        streams.rotationX = rotationX + first;
+        streams.rotationY = rotationY + first;
+        streams.rotationZ = rotationZ + first;
+        streams.rotationW = rotationW + first;
+        streams.axisX = axisX + first;
+        streams.axisY = axisY + first;
+        streams.axisZ = axisZ + first;
+        streams.angularVelocity = angularVelocity + first;
+        return streams;
+    }
+};
+
+#endif // ASTEROID_POOL_H
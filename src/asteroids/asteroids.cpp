@@ -1,9 +1,13 @@
 #include "asteroids.h"
+#include "asteroid_pool.h"
+#include "world_delta.h"
 #include "../input/input.h"
+#include "../jobs/jobs.h"
 #include "../util/math.h"
 #include "../util/random.h"
 #include "../util/resource_pool.h"
-#include "string_util.h"
+#include "../util/spatial_hash.h"
+#include "../util/hash_table.h"
 #include <iostream>
 #include <cstring>
 
@@ -19,21 +23,39 @@ namespace Asteroids
 
     #define SECTOR_WIDTH 16
     #define SECTOR_HEIGHT 16
-    #define MAX_SECTOR_COUNT 1024
-    Sector visitedSectors[MAX_SECTOR_COUNT];
-    u32 visitedSectorCount = 0;
 
-    ResourcePool<Sector, 32> activeSectors;
+    #define MAX_ACTIVE_SECTORS 64
+    #define SECTOR_EVICT_RADIUS 3 //in sectors, has to cover the predicted neighbourhood
+    ResourcePool<Sector, MAX_ACTIVE_SECTORS> activeSectors;
+    HashTable<u32, MAX_ACTIVE_SECTORS * 2> sectorTable; //packed coordinates -> activeSectors handle
+    Sector playerSector = {0, 0};
 
-    #define MAX_ASTEROID_COUNT 1024
-    ResourcePool<Asteroid, MAX_ASTEROID_COUNT> asteroids;
-    Asteroid *collidingAsteroids[MAX_ASTEROID_COUNT];
+    #define MAX_ASTEROID_COUNT 2048 //asteroids live as long as their sector, up to 7x7 of them are active
+    typedef MotionPool<Asteroid, MAX_ASTEROID_COUNT> AsteroidPool;
+    AsteroidPool asteroids;
+    u32 collidingAsteroids[MAX_ASTEROID_COUNT];
     u32 collidingAsteroidCount = 0;
+    SpatialHash<MAX_ASTEROID_COUNT, MAX_ASTEROID_COUNT> asteroidGrid;
 
-    ResourcePool<Asteroid, 1024> goldChunks;
-    Asteroid *collidingGoldChunks[1024];
+    AsteroidPool goldChunks;
+    u32 collidingGoldChunks[MAX_ASTEROID_COUNT];
     u32 collidingGoldChunksCount = 0;
 
+    //Written per pool index by jobs, then acted on in index order on the main thread
+    enum DistanceClass : u8
+    {
+        DISTANCE_COLLIDE, //close enough to render and collide
+        DISTANCE_IDLE,
+        DISTANCE_DESPAWN //its sector isn't active any more
+    };
+    DistanceClass distanceClasses[MAX_ASTEROID_COUNT];
+
+    #define MOTION_BATCH_SIZE 128 //multiple of 8, as MotionPool::integrate_range wants
+    #define CLASSIFY_BATCH_SIZE 128
+
+    void integrate_parallel(AsteroidPool *pool, r32 deltaTime);
+    void classify_distances(AsteroidPool *pool);
+
     const r32 asteroidDensity = 5320; //kg / m^3
     const r32 goldDensity = 19300;
     const r32 goldPricePerKiloUSD = 56410.22;
@@ -50,11 +72,41 @@ namespace Asteroids
     ShaderHandle skyShader;
     ShaderHandle pbrShader;
     ShaderHandle toonShader;
-    ShaderHandle uiShader;
 
     TextureHandle asciiTexture;
-    MaterialHandle asciiMaterial;
-    MeshHandle stringMesh = -1;
+
+    bool shootRequested = false;
+
+    // Sectors are generated by jobs into batches and moved into the asteroid pool a few at a time
+    struct SectorBatch
+    {
+        Sector coords;
+        bool cancelled; //sector was deactivated before the batch got committed
+
+        u32 commitTick;
+        u32 spawnCount;
+        u32 committedCount;
+        WorldDelta::SectorDelta delta;
+        AsteroidSpawn spawns[MAX_ASTROIDS_PER_SECTOR + MAX_PENDING_GOLD_PER_SECTOR];
+
+        Jobs::Counter counter;
+    };
+
+    #define MAX_SECTOR_BATCHES 18 //two 3x3 neighbourhoods
+    #define SECTOR_STREAM_LATENCY 4 //ticks from request to commit
+    #define SECTOR_STREAM_LOOKAHEAD 2.f //seconds
+    #define SECTOR_COMMIT_BUDGET 32 //asteroids per tick
+    SectorBatch sectorBatches[MAX_SECTOR_BATCHES];
+    u32 sectorBatchHead = 0;
+    u32 sectorBatchCount = 0;
+
+    #define RENDER_DISTANCE 10.f
+    void render_pool(AsteroidPool *pool, glm::vec3 viewPos, r32 alpha);
+
+    u64 pack_sector_key(Sector sector);
+    Sector get_sector(glm::vec3 pos);
+    void evict_sectors();
+    void return_gold(const SectorBatch &batch, u32 spawnIndex);
 }
 
 r32 Asteroids::volume_to_scale(r32 volume)
@@ -65,9 +117,12 @@ r32 Asteroids::volume_to_scale(r32 volume)
 }
 
 // Generated asteroid deterministically based on seed
-void Asteroids::init_asteroid(Asteroid* a, r32 seed, glm::vec2 sectorOrigin)
+void Asteroids::init_asteroid(AsteroidSpawn *spawn, r32 seed, glm::vec2 sectorOrigin)
 {
+    Asteroid *a = &spawn->asteroid;
     a->seed = seed;
+    a->generated = true;
+    spawn->gold = false;
 
     u32 materialIndex = std::round(seed*3);
     a->mat = asteroidMaterials[materialIndex];
@@ -80,16 +135,16 @@ void Asteroids::init_asteroid(Asteroid* a, r32 seed, glm::vec2 sectorOrigin)
     a->scale = volume_to_scale(a->volume);
 
     // This is poop, needs better random function for this
-    a->rotationAxis = glm::normalize(hash31(seed) * 2.f - 1.f);
-    a->angularVelocity = hash11(seed);
+    spawn->rotationAxis = glm::normalize(hash31(seed) * 2.f - 1.f);
+    spawn->angularVelocity = hash11(seed);
 
     glm::vec2 asteroidPos = hash23({sectorOrigin.x, seed, sectorOrigin.y}) * glm::vec2(SECTOR_WIDTH,SECTOR_HEIGHT) - glm::vec2(SECTOR_WIDTH/2,SECTOR_HEIGHT/2) + sectorOrigin;
-    a->position = {asteroidPos.x, 0, asteroidPos.y};
+    spawn->position = {asteroidPos.x, 0, asteroidPos.y};
     r32 angle = hash11(seed) * 360.f;
-    a->rotation = Quaternion::angle_axis(glm::radians(angle), a->rotationAxis);
+    spawn->rotation = Quaternion::angle_axis(glm::radians(angle), spawn->rotationAxis);
 
-    a->velocity = hash31(seed) - 0.5f;
-    a->velocity.y = 0.f;
+    spawn->velocity = hash31(seed) - 0.5f;
+    spawn->velocity.y = 0.f;
 
     a->radius = a->scale * 0.4f;
     a->mass = a->volume * asteroidDensity;
@@ -98,22 +153,222 @@ void Asteroids::init_asteroid(Asteroid* a, r32 seed, glm::vec2 sectorOrigin)
     a->health = baseHealth * a->scale;
 }
 
-void Asteroids::generate_sector(Sector *sector)
+// Gold chunk left behind in a sector the player moved away from
+void Asteroids::init_gold_chunk(AsteroidSpawn *spawn, const WorldDelta::GoldChunk &gold, Sector sector)
+{
+    Asteroid *a = &spawn->asteroid;
+    a->sector = sector;
+    a->seed = gold.seed;
+    a->generated = false;
+    spawn->gold = true;
+
+    a->mat = goldMaterial;
+    u32 meshIndex = std::round(hash11(gold.seed)*3);
+    a->mesh = asteroidMeshes[meshIndex];
+
+    a->volume = gold.volume;
+    a->scale = gold.scale;
+    a->radius = gold.radius;
+    a->mass = gold.mass;
+    a->health = 3 * a->scale;
+
+    spawn->position = gold.position;
+    spawn->rotation = Quaternion::angle_axis(hash11(gold.seed), hash31(gold.seed));
+    spawn->velocity = glm::vec3(0.f);
+    spawn->rotationAxis = hash31(gold.seed);
+    spawn->angularVelocity = 0.f;
+}
+
+// Only reads the seed tables and the delta it's given, safe to run on any thread
+u32 Asteroids::generate_sector(Sector sector, const WorldDelta::SectorDelta *delta, AsteroidSpawn *outSpawns)
 {
-    u32 c = hash12({sector->x,sector->y}) * (MAX_ASTROIDS_PER_SECTOR - MIN_ASTROIDS_PER_SECTOR) + MIN_ASTROIDS_PER_SECTOR;
+    u32 c = hash12({sector.x,sector.y}) * (MAX_ASTROIDS_PER_SECTOR - MIN_ASTROIDS_PER_SECTOR) + MIN_ASTROIDS_PER_SECTOR;
     //std::cout << "Generating " << c << " asteroids\n";
 
+    u32 spawnCount = 0;
     for (int i = 0; i < c; i++)
     {
-        r32 seed = hash13({sector->x,sector->y,i});
+        r32 seed = hash13({sector.x,sector.y,i});
+
+        // Already mined
+        if (WorldDelta::is_destroyed(*delta, seed))
+            continue;
+
+        AsteroidSpawn *spawn = &outSpawns[spawnCount++];
+        init_asteroid(spawn, seed, {sector.x*SECTOR_WIDTH,sector.y*SECTOR_HEIGHT});
+        spawn->asteroid.sector = sector;
+    }
+
+    for (u32 i = 0; i < delta->goldCount; i++)
+    {
+        init_gold_chunk(&outSpawns[spawnCount++], delta->gold[i], sector);
+    }
+
+    return spawnCount;
+}
+
+bool Asteroids::spawn_asteroid(const AsteroidSpawn &spawn)
+{
+    AsteroidPool *pool = spawn.gold ? &goldChunks : &asteroids;
+    if (pool->get_count() >= MAX_ASTEROID_COUNT)
+    {
+        std::cout << "Can't create asteroid, no room!\n";
+        return false;
+    }
+
+    s32 handle;
+    Asteroid *a = pool->create(&handle);
+    *a = spawn.asteroid;
+
+    pool->set_position(handle, spawn.position);
+    pool->set_rotation(handle, spawn.rotation);
+    pool->set_velocity(handle, spawn.velocity);
+    pool->set_angular_velocity(handle, spawn.rotationAxis, spawn.angularVelocity);
+    pool->reset_interpolation(handle);
+    return true;
+}
+
+// The delta store hands its gold over to the batch, so gold that doesn't make it into the pool has to go back
+// or it's gone for good. Asteroid spawns need nothing, they're generated again from the seeds
+void Asteroids::return_gold(const SectorBatch &batch, u32 spawnIndex)
+{
+    u32 firstGold = batch.spawnCount - batch.delta.goldCount;
+    if (spawnIndex < firstGold)
+        return;
+
+    WorldDelta::record_gold(pack_sector_key(batch.coords), batch.delta.gold[spawnIndex - firstGold]);
+}
+
+// Queues generation of a sector that was just made active, unless the queue is full
+void Asteroids::request_sector(Sector sector)
+{
+    if (sectorBatchCount >= MAX_SECTOR_BATCHES)
+        return;
+
+    s32 handle;
+    Sector *newSector = activeSectors.create(&handle);
+    if (newSector == nullptr)
+        return;
+    *newSector = sector;
+    sectorTable.insert(pack_sector_key(sector), handle);
+
+    SectorBatch &batch = sectorBatches[(sectorBatchHead + sectorBatchCount++) % MAX_SECTOR_BATCHES];
+    batch.coords = sector;
+    batch.cancelled = false;
+    batch.commitTick = state.tick + SECTOR_STREAM_LATENCY;
+    batch.spawnCount = 0;
+    batch.committedCount = 0;
+    WorldDelta::take_sector_delta(pack_sector_key(sector), &batch.delta);
+
+    Jobs::run([](void *data, u32, u32)
+    {
+        SectorBatch *b = (SectorBatch*)data;
+        b->spawnCount = generate_sector(b->coords, &b->delta, b->spawns);
+    }, &batch, 0, 1, &batch.counter);
+}
+
+// Makes sure the sectors around the player and around where the player is heading are active
+void Asteroids::stream_sectors()
+{
+    glm::vec3 lookahead = player.velocity * SECTOR_STREAM_LOOKAHEAD;
+    if (glm::length(lookahead) > SECTOR_WIDTH * 2.f)
+        lookahead = glm::normalize(lookahead) * (SECTOR_WIDTH * 2.f);
+    glm::vec3 predictedPos = player.position + lookahead;
+
+    Sector currentSector = get_sector(player.position);
+    Sector predictedSector = get_sector(predictedPos);
+    Sector centers[2] = {currentSector, predictedSector};
+    u32 centerCount = (predictedSector.x == currentSector.x && predictedSector.y == currentSector.y) ? 1 : 2;
+
+    for (u32 c = 0; c < centerCount; c++)
+    {
+        for (int x = 0; x < 3; x++)
+        {
+            for (int y = 0; y < 3; y++)
+            {
+                Sector sector {centers[c].x + (x-1), centers[c].y + (y-1)};
+
+                if (sectorTable.find(pack_sector_key(sector)) == nullptr)
+                    request_sector(sector);
+            }
+        }
+    }
+}
+
+u64 Asteroids::pack_sector_key(Sector sector)
+{
+    return ((u64)(u32)sector.x << 32) | (u32)sector.y;
+}
+
+Asteroids::Sector Asteroids::get_sector(glm::vec3 pos)
+{
+    return {(s32)pos.x/SECTOR_WIDTH, (s32)pos.z/SECTOR_HEIGHT};
+}
+
+// Deactivates sectors too far from the player's sector. Only needs to run when the player's sector changes
+void Asteroids::evict_sectors()
+{
+    for (int i = 0; i < activeSectors.get_count(); i++)
+    {
+        u32 handle = activeSectors.get_handle(i);
+        Sector &activeSector = activeSectors[handle];
+
+        s32 dx = std::abs(activeSector.x - playerSector.x);
+        s32 dy = std::abs(activeSector.y - playerSector.y);
+        if (MAX(dx, dy) <= SECTOR_EVICT_RADIUS)
+            continue;
+
+        for (u32 j = 0; j < sectorBatchCount; j++)
+        {
+            SectorBatch &batch = sectorBatches[(sectorBatchHead + j) % MAX_SECTOR_BATCHES];
+            if (batch.coords.x != activeSector.x || batch.coords.y != activeSector.y)
+                continue;
+
+            // Whatever wasn't committed yet won't be, return its gold now so a new request for the sector gets it
+            Jobs::wait(&batch.counter);
+            for (u32 k = batch.committedCount; k < batch.spawnCount; k++)
+            {
+                return_gold(batch, k);
+            }
+            batch.committedCount = batch.spawnCount;
+            batch.cancelled = true;
+        }
+
+        sectorTable.remove(pack_sector_key(activeSector));
+        activeSectors.mark_for_destruction(&activeSector);
+    }
+}
+
+// Moves generated asteroids into the pool, oldest request first and at most SECTOR_COMMIT_BUDGET per tick.
+// A batch is only looked at once its commit tick has come, so what gets spawned when doesn't depend on thread timing.
+void Asteroids::commit_sectors()
+{
+    u32 budget = SECTOR_COMMIT_BUDGET;
+
+    while (sectorBatchCount > 0)
+    {
+        SectorBatch &batch = sectorBatches[sectorBatchHead];
+        if (batch.commitTick > state.tick)
+            break;
+
+        Jobs::wait(&batch.counter);
 
-        if (asteroids.get_count() < MAX_ASTEROID_COUNT)
+        if (!batch.cancelled)
         {
-            Asteroid *a = asteroids.create();
-            init_asteroid(a, seed, {sector->x*SECTOR_WIDTH,sector->y*SECTOR_HEIGHT});
-            a->sector = sector;
+            while (batch.committedCount < batch.spawnCount && budget > 0)
+            {
+                u32 index = batch.committedCount++;
+                if (!spawn_asteroid(batch.spawns[index]))
+                    return_gold(batch, index);
+                budget--;
+            }
+
+            if (batch.committedCount < batch.spawnCount)
+                break;
         }
-        else std::cout << "Can't create asteroid, no room!\n";
+
+        sectorBatchHead = (sectorBatchHead + 1) % MAX_SECTOR_BATCHES;
+        sectorBatchCount--;
     }
 }
 
@@ -127,6 +382,7 @@ void Asteroids::shoot()
 
         r32 speed = 10.f;
         newBullet->position = player.position;
+        newBullet->prevPosition = player.position;
         newBullet->velocity = speed * shootDirection;
         newBullet->velocity += player.velocity;
         newBullet->radius = 0.05f;
@@ -137,29 +393,10 @@ void Asteroids::shoot()
 
 void Asteroids::initialize()
 {
-    // Load meshes
-    asteroidMeshes[0] = Renderer::create_mesh("Asteroid1", "res/meshes/asteroids/asteroids/asteroid1.gltf");
-    asteroidMeshes[1] = Renderer::create_mesh("Asteroid2", "res/meshes/asteroids/asteroids/asteroid2.gltf");
-    asteroidMeshes[2] = Renderer::create_mesh("Asteroid3", "res/meshes/asteroids/asteroids/asteroid3.gltf");
-    asteroidMeshes[3] = Renderer::create_mesh("Asteroid4", "res/meshes/asteroids/asteroids/asteroid4.gltf");
-
-    shipMesh = Renderer::create_mesh("Ship", "res/meshes/asteroids/ship.gltf");
-
-    // Load textures
-    TextureHandle asteroidNormalTex = Renderer::create_texture("AsteroidNormal", "res/textures/asteroids/asteroids_normals_1k.png", IMAGE_NORMAL);
-    TextureHandle asteroidAOTex = Renderer::create_texture("AsteroidAO", "res/textures/asteroids/asteroids_occlusion_1k.png");
-    const char* cubemapFnames[6] = {"res/textures/asteroids/skybox_right1.png",
-                                    "res/textures/asteroids/skybox_left2.png",
-                                    "res/textures/asteroids/skybox_top3.png",
-                                    "res/textures/asteroids/skybox_bottom4.png",
-                                    "res/textures/asteroids/skybox_front5.png",
-                                    "res/textures/asteroids/skybox_back6.png"};
-    TextureHandle envMap = Renderer::create_cubemap_texture("EnvSpace", cubemapFnames);
-    Renderer::set_env_map(envMap);
-
-    asciiTexture = Renderer::create_texture("Ascii", "res/textures/asteroids/tex_ascii.png", IMAGE_SRGB, TEXFILTER_NEAREST);
+    WorldDelta::init("world_delta.bin");
 
-    // Load shaders
+    // Load shaders first, their pipelines get built on the job threads while the meshes and textures load
+    Renderer::begin_shader_batch();
     VertexAttribFlags defaultVertexAttribs = (VertexAttribFlags)(VERTEX_POSITION_BIT | VERTEX_TEXCOORD_0_BIT | VERTEX_NORMAL_BIT | VERTEX_TANGENT_BIT | VERTEX_COLOR_BIT);
 
     ShaderDataLayout flatColorLayout;
@@ -275,6 +512,29 @@ void Asteroids::initialize()
     toonProps[8].offset = sizeof(glm::vec4) * 4 + sizeof(r32) * 4;
     toonLayout.properties = toonProps;
     toonShader = Renderer::create_shader("toon", "shaders/toon_vert.spv", "shaders/toon_frag.spv", RENDER_LAYER_OPAQUE, defaultVertexAttribs, toonLayout, 2);
+    Renderer::end_shader_batch();
+
+    // Load meshes
+    asteroidMeshes[0] = Renderer::create_mesh("Asteroid1", "res/meshes/asteroids/asteroids/asteroid1.gltf");
+    asteroidMeshes[1] = Renderer::create_mesh("Asteroid2", "res/meshes/asteroids/asteroids/asteroid2.gltf");
+    asteroidMeshes[2] = Renderer::create_mesh("Asteroid3", "res/meshes/asteroids/asteroids/asteroid3.gltf");
+    asteroidMeshes[3] = Renderer::create_mesh("Asteroid4", "res/meshes/asteroids/asteroids/asteroid4.gltf");
+
+    shipMesh = Renderer::create_mesh("Ship", "res/meshes/asteroids/ship.gltf");
+
+    // Load textures
+    TextureHandle asteroidNormalTex = Renderer::create_texture("AsteroidNormal", "res/textures/asteroids/asteroids_normals_1k.png", IMAGE_NORMAL);
+    TextureHandle asteroidAOTex = Renderer::create_texture("AsteroidAO", "res/textures/asteroids/asteroids_occlusion_1k.png");
+    const char* cubemapFnames[6] = {"res/textures/asteroids/skybox_right1.png",
+                                    "res/textures/asteroids/skybox_left2.png",
+                                    "res/textures/asteroids/skybox_top3.png",
+                                    "res/textures/asteroids/skybox_bottom4.png",
+                                    "res/textures/asteroids/skybox_front5.png",
+                                    "res/textures/asteroids/skybox_back6.png"};
+    TextureHandle envMap = Renderer::create_cubemap_texture("EnvSpace", cubemapFnames);
+    Renderer::set_env_map(envMap);
+
+    asciiTexture = Renderer::create_texture("Ascii", "res/textures/asteroids/tex_ascii.png", IMAGE_SRGB, TEXFILTER_NEAREST);
 
     // Load materials
     ToonData whiteToonData;
@@ -320,115 +580,110 @@ void Asteroids::initialize()
 
     goldMaterial = Renderer::create_material("goldMat", pbrShader, (void*)&goldData, asteroidTextures, true);
 
-    ShaderDataLayout uiLayout;
-    uiLayout.dataSize = 0;
-    uiLayout.propertyCount = 0;
-    uiLayout.properties = nullptr;
-    uiShader = Renderer::create_shader("ui", "shaders/ui_vert.spv", "shaders/ui_frag.spv", RENDER_LAYER_OVERLAY, defaultVertexAttribs, uiLayout, 1);
+    Renderer::set_overlay_font(asciiTexture);
 
-    TextureHandle asciiTextures[8] = {asciiTexture, -1, -1, -1, -1, -1, -1, -1};
-    asciiMaterial = Renderer::create_material("asciiMat", uiShader, nullptr, asciiTextures, false);
+    Renderer::wait_for_shaders();
 }
 
-void Asteroids::play_game(r32 deltaTime)
+void Asteroids::deinit()
+{
+    WorldDelta::deinit();
+}
+
+// Called once per frame, button presses are latched until the next tick so none get lost or repeated
+void Asteroids::poll_input()
 {
     if (Input::button_down(Input::BUTTON_JUMP))
+        shootRequested = true;
+}
+
+// One fixed simulation tick
+void Asteroids::play_game(r32 deltaTime)
+{
+    if (shootRequested)
     {
         shoot();
+        shootRequested = false;
     }
 
+    player.prevPosition = player.position;
+    player.prevRotation = player.rotation;
+
     move_player(deltaTime);
     update_asteroids(deltaTime);
     update_bullets(deltaTime);
     update_gold_chunks(deltaTime);
 
-    Sector currentSector{(s32)player.position.x/SECTOR_WIDTH, (s32)player.position.z/SECTOR_HEIGHT};
+    commit_sectors();
+    stream_sectors();
 
-    for (int x = 0; x < 3; x++)
+    Sector currentSector = get_sector(player.position);
+    if (currentSector.x != playerSector.x || currentSector.y != playerSector.y)
     {
-        for (int y = 0; y < 3; y++)
-        {
-            Sector sector {currentSector.x + (x-1), currentSector.y + (y-1)};
-            bool found = false;
-
-            u32 sectorCount = activeSectors.get_count();
-            for (int i = 0; i < sectorCount; i++)
-            {
-                u32 handle = activeSectors.get_handle(i);
-                Sector activeSector = activeSectors[handle];
-
-                if (activeSector.x == sector.x && activeSector.y == sector.y)
-                {
-                    found = true;
-                    break;
-                }
-            }
-
-            if (!found)
-            {
-                Sector *newSector = activeSectors.create();
-                if (newSector != nullptr)
-                {
-                    *newSector = sector;
-                    generate_sector(newSector);
-                }
-            }
-        }
+        playerSector = currentSector;
+        evict_sectors();
     }
 
-    for (int i = 0; i < activeSectors.get_count(); i++)
-    {
-        u32 handle = activeSectors.get_handle(i);
-        Sector &activeSector = activeSectors[handle];
+    asteroids.destroy_objs();
+    goldChunks.destroy_objs();
+    bullets.destroy_objs();
+    activeSectors.destroy_objs();
 
-        glm::vec3 sectorOrigin = {activeSector.x*SECTOR_WIDTH,0,activeSector.y*SECTOR_HEIGHT};
-        if (glm::distance(sectorOrigin, player.position) > 64.f)
-        {
-            activeSectors.mark_for_destruction(&activeSector);
-        }
-    }
+    state.tick++;
+}
+
+// Renders the state between the last two ticks, alpha is how far past the latest tick the frame is
+void Asteroids::render_game(r32 alpha)
+{
+    glm::vec3 playerPos = player.prevPosition + (player.position - player.prevPosition) * alpha;
+    Quaternion playerRot = Quaternion::nlerp(player.prevRotation, player.rotation, alpha);
 
     //this is a bit stupid having to set light position manually
     glm::vec3 lightDir = Quaternion::euler(glm::radians(glm::vec3(-40.f, 135.f, 0.f))) * glm::vec3(0.0,0.0,1.0);
     glm::vec4 lightColor = {1.0*1.5,1.0*1.5,0.9658*1.5,1.0};
-    Renderer::set_light(player.position, lightDir, lightColor);
+    Renderer::set_light(playerPos, lightDir, lightColor);
 
-    camera.position = player.position + glm::vec3(0,10,0);
+    camera.position = playerPos + glm::vec3(0,10,0);
     camera.rotation = Quaternion::angle_axis(glm::radians(-90.0f), {1,0,0});
     Renderer::set_camera_position(camera.position);
     Renderer::set_camera_rotation(camera.rotation);
 
     //render ship
-    Renderer::render_mesh(shipMesh, shipMaterial, player.position, player.rotation, {1.0,1.0,1.0});
+    Renderer::render_mesh(shipMesh, shipMaterial, playerPos, playerRot, {1.0,1.0,1.0});
 
-    asteroids.destroy_objs();
-    goldChunks.destroy_objs();
-    bullets.destroy_objs();
-    activeSectors.destroy_objs();
+    render_pool(&asteroids, playerPos, alpha);
+    render_pool(&goldChunks, playerPos, alpha);
 
-    //Draw score
-    if (stringMesh >= 0)
-        Renderer::destroy_mesh(stringMesh);
+    for (u32 i = 0; i < bullets.get_count(); i++)
+    {
+        u32 handle = bullets.get_handle(i);
+        Bullet &b = bullets[handle];
+
+        glm::vec3 bulletPos = b.prevPosition + (b.position - b.prevPosition) * alpha;
+        Renderer::render_mesh(Renderer::get_mesh("Sphere"), shipMaterial, bulletPos, Quaternion::identity(), {b.radius,b.radius,b.radius});
+    }
 
-    char scoreString[100];
+    //Draw score
+    char scoreString[32];
     strcpy(scoreString, "Score: ");
     itoa(state.score, scoreString + strlen(scoreString), 10);
 
-    MeshData meshData;
-    generate_mesh_from_string(scoreString, &meshData, {1,0.75,0});
-    stringMesh = Renderer::create_mesh("", &meshData);
-
-    delete[] meshData.position;
-    delete[] meshData.texcoord0;
-    delete[] meshData.normal;
-    delete[] meshData.tangent;
-    delete[] meshData.color;
-    delete[] meshData.triangles;
-
-    // TODO: Implement proper orthographic UI rendering
-    // Now it's rendering in world space which makes it difficult to position / scale
-    glm::vec3 scorePos = player.position + glm::vec3(-3.25, 5, -1.7);
-    Renderer::render_mesh(stringMesh, asciiMaterial, scorePos, Quaternion::angle_axis(glm::radians(-90.0f), {1,0,0}), {.1,.1,.1});
+    Renderer::draw_text(scoreString, {16, 16}, 24, {1,0.75,0});
+}
+
+void Asteroids::render_pool(AsteroidPool *pool, glm::vec3 viewPos, r32 alpha)
+{
+    for (u32 i = 0; i < pool->get_count(); i++)
+    {
+        u32 handle = pool->get_handle(i);
+        Asteroid &a = (*pool)[handle];
+
+        glm::vec3 position = pool->get_interpolated_position(handle, alpha);
+        if (glm::distance(position, viewPos) >= RENDER_DISTANCE)
+            continue;
+
+        Renderer::render_mesh(a.mesh, a.mat, position, pool->get_interpolated_rotation(handle, alpha), {a.scale,a.scale,a.scale});
+    }
 }
 
 void Asteroids::move_player(r32 deltaTime)
@@ -467,11 +722,10 @@ void Asteroids::update_bullets(r32 deltaTime)
         u32 handle = bullets.get_handle(i);
         Bullet &b = bullets[handle];
 
+        b.prevPosition = b.position;
         b.position += b.velocity * deltaTime;
         b.lifetime -= deltaTime;
 
-        Renderer::render_mesh(Renderer::get_mesh("Sphere"), shipMaterial, b.position, Quaternion::identity(), {b.radius,b.radius,b.radius});
-
         if (b.lifetime <= 0)
         {
             bullets.mark_for_destruction(&b);
@@ -479,48 +733,90 @@ void Asteroids::update_bullets(r32 deltaTime)
     }
 }
 
-void Asteroids::update_asteroid(Asteroid* a, r32 deltaTime)
+void Asteroids::integrate_parallel(AsteroidPool *pool, r32 deltaTime)
 {
-    Quaternion deltaRotation = Quaternion::angle_axis(a->angularVelocity * deltaTime, a->rotationAxis);
-    a->rotation = deltaRotation * a->rotation;
+    Jobs::parallel_for(pool->get_slot_count(), MOTION_BATCH_SIZE, [pool, deltaTime](u32 first, u32 count)
+    {
+        pool->integrate_range(first, count, deltaTime);
+    });
+}
 
-    a->position += a->velocity * deltaTime;
+// Asteroids go away with the sector they were generated in, so a sector that's still active keeps all of its asteroids
+// and an evicted one can be generated again without duplicates. The jobs only read the sector table
+void Asteroids::classify_distances(AsteroidPool *pool)
+{
+    const glm::vec3 playerPos = player.position;
+    Jobs::parallel_for(pool->get_count(), CLASSIFY_BATCH_SIZE, [pool, playerPos](u32 first, u32 count)
+    {
+        for (u32 i = first; i < first + count; i++)
+        {
+            u32 handle = pool->get_handle(i);
+            r32 distance = glm::distance(pool->get_position(handle), playerPos);
+
+            if (sectorTable.find(pack_sector_key((*pool)[handle].sector)) == nullptr)
+                distanceClasses[i] = DISTANCE_DESPAWN;
+            else if (distance >= RENDER_DISTANCE)
+                distanceClasses[i] = DISTANCE_IDLE;
+            else distanceClasses[i] = DISTANCE_COLLIDE;
+        }
+    });
 }
 
 void Asteroids::update_gold_chunks(r32 deltaTime)
 {
     collidingGoldChunksCount = 0;
+
+    r32 baseAcceleration = 2.f;
+    for (u32 i = 0; i < goldChunks.get_count(); i++)
+    {
+        u32 handle = goldChunks.get_handle(i);
+
+        // Gold follows the player around, so it belongs to the sector it's in. It stays while that one is active,
+        // and is left in its delta once it isn't, where the next request for the sector picks it up
+        goldChunks[handle].sector = get_sector(goldChunks.get_position(handle));
+
+        glm::vec3 playerDirection = glm::normalize(player.position - goldChunks.get_position(handle));
+        glm::vec3 acceleration = baseAcceleration * playerDirection;
+        goldChunks.set_velocity(handle, goldChunks.get_velocity(handle) + acceleration * deltaTime);
+    }
+
+    integrate_parallel(&goldChunks, deltaTime);
+    classify_distances(&goldChunks);
+
     for (u32 i = 0; i < goldChunks.get_count(); i++)
     {
         u32 handle = goldChunks.get_handle(i);
         Asteroid &a = goldChunks[handle];
 
-        if (glm::distance(a.position, player.position) > 32.f)
+        if (distanceClasses[i] == DISTANCE_DESPAWN)
         {
+            // Leave it where it is for when the player comes back
+            WorldDelta::GoldChunk gold;
+            gold.seed = a.seed;
+            gold.position = goldChunks.get_position(handle);
+            gold.volume = a.volume;
+            gold.scale = a.scale;
+            gold.radius = a.radius;
+            gold.mass = a.mass;
+            WorldDelta::record_gold(pack_sector_key(a.sector), gold);
+
             goldChunks.mark_for_destruction(&a);
             continue;
         }
 
-        glm::vec3 playerDirection = glm::normalize(player.position - a.position);
-        r32 baseAcceleration = 2.f;
-        glm::vec3 acceleration = baseAcceleration * playerDirection;
-        a.velocity += acceleration * deltaTime;
-
-        update_asteroid(&a, deltaTime);
-
-        if (glm::distance(a.position, player.position) >= 10.f)
+        if (distanceClasses[i] != DISTANCE_COLLIDE)
             continue;
 
-        Renderer::render_mesh(a.mesh, a.mat, a.position, a.rotation, {a.scale,a.scale,a.scale});
-        collidingGoldChunks[collidingGoldChunksCount++] = &a;
+        collidingGoldChunks[collidingGoldChunksCount++] = handle;
     }
 
     for (u32 i = 0; i < collidingGoldChunksCount; i++)
     {
-        Asteroid &a = *collidingGoldChunks[i];
+        u32 handle = collidingGoldChunks[i];
+        Asteroid &a = goldChunks[handle];
 
         //Collision with player:
-        r32 distance = glm::distance(a.position, player.position);
+        r32 distance = glm::distance(goldChunks.get_position(handle), player.position);
         distance = MAX(distance, 0.0001f); // Prevent distance from being 0
 
         r32 combinedRadii = a.radius + player.radius;
@@ -535,38 +831,49 @@ void Asteroids::update_gold_chunks(r32 deltaTime)
 
 void Asteroids::update_asteroids(r32 deltaTime)
 {
+    integrate_parallel(&asteroids, deltaTime);
+    classify_distances(&asteroids);
+
     collidingAsteroidCount = 0;
+    r32 maxRadius = 0.f;
     for (u32 i = 0; i < asteroids.get_count(); i++)
     {
         u32 handle = asteroids.get_handle(i);
         Asteroid &a = asteroids[handle];
 
-        if (glm::distance(a.position, player.position) > 32.f)
+        if (distanceClasses[i] == DISTANCE_DESPAWN)
         {
             asteroids.mark_for_destruction(&a);
             continue;
         }
 
-        update_asteroid(&a, deltaTime);
-
-        if (glm::distance(a.position, player.position) >= 10.f)
+        if (distanceClasses[i] != DISTANCE_COLLIDE)
             continue;
 
-        Renderer::render_mesh(a.mesh, a.mat, a.position, a.rotation, {a.scale,a.scale,a.scale});
-        collidingAsteroids[collidingAsteroidCount++] = &a;
+        collidingAsteroids[collidingAsteroidCount++] = handle;
+        maxRadius = MAX(maxRadius, a.radius);
     }
 
+    //Broadphase: two asteroids can only touch if they're in neighbouring cells
+    asteroidGrid.begin(MAX(maxRadius * 2.f, 0.1f));
     for (u32 i = 0; i < collidingAsteroidCount; i++)
     {
-        Asteroid &a = *collidingAsteroids[i];
+        asteroidGrid.insert(asteroids.get_position(collidingAsteroids[i]));
+    }
+    asteroidGrid.end();
+
+    for (u32 i = 0; i < collidingAsteroidCount; i++)
+    {
+        u32 handle = collidingAsteroids[i];
+        Asteroid &a = asteroids[handle];
 
         //Collision with bullets:
         for (u32 j = 0; j < bullets.get_count(); j++)
         {
-            u32 handle = bullets.get_handle(j);
-            Bullet &b = bullets[handle];
+            u32 bulletHandle = bullets.get_handle(j);
+            Bullet &b = bullets[bulletHandle];
 
-            r32 distance = glm::distance(a.position, b.position);
+            r32 distance = glm::distance(asteroids.get_position(handle), b.position);
             distance = MAX(distance, 0.0001f); // Prevent distance from being 0
 
             r32 combinedRadii = a.radius + b.radius;
@@ -578,50 +885,67 @@ void Asteroids::update_asteroids(r32 deltaTime)
 
             if (a.health <= 0)
             {
-                split_asteroid(&a);
+                if (a.generated)
+                    WorldDelta::record_destroyed(pack_sector_key(a.sector), a.seed);
+
+                split_asteroid(handle);
                 asteroids.mark_for_destruction(&a);
                 return;
             }
         }
 
         //Collision with other asteroids:
-        for (u32 j = i+1; j < collidingAsteroidCount; j++)
+        asteroidGrid.for_each_candidate(i, [handle](u32 j)
         {
-            Asteroid &b = *collidingAsteroids[j];
+            resolve_asteroid_collision(handle, collidingAsteroids[j]);
+        });
+    }
+}
 
-            r32 distance = glm::distance(a.position, b.position);
-            distance = MAX(distance, 0.0001f); // Prevent distance from being 0
+void Asteroids::resolve_asteroid_collision(u32 handleA, u32 handleB)
+{
+    Asteroid *a = &asteroids[handleA];
+    Asteroid *b = &asteroids[handleB];
+    glm::vec3 posA = asteroids.get_position(handleA);
+    glm::vec3 posB = asteroids.get_position(handleB);
 
-            r32 combinedRadii = a.radius + b.radius;
-            if (distance >= combinedRadii)
-                continue;
+    r32 distance = glm::distance(posA, posB);
+    distance = MAX(distance, 0.0001f); // Prevent distance from being 0
 
-            glm::vec3 normal = (b.position - a.position) / distance;
+    r32 combinedRadii = a->radius + b->radius;
+    if (distance >= combinedRadii)
+        return;
 
-            // Resolve overlap
-            r32 overlap = (combinedRadii - distance) * 0.5f;
-            a.position -= overlap * normal;
-            b.position += overlap * normal;
+    glm::vec3 normal = (posB - posA) / distance;
 
-            glm::vec3 tangent = {-normal.z, 0, normal.x};
+    // Resolve overlap
+    r32 overlap = (combinedRadii - distance) * 0.5f;
+    asteroids.set_position(handleA, posA - overlap * normal);
+    asteroids.set_position(handleB, posB + overlap * normal);
 
-            r32 dotTanA = glm::dot(a.velocity,tangent);
-            r32 dotTanB = glm::dot(b.velocity,tangent);
+    glm::vec3 tangent = {-normal.z, 0, normal.x};
 
-            r32 dotNormalA = glm::dot(a.velocity,normal);
-            r32 dotNormalB = glm::dot(b.velocity,normal);
+    glm::vec3 velA = asteroids.get_velocity(handleA);
+    glm::vec3 velB = asteroids.get_velocity(handleB);
 
-            r32 m1 = (dotNormalA * (a.mass - b.mass) + 2.f * b.mass * dotNormalB) / (a.mass + b.mass);
-            r32 m2 = (dotNormalB * (b.mass - a.mass) + 2.f * a.mass * dotNormalA) / (a.mass + b.mass);
+    r32 dotTanA = glm::dot(velA,tangent);
+    r32 dotTanB = glm::dot(velB,tangent);
 
-            a.velocity = tangent * dotTanA + normal * m1;
-            b.velocity = tangent * dotTanB + normal * m2;
-        }
-    }
+    r32 dotNormalA = glm::dot(velA,normal);
+    r32 dotNormalB = glm::dot(velB,normal);
+
+    r32 m1 = (dotNormalA * (a->mass - b->mass) + 2.f * b->mass * dotNormalB) / (a->mass + b->mass);
+    r32 m2 = (dotNormalB * (b->mass - a->mass) + 2.f * a->mass * dotNormalA) / (a->mass + b->mass);
+
+    asteroids.set_velocity(handleA, tangent * dotTanA + normal * m1);
+    asteroids.set_velocity(handleB, tangent * dotTanB + normal * m2);
 }
 
-void Asteroids::split_asteroid(Asteroid* a)
+void Asteroids::split_asteroid(u32 handle)
 {
+    Asteroid *a = &asteroids[handle];
+    glm::vec3 position = asteroids.get_position(handle);
+
     u32 chunkCount = 2 + a->seed * 4;
     if (a->mass < 1000)
         chunkCount = 0;
@@ -637,7 +961,7 @@ void Asteroids::split_asteroid(Asteroid* a)
         goldChunkCount = 0;
     u32 totalChunkCount = chunkCount + goldChunkCount;
 
-    glm::vec3 momentum = a->velocity * a->mass;
+    glm::vec3 momentum = asteroids.get_velocity(handle) * a->mass;
     glm::vec3 chunkMomentum = (momentum * rockPercentage) / (r32)chunkCount;
     glm::vec3 goldChunkMomentum = (momentum * goldPercentage) / (r32)goldChunkCount;
     r32 chunkMass = rockMass / chunkCount;
@@ -651,7 +975,7 @@ void Asteroids::split_asteroid(Asteroid* a)
     r32 goldVolume = goldChunkMass / goldDensity;
     r32 chunkScale = volume_to_scale(chunkVolume);
     r32 goldChunkScale = volume_to_scale(goldVolume);
-    r32 chunkAngMomentum = a->angularVelocity * a->mass / totalChunkCount;
+    r32 chunkAngMomentum = asteroids.get_angular_velocity(handle) * a->mass / totalChunkCount;
     r32 chunkAngVel = chunkAngMomentum / chunkMass;
     r32 goldChunkAngVel = chunkAngMomentum / goldChunkMass;
     r32 chunkRadius = chunkScale * 0.4f;
@@ -662,11 +986,13 @@ void Asteroids::split_asteroid(Asteroid* a)
         if (asteroids.get_count() >= MAX_ASTEROID_COUNT)
             break;
 
-        Asteroid* createdChunk = asteroids.create();
+        s32 chunkHandle;
+        Asteroid* createdChunk = asteroids.create(&chunkHandle);
 
         createdChunk->sector = a->sector;
         r32 chunkSeed = hash12({a->seed, i});
         createdChunk->seed = chunkSeed;
+        createdChunk->generated = false;
 
         u32 materialIndex = std::round(chunkSeed*3);
         createdChunk->mat = asteroidMaterials[materialIndex];
@@ -676,19 +1002,19 @@ void Asteroids::split_asteroid(Asteroid* a)
         createdChunk->volume = chunkVolume;
         createdChunk->scale = chunkScale;
 
-        createdChunk->rotationAxis = glm::normalize(hash31(chunkSeed));
-        createdChunk->angularVelocity = chunkAngVel;
+        asteroids.set_angular_velocity(chunkHandle, hash31(chunkSeed), chunkAngVel);
 
         r32 angle = glm::radians((360.f / chunkCount) * i);
         Quaternion direction = Quaternion::angle_axis(angle, {0,1,0});
         glm::vec3 offset = (direction * glm::vec3(0,0,1)) * chunkRadius;
 
-        createdChunk->position = a->position + offset;
-        createdChunk->rotation = Quaternion::angle_axis(hash11(chunkSeed), hash31(chunkSeed));
+        asteroids.set_position(chunkHandle, position + offset);
+        asteroids.set_rotation(chunkHandle, Quaternion::angle_axis(hash11(chunkSeed), hash31(chunkSeed)));
+        asteroids.reset_interpolation(chunkHandle);
 
         glm::vec3 velocity = chunkVelocity + (direction * glm::vec3(0,0,1)) * explosionVelocity;
 
-        createdChunk->velocity = velocity;
+        asteroids.set_velocity(chunkHandle, velocity);
 
         createdChunk->radius = chunkRadius;
         createdChunk->mass = chunkMass;
@@ -702,11 +1028,13 @@ void Asteroids::split_asteroid(Asteroid* a)
         if (goldChunks.get_count() >= MAX_ASTEROID_COUNT)
             break;
 
-        Asteroid* createdChunk = goldChunks.create();
+        s32 chunkHandle;
+        Asteroid* createdChunk = goldChunks.create(&chunkHandle);
 
         createdChunk->sector = a->sector;
         r32 chunkSeed = hash12({a->seed, g});
         createdChunk->seed = chunkSeed;
+        createdChunk->generated = false;
 
         createdChunk->mat = goldMaterial;
         u32 meshIndex = std::round(hash11(chunkSeed)*3);
@@ -715,19 +1043,19 @@ void Asteroids::split_asteroid(Asteroid* a)
         createdChunk->volume = goldVolume;
         createdChunk->scale = goldChunkScale;
 
-        createdChunk->rotationAxis = glm::normalize(hash31(chunkSeed));
-        createdChunk->angularVelocity = goldChunkAngVel;
+        goldChunks.set_angular_velocity(chunkHandle, hash31(chunkSeed), goldChunkAngVel);
 
         r32 angle = glm::radians((360.f / goldChunkCount) * g);
         Quaternion direction = Quaternion::angle_axis(angle, {0,1,0});
         glm::vec3 offset = (direction * glm::vec3(0,0,1)) * goldRadius;
 
-        createdChunk->position = a->position + offset;
-        createdChunk->rotation = Quaternion::angle_axis(hash11(chunkSeed), hash31(chunkSeed));
+        goldChunks.set_position(chunkHandle, position + offset);
+        goldChunks.set_rotation(chunkHandle, Quaternion::angle_axis(hash11(chunkSeed), hash31(chunkSeed)));
+        goldChunks.reset_interpolation(chunkHandle);
 
         glm::vec3 velocity = goldChunkVelocity + (direction * glm::vec3(0,0,1)) * goldExplosionVelocity;
 
-        createdChunk->velocity = velocity;
+        goldChunks.set_velocity(chunkHandle, velocity);
 
         createdChunk->radius = goldRadius;
         createdChunk->mass = goldChunkMass;
@@ -4,12 +4,14 @@
 #include "../util/typedef.h"
 #include "../util/quaternion.h"
 #include "../rendering/renderer.h"
+#include "world_delta.h"
 
 namespace Asteroids
 {
     struct GameState
     {
         u32 score;
+        u32 tick;
     };
 
     struct Player
@@ -24,6 +26,10 @@ namespace Asteroids
         r32 radius = 0.5f;
 
         glm::vec3 velocity = {0.0, 0.0, 0.0};
+
+        //state at the start of the latest tick, for interpolation
+        glm::vec3 prevPosition = {0.0, 0.0, 0.0};
+        Quaternion prevRotation = {0.0, 0.0, 0.0, 1.0};
     };
 
     struct Camera
@@ -35,6 +41,7 @@ namespace Asteroids
     struct Bullet
     {
         glm::vec3 position;
+        glm::vec3 prevPosition;
         glm::vec3 velocity;
         r32 radius;
         r32 lifetime;
@@ -50,8 +57,9 @@ namespace Asteroids
 
     struct Asteroid
     {
-        Sector *sector;
+        Sector sector; //where it was generated, gold chunks move on to the sector they are in
         r32 seed;
+        bool generated; //comes from generate_sector, not from splitting
 
         MaterialHandle mat;
         MeshHandle mesh;
@@ -59,13 +67,7 @@ namespace Asteroids
         r32 volume;
         r32 scale;
 
-        glm::vec3 rotationAxis;
-        r32 angularVelocity;
-
-        glm::vec3 position;
-        Quaternion rotation;
-
-        glm::vec3 velocity;
+        //position, rotation and velocity live in the pool's motion streams
 
         //collision
         r32 radius;
@@ -74,20 +76,42 @@ namespace Asteroids
         u32 health;
     };
 
+    // Everything needed to put an asteroid in the pool, generated off the main thread
+    struct AsteroidSpawn
+    {
+        Asteroid asteroid;
+
+        glm::vec3 position;
+        Quaternion rotation;
+        glm::vec3 velocity;
+        glm::vec3 rotationAxis;
+        r32 angularVelocity;
+
+        bool gold;
+    };
+
     r32 volume_to_scale(r32 volume);
-    void init_asteroid(Asteroid* a, r32 seed, glm::vec2 sectorOrigin);
-    void generate_sector(Sector *sector);
+    void init_asteroid(AsteroidSpawn *spawn, r32 seed, glm::vec2 sectorOrigin);
+    void init_gold_chunk(AsteroidSpawn *spawn, const WorldDelta::GoldChunk &gold, Sector sector);
+    u32 generate_sector(Sector sector, const WorldDelta::SectorDelta *delta, AsteroidSpawn *outSpawns);
+    bool spawn_asteroid(const AsteroidSpawn &spawn);
+    void request_sector(Sector sector);
+    void stream_sectors();
+    void commit_sectors();
     void shoot();
     void mark_bullet_for_deletion(Bullet *b);
     void destroy_bullet(Bullet* b);
     void initialize();
+    void deinit();
+    void poll_input();
     void play_game(r32 deltaTime);
+    void render_game(r32 alpha);
     void move_player(r32 deltaTime);
     void update_bullets(r32 deltaTime);
     void update_gold_chunks(r32 deltaTime);
-    void update_asteroid(Asteroid *a, r32 deltaTime);
     void update_asteroids(r32 deltaTime);
-    void split_asteroid(Asteroid *a);
+    void resolve_asteroid_collision(u32 handleA, u32 handleB);
+    void split_asteroid(u32 handle);
     void mark_gold_chunk_for_deletion(Asteroid *a);
     void mark_asteroid_for_deletion(Asteroid *a);
     void mark_sector_for_deletion(Sector *s);
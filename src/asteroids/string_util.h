@@ -1,8 +0,0 @@
-#ifndef ASTEROIDS_STRING_UTIL_H
-#define ASTEROIDS_STRING_UTLI_H
-
-#include "../rendering/rendering_util.h"
-
-void generate_mesh_from_string(const char *s, MeshData *data, Color color = {1,1,1});
-
-#endif // ASTEROIDS_STRING_UTIL_H
@@ -0,0 +1,277 @@
+#include "world_delta.h"
+#include "../util/hash_table.h"
+#include "../util/mapped_file.h"
+#include <iostream>
+#include <cstring>
+
+namespace WorldDelta
+{
+    struct CacheEntry
+    {
+        u64 key;
+        u64 lastUsed;
+        bool used;
+        bool dirty; //changed since it was last written to the file
+        SectorDelta delta;
+    };
+
+    #define DELTA_CACHE_SIZE 64
+    CacheEntry cache[DELTA_CACHE_SIZE];
+    HashTable<u32, DELTA_CACHE_SIZE * 2> cacheTable; //sector key -> cache slot
+    u64 useCounter = 0;
+
+    // File layout: header, then records of variable length. Each record is a full snapshot of one sector's delta,
+    // the newest one for a sector wins. Records link back to the previous one so the file can be searched without the index
+    struct FileHeader
+    {
+        u32 magic;
+        u32 version;
+        u64 end;
+        u64 lastRecord;
+    };
+
+    struct RecordHeader
+    {
+        u64 key;
+        u64 prevRecord;
+        u32 destroyedCount;
+        u32 goldCount;
+    };
+
+    #define DELTA_FILE_MAGIC 0x544c4544 //DELT
+    #define DELTA_FILE_VERSION 1
+    #define DELTA_FILE_GROW_SIZE 0x10000
+
+    MappedFile file;
+    bool fileOpen = false;
+
+    #define DELTA_INDEX_SIZE 0x2000
+    HashTable<u64, DELTA_INDEX_SIZE> fileIndex; //sector key -> offset of newest record
+    bool fileIndexComplete = true; //if the index filled up, missing keys have to be searched from the file
+
+    FileHeader *get_file_header();
+    u64 find_record(u64 key);
+    void read_record(u64 offset, SectorDelta *outDelta);
+    void write_record(u64 key, const SectorDelta &delta);
+    CacheEntry *find_entry(u64 key, bool create);
+}
+
+WorldDelta::FileHeader *WorldDelta::get_file_header()
+{
+    return (FileHeader*)file.data;
+}
+
+u64 WorldDelta::find_record(u64 key)
+{
+    if (!fileOpen)
+        return 0;
+
+    u64 *indexed = fileIndex.find(key);
+    if (indexed != nullptr)
+        return *indexed;
+    if (fileIndexComplete)
+        return 0;
+
+    u64 offset = get_file_header()->lastRecord;
+    while (offset != 0)
+    {
+        RecordHeader *record = (RecordHeader*)(file.data + offset);
+        if (record->key == key)
+            return offset;
+        offset = record->prevRecord;
+    }
+    return 0;
+}
+
+void WorldDelta::read_record(u64 offset, SectorDelta *outDelta)
+{
+    RecordHeader *record = (RecordHeader*)(file.data + offset);
+    u8 *payload = file.data + offset + sizeof(RecordHeader);
+
+    outDelta->destroyedCount = record->destroyedCount;
+    memcpy(outDelta->destroyedSeeds, payload, sizeof(r32) * record->destroyedCount);
+    payload += sizeof(r32) * record->destroyedCount;
+
+    outDelta->goldCount = record->goldCount;
+    memcpy(outDelta->gold, payload, sizeof(GoldChunk) * record->goldCount);
+}
+
+void WorldDelta::write_record(u64 key, const SectorDelta &delta)
+{
+    if (!fileOpen)
+    {
+        std::cout << "World delta file not open, sector changes lost!\n";
+        return;
+    }
+
+    u64 recordSize = sizeof(RecordHeader) + sizeof(r32) * delta.destroyedCount + sizeof(GoldChunk) * delta.goldCount;
+    recordSize = (recordSize + 7) & ~7ull;
+
+    u64 offset = get_file_header()->end;
+    if (offset + recordSize > file.size)
+    {
+        if (!resize_mapped_file(&file, file.size + DELTA_FILE_GROW_SIZE))
+        {
+            // The old mapping is already gone, release the rest and go on without the file
+            close_mapped_file(&file);
+            fileOpen = false;
+            return;
+        }
+    }
+
+    RecordHeader *record = (RecordHeader*)(file.data + offset);
+    record->key = key;
+    record->prevRecord = get_file_header()->lastRecord;
+    record->destroyedCount = delta.destroyedCount;
+    record->goldCount = delta.goldCount;
+
+    u8 *payload = file.data + offset + sizeof(RecordHeader);
+    memcpy(payload, delta.destroyedSeeds, sizeof(r32) * delta.destroyedCount);
+    payload += sizeof(r32) * delta.destroyedCount;
+    memcpy(payload, delta.gold, sizeof(GoldChunk) * delta.goldCount);
+
+    get_file_header()->end = offset + recordSize;
+    get_file_header()->lastRecord = offset;
+
+    u64 *indexed = fileIndex.find(key);
+    if (indexed != nullptr)
+        *indexed = offset;
+    else if (!fileIndex.insert(key, offset))
+        fileIndexComplete = false;
+}
+
+// Returns the cached delta of a sector, loading it from the file if needed. Without create, sectors that
+// have no changes return nullptr instead of taking up a cache slot
+WorldDelta::CacheEntry *WorldDelta::find_entry(u64 key, bool create)
+{
+    u32 *cached = cacheTable.find(key);
+    if (cached != nullptr)
+    {
+        cache[*cached].lastUsed = ++useCounter;
+        return &cache[*cached];
+    }
+
+    u64 recordOffset = find_record(key);
+    if (recordOffset == 0 && !create)
+        return nullptr;
+
+    // Find a free slot or the least recently used one
+    u32 slot = 0;
+    for (u32 i = 0; i < DELTA_CACHE_SIZE; i++)
+    {
+        if (!cache[i].used)
+        {
+            slot = i;
+            break;
+        }
+        if (cache[i].lastUsed < cache[slot].lastUsed)
+            slot = i;
+    }
+
+    CacheEntry &entry = cache[slot];
+    if (entry.used)
+    {
+        if (entry.dirty)
+            write_record(entry.key, entry.delta);
+        cacheTable.remove(entry.key);
+    }
+
+    entry.key = key;
+    entry.lastUsed = ++useCounter;
+    entry.used = true;
+    entry.dirty = false;
+
+    if (recordOffset != 0)
+        read_record(recordOffset, &entry.delta);
+    else
+    {
+        entry.delta.destroyedCount = 0;
+        entry.delta.goldCount = 0;
+    }
+
+    cacheTable.insert(key, slot);
+    return &entry;
+}
+
+void WorldDelta::init(const char *fname)
+{
+    for (u32 i = 0; i < DELTA_CACHE_SIZE; i++)
+    {
+        cache[i].used = false;
+    }
+    cacheTable.clear();
+    fileIndex.clear();
+    fileIndexComplete = true;
+    useCounter = 0;
+
+    // Scratch file, it only lives as long as the session
+    fileOpen = open_mapped_file(&file, fname, DELTA_FILE_GROW_SIZE);
+    if (!fileOpen)
+    {
+        close_mapped_file(&file);
+        return;
+    }
+
+    FileHeader *header = get_file_header();
+    header->magic = DELTA_FILE_MAGIC;
+    header->version = DELTA_FILE_VERSION;
+    header->end = sizeof(FileHeader);
+    header->lastRecord = 0;
+}
+
+void WorldDelta::deinit()
+{
+    if (fileOpen)
+        close_mapped_file(&file);
+    fileOpen = false;
+}
+
+void WorldDelta::record_destroyed(u64 sectorKey, r32 seed)
+{
+    CacheEntry *entry = find_entry(sectorKey, true);
+    if (entry->delta.destroyedCount >= MAX_DESTROYED_PER_SECTOR)
+        return;
+
+    entry->delta.destroyedSeeds[entry->delta.destroyedCount++] = seed;
+    entry->dirty = true;
+}
+
+void WorldDelta::record_gold(u64 sectorKey, const GoldChunk &gold)
+{
+    CacheEntry *entry = find_entry(sectorKey, true);
+    if (entry->delta.goldCount >= MAX_PENDING_GOLD_PER_SECTOR)
+    {
+        std::cout << "Too much gold left in sector, some of it is lost!\n";
+        return;
+    }
+
+    entry->delta.gold[entry->delta.goldCount++] = gold;
+    entry->dirty = true;
+}
+
+void WorldDelta::take_sector_delta(u64 sectorKey, SectorDelta *outDelta)
+{
+    outDelta->destroyedCount = 0;
+    outDelta->goldCount = 0;
+
+    CacheEntry *entry = find_entry(sectorKey, false);
+    if (entry == nullptr)
+        return;
+
+    *outDelta = entry->delta;
+    if (entry->delta.goldCount > 0)
+    {
+        entry->delta.goldCount = 0;
+        entry->dirty = true;
+    }
+}
+
+bool WorldDelta::is_destroyed(const SectorDelta &delta, r32 seed)
+{
+    for (u32 i = 0; i < delta.destroyedCount; i++)
+    {
+        if (delta.destroyedSeeds[i] == seed)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,44 @@
+#ifndef WORLD_DELTA_H
+#define WORLD_DELTA_H
+
+#include <glm/glm.hpp>
+#include "../util/typedef.h"
+
+// Changes the player has made to the procedurally generated world, per sector: which generated asteroids
+// are gone and which gold chunks were left floating around. Recently used sectors are kept in memory,
+// the rest get written to an append-only scratch file, so memory doesn't grow with the number of sectors visited.
+namespace WorldDelta
+{
+    struct GoldChunk
+    {
+        r32 seed;
+        glm::vec3 position;
+        r32 volume;
+        r32 scale;
+        r32 radius;
+        r32 mass;
+    };
+
+    #define MAX_DESTROYED_PER_SECTOR 32 //can't destroy more than a sector generates
+    #define MAX_PENDING_GOLD_PER_SECTOR 32
+    struct SectorDelta
+    {
+        u32 destroyedCount;
+        r32 destroyedSeeds[MAX_DESTROYED_PER_SECTOR];
+        u32 goldCount;
+        GoldChunk gold[MAX_PENDING_GOLD_PER_SECTOR];
+    };
+
+    void init(const char *fname);
+    void deinit();
+
+    void record_destroyed(u64 sectorKey, r32 seed);
+    void record_gold(u64 sectorKey, const GoldChunk &gold);
+
+    // Copies the delta of a sector that is about to be generated. Pending gold is removed from the store,
+    // since it's going to be spawned again. Gold that ends up not being spawned has to be put back with record_gold
+    void take_sector_delta(u64 sectorKey, SectorDelta *outDelta);
+    bool is_destroyed(const SectorDelta &delta, r32 seed);
+}
+
+#endif // WORLD_DELTA_H
@@ -8,15 +8,22 @@ namespace Input
 
     State inputState;
 
+    bool scriptedInput = false;
 }
 
 void Input::init()
 {
+    if (scriptedInput)
+        return;
+
     SDL::init_controller();
 }
 
 void Input::deinit()
 {
+    if (scriptedInput)
+        return;
+
     SDL::deinit_controller();
 }
 
@@ -32,7 +39,23 @@ void Input::refresh()
         inputState.button[i].prevState = inputState.button[i].state;
     }
 
-    SDL::poll_input(&inputState);
+    if (!scriptedInput)
+        SDL::poll_input(&inputState);
+}
+
+void Input::set_scripted(bool scripted)
+{
+    scriptedInput = scripted;
+}
+
+void Input::set_axis(Axis axis, r64 value)
+{
+    inputState.axis[axis].state = value;
+}
+
+void Input::set_button(Button button, bool state)
+{
+    inputState.button[button].state = state;
 }
 
 const r64 Input::axis(Axis axis)
@@ -85,6 +108,9 @@ const bool Input::exit()
 
 void Input::controller_rumble(r32 strength, r32 length)
 {
+    if (scriptedInput)
+        return;
+
     SDL::controller_rumble(strength, length * 1000);
 }
 
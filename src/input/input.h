@@ -57,6 +57,11 @@ namespace Input
     void deinit();
     void refresh();
 
+    //scripted input doesn't poll the platform, state only changes through set_axis and set_button
+    void set_scripted(bool scripted);
+    void set_axis(Axis axis, r64 value);
+    void set_button(Button button, bool state);
+
     const r64 axis(Axis axis);
     const bool axis_moved(Axis axis);
     const bool axis_released(Axis axis);
@@ -0,0 +1,218 @@
+#include "jobs.h"
+#include <cstdint>
+#include <iostream>
+
+namespace Jobs
+{
+    struct Job
+    {
+        JobFunc func;
+        void *data;
+        u32 first;
+        u32 count;
+        Counter *counter;
+    };
+
+    #define MAX_WORKER_COUNT 16
+    #define JOB_QUEUE_SIZE 1024 //must be a power of two
+
+    struct JobQueue
+    {
+        Job jobs[JOB_QUEUE_SIZE];
+        u32 top; //thieves take from here
+        u32 bottom; //owner pushes and pops here
+        SDL_SpinLock lock;
+    };
+
+    JobQueue queues[MAX_WORKER_COUNT]; //queue 0 belongs to the main thread
+    SDL_Thread *threads[MAX_WORKER_COUNT];
+    u32 workerCount = 1;
+
+    SDL_sem *jobSemaphore = nullptr;
+    SDL_atomic_t quit;
+
+    thread_local u32 workerIndex = 0;
+
+    bool push_job(JobQueue *queue, const Job &job);
+    bool pop_job(JobQueue *queue, Job *outJob);
+    bool steal_job(JobQueue *queue, Job *outJob);
+    void execute_job(const Job &job);
+    bool try_run_job();
+    int worker_main(void *data);
+}
+
+bool Jobs::push_job(JobQueue *queue, const Job &job)
+{
+    SDL_AtomicLock(&queue->lock);
+    if (queue->bottom - queue->top >= JOB_QUEUE_SIZE)
+    {
+        SDL_AtomicUnlock(&queue->lock);
+        return false;
+    }
+
+    queue->jobs[queue->bottom & (JOB_QUEUE_SIZE - 1)] = job;
+    queue->bottom++;
+    SDL_AtomicUnlock(&queue->lock);
+    return true;
+}
+
+bool Jobs::pop_job(JobQueue *queue, Job *outJob)
+{
+    SDL_AtomicLock(&queue->lock);
+    if (queue->bottom == queue->top)
+    {
+        SDL_AtomicUnlock(&queue->lock);
+        return false;
+    }
+
+    queue->bottom--;
+    *outJob = queue->jobs[queue->bottom & (JOB_QUEUE_SIZE - 1)];
+    SDL_AtomicUnlock(&queue->lock);
+    return true;
+}
+
+bool Jobs::steal_job(JobQueue *queue, Job *outJob)
+{
+    SDL_AtomicLock(&queue->lock);
+    if (queue->bottom == queue->top)
+    {
+        SDL_AtomicUnlock(&queue->lock);
+        return false;
+    }
+
+    *outJob = queue->jobs[queue->top & (JOB_QUEUE_SIZE - 1)];
+    queue->top++;
+    SDL_AtomicUnlock(&queue->lock);
+    return true;
+}
+
+void Jobs::execute_job(const Job &job)
+{
+    job.func(job.data, job.first, job.count);
+
+    if (job.counter != nullptr)
+        SDL_AtomicAdd(&job.counter->value, -1);
+}
+
+bool Jobs::try_run_job()
+{
+    Job job;
+    bool found = pop_job(&queues[workerIndex], &job);
+
+    for (u32 i = 1; !found && i < workerCount; i++)
+    {
+        found = steal_job(&queues[(workerIndex + i) % workerCount], &job);
+    }
+
+    if (!found)
+        return false;
+
+    execute_job(job);
+    return true;
+}
+
+int Jobs::worker_main(void *data)
+{
+    workerIndex = (u32)(uintptr_t)data;
+
+    while (!SDL_AtomicGet(&quit))
+    {
+        SDL_SemWait(jobSemaphore);
+        while (try_run_job());
+    }
+
+    return 0;
+}
+
+void Jobs::init(u32 count)
+{
+    if (count == 0)
+        count = SDL_GetCPUCount();
+    workerCount = count < 1 ? 1 : (count > MAX_WORKER_COUNT ? MAX_WORKER_COUNT : count);
+
+    for (u32 i = 0; i < MAX_WORKER_COUNT; i++)
+    {
+        queues[i].top = 0;
+        queues[i].bottom = 0;
+        queues[i].lock = 0;
+    }
+
+    SDL_AtomicSet(&quit, 0);
+    jobSemaphore = SDL_CreateSemaphore(0);
+    workerIndex = 0;
+
+    for (u32 i = 1; i < workerCount; i++)
+    {
+        threads[i] = SDL_CreateThread(worker_main, "JobWorker", (void*)(uintptr_t)i);
+        if (threads[i] == nullptr)
+        {
+            std::cout << "Failed to create job worker thread!\n";
+            workerCount = i;
+            break;
+        }
+    }
+}
+
+void Jobs::deinit()
+{
+    SDL_AtomicSet(&quit, 1);
+    for (u32 i = 1; i < workerCount; i++)
+    {
+        SDL_SemPost(jobSemaphore);
+    }
+    for (u32 i = 1; i < workerCount; i++)
+    {
+        SDL_WaitThread(threads[i], nullptr);
+    }
+
+    SDL_DestroySemaphore(jobSemaphore);
+    jobSemaphore = nullptr;
+    workerCount = 1;
+}
+
+u32 Jobs::get_worker_count()
+{
+    return workerCount;
+}
+
+void Jobs::run(JobFunc func, void *data, u32 first, u32 count, Counter *counter)
+{
+    Job job;
+    job.func = func;
+    job.data = data;
+    job.first = first;
+    job.count = count;
+    job.counter = counter;
+
+    if (counter != nullptr)
+        SDL_AtomicAdd(&counter->value, 1);
+
+    // Single threaded or queue full, just do it now
+    if (workerCount == 1 || !push_job(&queues[workerIndex], job))
+    {
+        execute_job(job);
+        return;
+    }
+
+    SDL_SemPost(jobSemaphore);
+}
+
+void Jobs::parallel_for(JobFunc func, void *data, u32 count, u32 batchSize, Counter *counter)
+{
+    if (batchSize == 0)
+        batchSize = 1;
+
+    for (u32 first = 0; first < count; first += batchSize)
+    {
+        u32 batchCount = count - first < batchSize ? count - first : batchSize;
+        run(func, data, first, batchCount, counter);
+    }
+}
+
+void Jobs::wait(Counter *counter)
+{
+    while (SDL_AtomicGet(&counter->value) > 0)
+    {
+        try_run_job();
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+#include <SDL.h>
+#include "../util/typedef.h"
+
+// Work-stealing job system. Every thread (the main thread included) owns a queue, pushes and pops its own jobs
+// at the bottom and steals from the top of the others' when it runs dry.
+// Jobs must not touch shared state other than what they were handed: write results per index and apply them
+// afterwards on the calling thread in a fixed order, so the outcome doesn't depend on the thread count.
+namespace Jobs
+{
+    typedef void (*JobFunc)(void *data, u32 first, u32 count);
+
+    // Number of jobs still running, wait() returns when it reaches zero
+    struct Counter
+    {
+        SDL_atomic_t value;
+
+        Counter()
+        {
+            SDL_AtomicSet(&value, 0);
+        }
+    };
+
+    // workerCount 0 means one thread per logical core
+    void init(u32 workerCount = 0);
+    void deinit();
+    u32 get_worker_count();
+
+    void run(JobFunc func, void *data, u32 first, u32 count, Counter *counter);
+    // Splits [0, count) into batches of batchSize items, one job each
+    void parallel_for(JobFunc func, void *data, u32 count, u32 batchSize, Counter *counter);
+    // Runs queued jobs while waiting instead of blocking
+    void wait(Counter *counter);
+
+    template <typename F>
+    void call_body(void *data, u32 first, u32 count)
+    {
+        (*(F*)data)(first, count);
+    }
+
+    // Calls body(first, count) for every batch and returns once all of them are done
+    template <typename F>
+    void parallel_for(u32 count, u32 batchSize, F body)
+    {
+        Counter counter;
+        parallel_for(&call_body<F>, (void*)&body, count, batchSize, &counter);
+        wait(&counter);
+    }
+}
+
+#endif // JOBS_H
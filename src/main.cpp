@@ -1,52 +1,681 @@
 #include <iostream>
+#include <iomanip>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
 #include <SDL.h>
 #include <SDL_vulkan.h>
 
 #define GLM_FORCE_RADIANS
 #include <glm/gtx/rotate_vector.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 
 #include "input/input.h"
+#include "jobs/jobs.h"
 #include "rendering/renderer.h"
 #include "time/time.h"
 #include "rendering/image_loader.h"
+#include "rendering/transform_kernel.h"
 #include "asteroids/asteroids.h"
+#include "util/math.h"
+#include "util/arena.h"
+#include "util/radix_sort.h"
+#include "util/spatial_hash.h"
+#include "util/resource_pool.h"
+
+#define DEFAULT_TICK_RATE 60 //simulation ticks per second
+#define MAX_TICKS_PER_FRAME 5 //after a hitch, drop time instead of trying to catch up all at once
+
+struct SubsystemTiming
+{
+    const char *name;
+    r64 total;
+    r64 max;
+};
+
+void add_timing(SubsystemTiming *timing, r64 start, r64 end)
+{
+    r64 time = end - start;
+    timing->total += time;
+    timing->max = MAX(timing->max, time);
+}
+
+// Same scripted input every run: keep thrusting, turn in bursts and fire every few ticks
+void script_input(u32 tick)
+{
+    Input::set_button(Input::BUTTON_UP, true);
+    Input::set_button(Input::BUTTON_RIGHT, (tick % 240) < 90);
+    Input::set_button(Input::BUTTON_JUMP, (tick % 15) == 0);
+}
+
+// Runs the game for a fixed number of ticks on the null renderer, rendering every tick, and prints where the time went
+void run_headless(u32 tickCount, r64 tickLength)
+{
+    enum
+    {
+        TIMING_PLAY_GAME,
+        TIMING_RENDER_GAME,
+        TIMING_SORT_DRAWCALLS,
+        TIMING_DRAW,
+        TIMING_COUNT
+    };
+    SubsystemTiming timings[TIMING_COUNT] = {{"play_game", 0, 0},
+                                             {"render_game", 0, 0},
+                                             {"sort_drawcalls", 0, 0},
+                                             {"draw", 0, 0}};
+
+    u64 drawcalls = 0;
+    u64 batches = 0;
+    u64 arenaAllocs = 0;
+    u64 heapAllocs = 0; //should stay at 0, otherwise the frame arena is too small
+
+    r64 runStart = Time::current_time_in_ms();
+    for (u32 tick = 0; tick < tickCount; tick++)
+    {
+        Input::refresh();
+        script_input(tick);
+        Asteroids::poll_input();
+
+        r64 t0 = Time::current_time_in_ms();
+        Asteroids::play_game(tickLength / 1000.0);
+        r64 t1 = Time::current_time_in_ms();
+
+        Renderer::clear_queue();
+        Asteroids::render_game(1.0f);
+        r64 t2 = Time::current_time_in_ms();
+
+        Renderer::sort_drawcalls();
+        r64 t3 = Time::current_time_in_ms();
+
+        Renderer::draw();
+        r64 t4 = Time::current_time_in_ms();
+
+        add_timing(&timings[TIMING_PLAY_GAME], t0, t1);
+        add_timing(&timings[TIMING_RENDER_GAME], t1, t2);
+        add_timing(&timings[TIMING_SORT_DRAWCALLS], t2, t3);
+        add_timing(&timings[TIMING_DRAW], t3, t4);
+
+        drawcalls += Renderer::get_drawcall_count();
+        batches += Renderer::get_batch_count();
+
+        Arena *frameArena = Renderer::get_frame_arena();
+        arenaAllocs += frameArena->allocCount;
+        heapAllocs += frameArena->heapAllocCount;
+    }
+    r64 runTime = Time::current_time_in_ms() - runStart;
+
+    std::cout << "Headless run: " << tickCount << " ticks, " << Jobs::get_worker_count() << " job workers, " << runTime << " ms\n";
+    std::cout << std::left << std::setw(16) << "subsystem" << std::right << std::setw(12) << "total ms" << std::setw(12) << "avg ms" << std::setw(12) << "max ms" << "\n";
+    std::cout << std::fixed << std::setprecision(4);
+    for (u32 i = 0; i < TIMING_COUNT; i++)
+    {
+        std::cout << std::left << std::setw(16) << timings[i].name << std::right << std::setw(12) << timings[i].total;
+        std::cout << std::setw(12) << timings[i].total / MAX(tickCount, 1u) << std::setw(12) << timings[i].max << "\n";
+    }
+    std::cout << "Drawcalls: " << (r64)drawcalls / MAX(tickCount, 1u) << " per frame in " << (r64)batches / MAX(tickCount, 1u) << " instanced draws\n";
+    std::cout << "Frame arena: " << (r64)arenaAllocs / MAX(tickCount, 1u) << " allocations per frame, " << heapAllocs << " heap fallbacks, ";
+    std::cout << Renderer::get_frame_arena()->peak << " bytes peak\n";
+    std::cout << std::endl;
+}
+
+// Sorts random drawcall keys laid out like the renderer's opaque layer (material, mesh, depth, data index)
+// with std::sort and the radix sort, and prints the average time of each
+void run_sort_benchmark(u32 iterations)
+{
+    const u32 sizes[] = {0x400, 0x4000, 0x10000};
+    const u32 maxSize = 0x10000;
+
+    Renderer::DrawCall *keys = (Renderer::DrawCall*)malloc(sizeof(Renderer::DrawCall) * maxSize);
+    Renderer::DrawCall *sorted = (Renderer::DrawCall*)malloc(sizeof(Renderer::DrawCall) * maxSize);
+    Renderer::DrawCall *radixSorted = (Renderer::DrawCall*)malloc(sizeof(Renderer::DrawCall) * maxSize);
+    Renderer::DrawCall *scratch = (Renderer::DrawCall*)malloc(sizeof(Renderer::DrawCall) * maxSize);
+
+    srand(1);
+
+    std::cout << "Sort benchmark: " << iterations << " iterations\n";
+    std::cout << std::setw(10) << "drawcalls" << std::setw(16) << "std::sort ms" << std::setw(16) << "radix_sort ms" << "\n";
+    std::cout << std::fixed << std::setprecision(4);
+    for (u32 size : sizes)
+    {
+        r64 sortTime = 0;
+        r64 radixTime = 0;
+        bool match = true;
+
+        for (u32 iteration = 0; iteration < iterations; iteration++)
+        {
+            for (u32 i = 0; i < size; i++)
+            {
+                u64 depth = rand() % 0x1000000;
+                keys[i].sortingID = (u64)(rand() % 16) << 44 | (u64)(rand() % 32) << 36 | depth << 12 | (i % 0x1000);
+            }
+            memcpy(sorted, keys, sizeof(Renderer::DrawCall) * size);
+            memcpy(radixSorted, keys, sizeof(Renderer::DrawCall) * size);
+
+            r64 t0 = Time::current_time_in_ms();
+            std::sort(sorted, sorted + size, [](const Renderer::DrawCall &a, const Renderer::DrawCall &b)
+            {
+                return a.sortingID < b.sortingID;
+            });
+            r64 t1 = Time::current_time_in_ms();
+            radix_sort<Renderer::DrawCall, Renderer::drawcall_get_sort_key>(radixSorted, scratch, size);
+            r64 t2 = Time::current_time_in_ms();
+
+            sortTime += t1 - t0;
+            radixTime += t2 - t1;
+            match = match && memcmp(sorted, radixSorted, sizeof(Renderer::DrawCall) * size) == 0;
+        }
+
+        std::cout << std::setw(10) << size << std::setw(16) << sortTime / iterations << std::setw(16) << radixTime / iterations;
+        std::cout << (match ? "" : "  MISMATCH") << "\n";
+    }
+    std::cout << std::endl;
+
+    free(scratch);
+    free(radixSorted);
+    free(sorted);
+    free(keys);
+}
+
+// The matrix path from before the transform kernels: full 4x4 translation, rotation and scale multiplied together
+glm::mat4 build_matrix_glm(glm::vec3 pos, Quaternion rot, glm::vec3 scl)
+{
+    glm::mat4 rotation;
+    rotation[0][0] = 1 - 2 * rot.y * rot.y - 2 * rot.z * rot.z;
+    rotation[0][1] = 2 * rot.x * rot.y + 2 * rot.z * rot.w;
+    rotation[0][2] = 2 * rot.x * rot.z - 2 * rot.y * rot.w;
+    rotation[0][3] = 0;
+    rotation[1][0] = 2 * rot.x * rot.y - 2 * rot.z * rot.w;
+    rotation[1][1] = 1 - 2 * rot.x * rot.x - 2 * rot.z * rot.z;
+    rotation[1][2] = 2 * rot.y * rot.z + 2 * rot.x * rot.w;
+    rotation[1][3] = 0;
+    rotation[2][0] = 2 * rot.x * rot.z + 2 * rot.y * rot.w;
+    rotation[2][1] = 2 * rot.y * rot.z - 2 * rot.x * rot.w;
+    rotation[2][2] = 1 - 2 * rot.x * rot.x - 2 * rot.y * rot.y;
+    rotation[2][3] = 0;
+    rotation[3][0] = 0;
+    rotation[3][1] = 0;
+    rotation[3][2] = 0;
+    rotation[3][3] = 1;
+
+    return glm::translate(glm::mat4(1.0f), pos) * rotation * glm::scale(glm::mat4(1.0f), scl);
+}
+
+// Builds MAX_TRANSFORMS random transforms with the old glm path and every transform kernel the CPU supports,
+// and prints the average time of each and its largest difference from the glm result
+void run_transform_benchmark(u32 iterations)
+{
+    const u32 count = MAX_TRANSFORMS;
+
+    r32 *components = (r32*)malloc(sizeof(r32) * TRANSFORM_COMPONENT_COUNT * count);
+    TransformKernel::TransformStreams streams = TransformKernel::make_streams(components, count);
+    u16 *indices = (u16*)malloc(sizeof(u16) * count);
+    glm::mat4 *reference = (glm::mat4*)malloc(sizeof(glm::mat4) * count);
+    AffineMatrix *matrices = (AffineMatrix*)malloc(sizeof(AffineMatrix) * count);
+
+    srand(1);
+    for (u32 i = 0; i < count; i++)
+    {
+        glm::vec3 pos(rand() % 1000 - 500.0f, rand() % 1000 - 500.0f, rand() % 1000 - 500.0f);
+        glm::vec3 axis(rand() % 100 + 1.0f, rand() % 100 - 50.0f, rand() % 100 - 50.0f);
+        Quaternion rot = Quaternion::angle_axis((rand() % 628) / 100.0f, axis);
+        glm::vec3 scl(rand() % 40 / 10.0f + 0.1f, rand() % 40 / 10.0f + 0.1f, rand() % 40 / 10.0f + 0.1f);
+        TransformKernel::set_transform(streams, i, pos, rot, scl);
+        indices[i] = i;
+    }
+
+    TransformKernel::init();
+    TransformKernel::KernelLevel supported = TransformKernel::get_level();
+
+    std::cout << "Transform benchmark: " << count << " transforms, " << iterations << " iterations\n";
+    std::cout << std::left << std::setw(10) << "path" << std::right << std::setw(12) << "ms" << std::setw(14) << "max error" << "\n";
+    std::cout << std::fixed << std::setprecision(4);
+
+    r64 start = Time::current_time_in_ms();
+    for (u32 iteration = 0; iteration < iterations; iteration++)
+    {
+        for (u32 i = 0; i < count; i++)
+        {
+            u32 j = indices[i];
+            glm::vec3 pos(streams.posX[j], streams.posY[j], streams.posZ[j]);
+            Quaternion rot(streams.rotX[j], streams.rotY[j], streams.rotZ[j], streams.rotW[j]);
+            glm::vec3 scl(streams.sclX[j], streams.sclY[j], streams.sclZ[j]);
+            reference[i] = build_matrix_glm(pos, rot, scl);
+        }
+    }
+    std::cout << std::left << std::setw(10) << "glm" << std::right << std::setw(12) << (Time::current_time_in_ms() - start) / iterations << "\n";
+
+    for (u32 level = 0; level <= supported; level++)
+    {
+        TransformKernel::set_level((TransformKernel::KernelLevel)level);
+
+        start = Time::current_time_in_ms();
+        for (u32 iteration = 0; iteration < iterations; iteration++)
+        {
+            TransformKernel::build_matrices(streams, indices, count, matrices);
+        }
+        r64 time = (Time::current_time_in_ms() - start) / iterations;
+
+        r32 maxError = 0;
+        for (u32 i = 0; i < count; i++)
+        {
+            for (u32 row = 0; row < 3; row++)
+            {
+                for (u32 column = 0; column < 4; column++)
+                {
+                    maxError = MAX(maxError, std::abs(matrices[i].rows[row][column] - reference[i][column][row]));
+                }
+            }
+        }
+
+        std::cout << std::left << std::setw(10) << TransformKernel::get_level_name((TransformKernel::KernelLevel)level) << std::right << std::setw(12) << time;
+        std::cout << std::setw(14) << std::setprecision(8) << maxError << std::setprecision(4) << "\n";
+    }
+    std::cout << std::endl;
+
+    free(matrices);
+    free(reference);
+    free(indices);
+    free(components);
+}
+
+// Finds the touching pairs of random asteroids spread at the density of a sector (20 per 16x16 units)
+// with the nested loop from before the spatial hash and with the hash, and prints the time and pair tests of each.
+// The nested loop is O(n^2), so it only runs once per size
+void run_broadphase_benchmark(u32 iterations)
+{
+    const u32 sizes[] = {1000, 10000, 100000};
+    const u32 maxSize = 100000;
+
+    glm::vec3 *positions = (glm::vec3*)malloc(sizeof(glm::vec3) * maxSize);
+    r32 *radii = (r32*)malloc(sizeof(r32) * maxSize);
+    SpatialHash<maxSize, 0x20000> *grid = new SpatialHash<maxSize, 0x20000>();
+
+    srand(1);
+
+    std::cout << "Broadphase benchmark: " << iterations << " iterations\n";
+    std::cout << std::setw(10) << "asteroids" << std::setw(14) << "loop ms" << std::setw(14) << "loop tests";
+    std::cout << std::setw(14) << "hash ms" << std::setw(14) << "hash tests" << std::setw(10) << "contacts" << "\n";
+    std::cout << std::fixed << std::setprecision(4);
+    for (u32 size : sizes)
+    {
+        const r32 side = std::sqrt(size * 16.f * 16.f / 20.f);
+        r32 maxRadius = 0;
+        for (u32 i = 0; i < size; i++)
+        {
+            positions[i] = glm::vec3(side * rand() / RAND_MAX, 0, side * rand() / RAND_MAX);
+            r32 volume = 0.05f + 3.95f * rand() / RAND_MAX;
+            radii[i] = Asteroids::volume_to_scale(volume) * 0.4f;
+            maxRadius = MAX(maxRadius, radii[i]);
+        }
+
+        // Contacts are summed up as pair ids, so both ways have to find the same set and not only as many
+        u64 loopTests = 0;
+        u64 loopContacts = 0;
+        u64 loopChecksum = 0;
+
+        r64 t0 = Time::current_time_in_ms();
+        for (u32 i = 0; i < size; i++)
+        {
+            for (u32 j = i + 1; j < size; j++)
+            {
+                loopTests++;
+                if (glm::distance(positions[i], positions[j]) < radii[i] + radii[j])
+                {
+                    loopContacts++;
+                    loopChecksum += (u64)i * size + j;
+                }
+            }
+        }
+        r64 loopTime = Time::current_time_in_ms() - t0;
+
+        u64 hashTests = 0;
+        u64 hashContacts = 0;
+        u64 hashChecksum = 0;
+        bool match = true;
+
+        t0 = Time::current_time_in_ms();
+        for (u32 iteration = 0; iteration < iterations; iteration++)
+        {
+            hashTests = 0;
+            hashContacts = 0;
+            hashChecksum = 0;
+
+            grid->begin(MAX(maxRadius * 2.f, 0.1f));
+            for (u32 i = 0; i < size; i++)
+            {
+                grid->insert(positions[i]);
+            }
+            grid->end();
+
+            for (u32 i = 0; i < size; i++)
+            {
+                grid->for_each_candidate(i, [&](u32 j)
+                {
+                    hashTests++;
+                    if (glm::distance(positions[i], positions[j]) < radii[i] + radii[j])
+                    {
+                        hashContacts++;
+                        hashChecksum += (u64)i * size + j;
+                    }
+                });
+            }
+            match = match && hashContacts == loopContacts && hashChecksum == loopChecksum;
+        }
+        r64 hashTime = (Time::current_time_in_ms() - t0) / iterations;
+
+        std::cout << std::setw(10) << size << std::setw(14) << loopTime << std::setw(14) << loopTests;
+        std::cout << std::setw(14) << hashTime << std::setw(14) << hashTests << std::setw(10) << hashContacts;
+        std::cout << (match ? "" : "  MISMATCH") << "\n";
+    }
+    std::cout << std::endl;
+
+    delete grid;
+    free(radii);
+    free(positions);
+}
+
+// The pool from before the slot map, cut down to what the benchmark uses: destroying searches the live handles for the object
+template <class T, u32 poolSize>
+struct LinearSearchPool
+{
+    T objs[poolSize];
+    u32 handles[poolSize];
+    u32 count;
+
+    T *objsToDelete[poolSize];
+    u32 objsToDeleteCount;
+
+    LinearSearchPool()
+    {
+        count = 0;
+        objsToDeleteCount = 0;
+
+        for (u32 i = 0; i < poolSize; i++)
+        {
+            handles[i] = i;
+        }
+    }
+
+    T *create()
+    {
+        if (count >= poolSize)
+            return nullptr;
+
+        return &objs[handles[count++]];
+    }
+
+    void mark_for_destruction(T *obj)
+    {
+        objsToDelete[objsToDeleteCount++] = obj;
+    }
+
+    void destroy_objs()
+    {
+        for (u32 d = 0; d < objsToDeleteCount; d++)
+        {
+            for (u32 i = 0; i < count; i++)
+            {
+                const u32 handle = handles[i];
+                if (&objs[handle] != objsToDelete[d])
+                    continue;
+
+                count--;
+                handles[i] = handles[count];
+                handles[count] = handle;
+                break;
+            }
+        }
+        objsToDeleteCount = 0;
+    }
+};
+
+// Fills both pools, marks half of the objects in random order and times destroy_objs,
+// then checks that the same handles are left alive
+template <u32 size>
+void run_pool_benchmark_size(u32 iterations)
+{
+    u32 *order = (u32*)malloc(sizeof(u32) * size);
+    u32 *alive = (u32*)malloc(sizeof(u32) * size);
+    r64 linearTime = 0;
+    r64 slotMapTime = 0;
+    bool match = true;
+
+    for (u32 iteration = 0; iteration < iterations; iteration++)
+    {
+        LinearSearchPool<u32, size> *linearPool = new LinearSearchPool<u32, size>();
+        ResourcePool<u32, size> *slotMap = new ResourcePool<u32, size>();
+
+        for (u32 i = 0; i < size; i++)
+        {
+            *linearPool->create() = i;
+            *slotMap->create() = i;
+            order[i] = i;
+        }
+        for (u32 i = size - 1; i > 0; i--)
+        {
+            std::swap(order[i], order[rand() % (i + 1)]);
+        }
+        for (u32 i = 0; i < size / 2; i++)
+        {
+            linearPool->mark_for_destruction(&linearPool->objs[order[i]]);
+            slotMap->mark_for_destruction(&(*slotMap)[order[i]]);
+        }
+
+        r64 t0 = Time::current_time_in_ms();
+        linearPool->destroy_objs();
+        r64 t1 = Time::current_time_in_ms();
+        slotMap->destroy_objs();
+        r64 t2 = Time::current_time_in_ms();
+
+        linearTime += t1 - t0;
+        slotMapTime += t2 - t1;
+
+        // Both keep the live handles densely but in a different order
+        match = match && linearPool->count == slotMap->get_count();
+        for (u32 i = 0; match && i < linearPool->count; i++)
+        {
+            alive[i] = linearPool->handles[i];
+        }
+        std::sort(alive, alive + linearPool->count);
+        for (u32 i = 0; match && i < linearPool->count; i++)
+        {
+            match = slotMap->is_alive(alive[i]);
+        }
+
+        delete slotMap;
+        delete linearPool;
+    }
+
+    std::cout << std::setw(10) << size << std::setw(18) << linearTime / iterations << std::setw(16) << slotMapTime / iterations;
+    std::cout << (match ? "" : "  MISMATCH") << "\n";
+
+    free(alive);
+    free(order);
+}
+
+// Destroys half of a full pool, marked in random order, with the old linear search pool and with the slot map,
+// and prints the average time of each
+void run_pool_benchmark(u32 iterations)
+{
+    srand(1);
+
+    std::cout << "Pool benchmark: " << iterations << " iterations\n";
+    std::cout << std::setw(10) << "objects" << std::setw(18) << "linear search ms" << std::setw(16) << "slot map ms" << "\n";
+    std::cout << std::fixed << std::setprecision(4);
+    run_pool_benchmark_size<128>(iterations);
+    run_pool_benchmark_size<1024>(iterations);
+    run_pool_benchmark_size<65536>(iterations);
+    std::cout << std::endl;
+}
 
 int main(int argc, char **argv)
 {
+    u32 tickRate = DEFAULT_TICK_RATE;
+    u32 headlessTicks = 0;
+    u32 workerCount = 0;
+    u32 sortBenchmarkIterations = 0;
+    u32 transformBenchmarkIterations = 0;
+    u32 broadphaseBenchmarkIterations = 0;
+    u32 poolBenchmarkIterations = 0;
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], "-tickrate") == 0)
+            tickRate = MAX(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "-headless") == 0)
+            headlessTicks = MAX(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "-workers") == 0)
+            workerCount = MAX(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "-sortbench") == 0)
+            sortBenchmarkIterations = MAX(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "-matbench") == 0)
+            transformBenchmarkIterations = MAX(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "-hashbench") == 0)
+            broadphaseBenchmarkIterations = MAX(atoi(argv[i + 1]), 1);
+        else if (strcmp(argv[i], "-poolbench") == 0)
+            poolBenchmarkIterations = MAX(atoi(argv[i + 1]), 1);
+    }
+
+    if (sortBenchmarkIterations > 0)
+    {
+        SDL_Init(SDL_INIT_TIMER);
+        run_sort_benchmark(sortBenchmarkIterations);
+        SDL_Quit();
+        return 0;
+    }
+
+    if (transformBenchmarkIterations > 0)
+    {
+        SDL_Init(SDL_INIT_TIMER);
+        run_transform_benchmark(transformBenchmarkIterations);
+        SDL_Quit();
+        return 0;
+    }
+
+    if (broadphaseBenchmarkIterations > 0)
+    {
+        SDL_Init(SDL_INIT_TIMER);
+        run_broadphase_benchmark(broadphaseBenchmarkIterations);
+        SDL_Quit();
+        return 0;
+    }
+
+    if (poolBenchmarkIterations > 0)
+    {
+        SDL_Init(SDL_INIT_TIMER);
+        run_pool_benchmark(poolBenchmarkIterations);
+        SDL_Quit();
+        return 0;
+    }
+
+    if (headlessTicks > 0)
+    {
+        SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS);
+
+        Renderer::init(Renderer::RENDERER_BACKEND_NULL);
+        Input::set_scripted(true);
+        Input::init();
+        Jobs::init(workerCount);
+
+        Asteroids::initialize();
+        run_headless(headlessTicks, 1000.0 / tickRate);
+        Asteroids::deinit();
+
+        Jobs::deinit();
+        Input::deinit();
+        Renderer::deinit();
+
+        SDL_Quit();
+        return 0;
+    }
+
     SDL_Init(SDL_INIT_TIMER | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER | SDL_INIT_EVENTS | SDL_INIT_HAPTIC);
 
+    r64 startupStart = Time::current_time_in_ms();
+
     ImageLoader::init();
     Renderer::init();
     Input::init();
+    Jobs::init(workerCount);
 
     //Input::controller_rumble(1, 1.0f);
 
     bool fullscreen = false;
 
+    Asteroids::initialize();
+
+    // Run twice to compare, the first run after a driver update or without pipeline_cache.bin is cold
+    PipelineStats pipelineStats = Renderer::get_pipeline_stats();
+    std::cout << "Startup took " << Time::current_time_in_ms() - startupStart << " ms, ";
+    std::cout << pipelineStats.pipelineCount << " pipelines in " << pipelineStats.creationMs << " ms with a ";
+    if (pipelineStats.warmCache)
+        std::cout << "warm pipeline cache (" << pipelineStats.loadedCacheBytes << " bytes)\n";
+    else std::cout << "cold pipeline cache\n";
+    std::cout << std::endl;
+
     //time
     r64 currentTime = Time::current_time_in_ms();
+    const r64 tickLength = 1000.0 / tickRate;
+    r64 accumulator = 0.0;
 
-    Asteroids::initialize();
+    // Totals of the draw loop's bind cache, printed as per frame averages on exit
+    Renderer::BindStats bindTotals = {};
+    u32 drawnFrames = 0;
 
     while (!Input::exit())
     {
         r64 newTime = Time::current_time_in_ms();
-        r32 deltaTime = (newTime - currentTime);
-        r32 deltaTimeInSeconds = deltaTime / 1000.f;
+        accumulator += newTime - currentTime;
         currentTime = newTime;
 
-        Renderer::clear_queue();
-
         Input::refresh();
+        Asteroids::poll_input();
 
-        Asteroids::play_game(deltaTimeInSeconds);
+        u32 ticks = 0;
+        while (accumulator >= tickLength && ticks < MAX_TICKS_PER_FRAME)
+        {
+            Asteroids::play_game(tickLength / 1000.0);
+            accumulator -= tickLength;
+            ticks++;
+        }
+        if (accumulator >= tickLength)
+            accumulator = std::fmod(accumulator, tickLength);
+
+        Renderer::clear_queue();
+
+        Asteroids::render_game(accumulator / tickLength);
 
         Renderer::sort_drawcalls();
 
         if (!Input::minimized())
+        {
             Renderer::draw();
+
+            Renderer::BindStats stats = Renderer::get_bind_stats();
+            bindTotals.pipelineBinds += stats.pipelineBinds;
+            bindTotals.pipelineSkips += stats.pipelineSkips;
+            bindTotals.descriptorSetBinds += stats.descriptorSetBinds;
+            bindTotals.descriptorSetSkips += stats.descriptorSetSkips;
+            bindTotals.vertexBufferBinds += stats.vertexBufferBinds;
+            bindTotals.vertexBufferSkips += stats.vertexBufferSkips;
+            drawnFrames++;
+        }
     }
 
+    r64 frames = MAX(drawnFrames, 1u);
+    std::cout << "Binds per frame (made / skipped):\n";
+    std::cout << "pipelines " << bindTotals.pipelineBinds / frames << " / " << bindTotals.pipelineSkips / frames << "\n";
+    std::cout << "descriptor sets " << bindTotals.descriptorSetBinds / frames << " / " << bindTotals.descriptorSetSkips / frames << "\n";
+    std::cout << "vertex buffers " << bindTotals.vertexBufferBinds / frames << " / " << bindTotals.vertexBufferSkips / frames << "\n";
+
+    GpuMemoryStats memoryStats = Renderer::get_gpu_memory_stats();
+    std::cout << "GPU memory: " << memoryStats.allocationCount << " allocations in " << memoryStats.blockCount << " blocks, ";
+    std::cout << memoryStats.requestedBytes << " bytes requested, " << memoryStats.usedBytes << " used, " << memoryStats.reservedBytes << " reserved, ";
+    std::cout << memoryStats.fragmentation * 100 << "% fragmented\n";
+    std::cout << std::endl;
+
+    Asteroids::deinit();
+    Jobs::deinit();
     ImageLoader::deinit();
     Input::deinit();
     Renderer::deinit();
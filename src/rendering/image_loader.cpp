@@ -1,4 +1,5 @@
 #include "image_loader.h"
+#include "../util/arena.h"
 #include <IL/il.h>
 #include <IL/ilu.h>
 #include <cstdlib>
@@ -13,7 +14,7 @@ void ImageLoader::deinit()
     ilShutDown();
 }
 
-void ImageLoader::load_image(Image *image, const char *fname, ImageType type)
+void ImageLoader::load_image(Image *image, const char *fname, ImageType type, Arena *arena)
 {
     image->type = type;
 
@@ -28,7 +29,10 @@ void ImageLoader::load_image(Image *image, const char *fname, ImageType type)
     image->height = ilGetInteger(IL_IMAGE_HEIGHT);
 
     s32 imageSize = image->width * image->height * 4;
-    image->pixels = (u8*)malloc(imageSize);
+    if (arena != nullptr)
+        image->pixels = arena_alloc_array<u8>(arena, imageSize);
+    else
+        image->pixels = (u8*)malloc(imageSize);
 
     memcpy(image->pixels, ilGetData(), imageSize);
 
@@ -3,12 +3,15 @@
 #include "../util/typedef.h"
 #include "rendering_util.h"
 
+struct Arena;
+
 namespace ImageLoader
 {
     void init();
     void deinit();
 
-    void load_image(Image *image, const char *fname, ImageType type = IMAGE_SRGB);
+    // With an arena the pixels are allocated from it and free_image must not be called
+    void load_image(Image *image, const char *fname, ImageType type = IMAGE_SRGB, Arena *arena = nullptr);
     void free_image(Image *image);
 }
 
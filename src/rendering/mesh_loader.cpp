@@ -4,6 +4,7 @@
 #include <cstring>
 #include <sstream>
 #include "vulkan.h"
+#include "../util/arena.h"
 #include <cjson/cJSON.h>
 
 void MeshLoader::init()
@@ -15,8 +16,9 @@ void MeshLoader::deinit()
 
 }
 
-void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
+void MeshLoader::load_mesh(MeshHandle handle, const char *fname, Arena *arena)
 {
+    ArenaScope scope(arena);
     MeshData temp{};
 
     glm::vec3 *expandedVertices = nullptr;
@@ -143,7 +145,7 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         }
 
         //The worst thing I ever wrote possibly
-        char* path = new char[lastSlashIndex + 2];
+        char* path = arena_alloc_array<char>(arena, lastSlashIndex + 2);
         memcpy(path, fname, lastSlashIndex+1);
         path[lastSlashIndex+1] = 0;
 
@@ -152,13 +154,13 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         std::cout << "Opening binary file " << bufferFnameStream.str() << std::endl;
         std::cout << "File size in bytes = " << buffer0Size << std::endl;
 
-        char *buffer0Data = new char[buffer0Size]{};
+        char *buffer0Data = arena_alloc_array<char>(arena, buffer0Size);
+        memset(buffer0Data, 0, buffer0Size);
 
         std::ifstream bufferFile(bufferFnameStream.str(), std::ios::binary);
 
         bufferFile.read(buffer0Data, buffer0Size);
         bufferFile.close();
-        delete[] path;
 
         //get triangles
         cJSON *indexAccessor = cJSON_GetArrayItem(accessors, indicesIndex);
@@ -167,7 +169,7 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
 
         temp.triangleCount = indexCount->valueint / 3;
 
-        temp.triangles = new Triangle[temp.triangleCount];
+        temp.triangles = arena_alloc_array<Triangle>(arena, temp.triangleCount);
 
         cJSON *indexBufferView = cJSON_GetArrayItem(bufferViews, indexBufferViewIndex->valueint);
         cJSON *indexBufferIndex = cJSON_GetObjectItemCaseSensitive(indexBufferView, "buffer");
@@ -191,7 +193,7 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
 
         temp.vertexCount = positionCount->valueint;
 
-        temp.position = new glm::vec3[temp.vertexCount];
+        temp.position = arena_alloc_array<glm::vec3>(arena, temp.vertexCount);
 
         cJSON *positionBufferView = cJSON_GetArrayItem(bufferViews, positionBufferViewIndex->valueint);
         cJSON *positionBufferIndex = cJSON_GetObjectItemCaseSensitive(positionBufferView, "buffer");
@@ -210,7 +212,7 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         cJSON *uvBufferViewIndex = cJSON_GetObjectItemCaseSensitive(uvAccessor, "bufferView");
         cJSON *uvCount = cJSON_GetObjectItemCaseSensitive(uvAccessor, "count");
 
-        temp.texcoord0 = new glm::vec2[temp.vertexCount];
+        temp.texcoord0 = arena_alloc_array<glm::vec2>(arena, temp.vertexCount);
 
         cJSON *uvBufferView = cJSON_GetArrayItem(bufferViews, uvBufferViewIndex->valueint);
         cJSON *uvBufferIndex = cJSON_GetObjectItemCaseSensitive(uvBufferView, "buffer");
@@ -229,7 +231,7 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         cJSON *normalBufferViewIndex = cJSON_GetObjectItemCaseSensitive(normalAccessor, "bufferView");
         cJSON *normalCount = cJSON_GetObjectItemCaseSensitive(normalAccessor, "count");
 
-        temp.normal = new glm::vec3[temp.vertexCount];
+        temp.normal = arena_alloc_array<glm::vec3>(arena, temp.vertexCount);
 
         cJSON *normalBufferView = cJSON_GetArrayItem(bufferViews, normalBufferViewIndex->valueint);
         cJSON *normalBufferIndex = cJSON_GetObjectItemCaseSensitive(normalBufferView, "buffer");
@@ -248,7 +250,7 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         cJSON *tangentBufferViewIndex = cJSON_GetObjectItemCaseSensitive(tangentAccessor, "bufferView");
         cJSON *tangentCount = cJSON_GetObjectItemCaseSensitive(tangentAccessor, "count");
 
-        temp.tangent = new glm::vec4[temp.vertexCount];
+        temp.tangent = arena_alloc_array<glm::vec4>(arena, temp.vertexCount);
 
         cJSON *tangentBufferView = cJSON_GetArrayItem(bufferViews, tangentBufferViewIndex->valueint);
         cJSON *tangentBufferIndex = cJSON_GetObjectItemCaseSensitive(tangentBufferView, "buffer");
@@ -263,7 +265,6 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         }
 
         cJSON_Delete(json);
-        delete[] buffer0Data;
     }
 
     /*temp.vertexCount = 4;
@@ -297,14 +298,11 @@ void MeshLoader::load_mesh(MeshHandle handle, const char *fname)
         std::cout << "Vert #" << i << ": {" << temp.position[i].x << ", " << temp.position[i].y << ", " << temp.position[i].z << "}\n";
     }*/
 
-    temp.color = new glm::vec4[temp.vertexCount]{};
+    temp.color = arena_alloc_array<glm::vec4>(arena, temp.vertexCount);
+    for (u32 i = 0; i < temp.vertexCount; i++)
+    {
+        temp.color[i] = glm::vec4(0);
+    }
 
     Vulkan::create_vertex_buffer(handle, &temp);
-
-    delete[] temp.triangles;
-    delete[] temp.position;
-    delete[] temp.texcoord0;
-    delete[] temp.normal;
-    delete[] temp.tangent;
-    delete[] temp.color;
 }
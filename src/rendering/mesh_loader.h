@@ -3,6 +3,8 @@
 #include "../util/typedef.h"
 #include "rendering_util.h"
 
+struct Arena;
+
 #define GLTF_BYTE 5120
 #define GLTF_UNSIGNED_BYTE 5121
 #define GLTF_SHORT 5122
@@ -15,7 +17,8 @@ namespace MeshLoader
     void init();
     void deinit();
 
-    void load_mesh(MeshHandle handle, const char *fname);
+    // Temporary data is allocated from the arena and freed before returning
+    void load_mesh(MeshHandle handle, const char *fname, Arena *arena);
 }
 
 #endif
@@ -9,6 +9,9 @@
 #include "mesh_loader.h"
 #include "../util/math.h"
 #include "../util/resource_pool.h"
+#include "../util/arena.h"
+#include "../util/radix_sort.h"
+#include "../jobs/jobs.h"
 
 struct InternalMesh;
 struct InternalTexture;
@@ -18,13 +21,52 @@ namespace Renderer
     DrawCall renderQueue[0x1000];
     u16 queueLength = 0;
 
+    u16 batchCount = 0;
+    u32 instanceCount = 0; //one per drawcall
+
+    void build_batches();
+
+    #define MIN_BATCHES_PER_SLICE 64 //below this, a job costs more than it saves
+
+    void record_pass(Vulkan::RecordingPass pass);
+    void record_batches(Vulkan::RecordingPass pass, u32 slice, u32 firstBatch, u32 count);
+
+    BindStats sliceBindStats[MAX_RECORDING_SLICES]; //each slice counts its own, summed after recording
+    BindStats frameBindStats;
+
     u16 nextDataIndex = 0;
     u16 nextTransformIndex = 0;
 
     RendererState state;
+    TransformKernel::TransformStreams transforms;
+
+    RendererBackend backend = RENDERER_BACKEND_VULKAN;
+
+    #define FRAME_ARENA_SIZE 0x100000
+    #define LOAD_ARENA_SIZE 0x6000000 //enough for a cubemap of 2k RGBA8 textures, 6*2048*2048*4 bytes
+    Arena frameArena;
+    Arena loadArena;
+
+    struct DynamicMeshDraw
+    {
+        DynamicMeshHandle mesh;
+        u32 indexCount;
+    };
+    DynamicMeshDraw dynamicMeshDraws[MAX_DYNAMIC_MESH_COUNT];
+    u32 dynamicMeshDrawCount = 0;
+
+    DynamicMeshHandle textMesh; //draw_text writes its glyphs straight into it
+    u32 textGlyphCount = 0;
 
     glm::vec3 camPos;
     Quaternion camRot;
+    glm::vec3 camForward = {0,0,-1};
+
+    #define SORT_DEPTH_RANGE 100.0f //camera far plane
+    #define SORT_DEPTH_MAX 0xffffff
+    SortPolicy layerSortPolicies[4] = {SORT_STATE_FIRST, SORT_DEPTH_FIRST, SORT_STATE_FIRST, SORT_STATE_FIRST};
+
+    u32 quantize_depth(glm::vec3 pos, RenderLayer layer);
 
     const char *textureNames[MAX_TEXTURE_COUNT];
     ResourcePool<Texture, MAX_TEXTURE_COUNT> textures;
@@ -32,6 +74,8 @@ namespace Renderer
     const char *meshNames[MAX_VERTEX_BUFFER_COUNT];
     ResourcePool<Mesh, MAX_VERTEX_BUFFER_COUNT> meshes;
 
+    ResourcePool<DynamicMesh, MAX_DYNAMIC_MESH_COUNT> dynamicMeshes;
+
     const char *shaderNames[MAX_SHADER_COUNT];
     ResourcePool<Shader, MAX_SHADER_COUNT> shaders;
 
@@ -41,22 +85,37 @@ namespace Renderer
 
 using namespace Renderer;
 
-void Renderer::init()
+void Renderer::init(RendererBackend b)
 {
+    backend = b;
+
     std::cout << "Initializing Renderer!\n";
     std::cout << "Memory footprint:\n";
     std::cout << "Renderer state: " << sizeof(RendererState) * 2 << " bytes\n";
+    std::cout << "Frame arena: " << FRAME_ARENA_SIZE << " bytes\n";
+    std::cout << "Load arena: " << LOAD_ARENA_SIZE << " bytes\n";
     std::cout << std::endl;
 
+    init_arena(&frameArena, FRAME_ARENA_SIZE);
+    init_arena(&loadArena, LOAD_ARENA_SIZE);
+
+    TransformKernel::init();
+    transforms = TransformKernel::make_streams(state.transformComponents, MAX_TRANSFORMS);
+
     //////////////////////////////////////////////////////
 
-    SDL::create_window();
+    if (backend == RENDERER_BACKEND_NULL)
+        std::cout << "Using null backend, nothing will be drawn\n";
+    else
+    {
+        SDL::create_window();
 
-    u32 extensionCount = SDL::get_vulkan_instance_extension_count();
-    const char* extensionNames[32];
-    SDL::get_vulkan_instance_extension_names(extensionCount, extensionNames);
+        u32 extensionCount = SDL::get_vulkan_instance_extension_count();
+        const char* extensionNames[32];
+        SDL::get_vulkan_instance_extension_names(extensionCount, extensionNames);
 
-    Vulkan::init(extensionCount, extensionNames, &SDL::create_vulkan_surface);
+        Vulkan::init(extensionCount, extensionNames, &SDL::create_vulkan_surface);
+    }
 
     // Some default resources
     create_texture("NormalEmpty", "res/textures/dev/normal_empty.png", IMAGE_NORMAL);
@@ -65,6 +124,8 @@ void Renderer::init()
 
     create_mesh("Plane", "res/meshes/dev/plane.gltf");
     create_mesh("Sphere", "res/meshes/dev/sphere.gltf");
+
+    textMesh = create_dynamic_mesh(MAX_OVERLAY_GLYPHS * 4, MAX_OVERLAY_GLYPHS * 6);
 }
 void Renderer::deinit()
 {
@@ -92,6 +153,18 @@ void Renderer::deinit()
     }
     meshes.destroy_objs();
 
+    for (u32 i = 0; i < dynamicMeshes.get_count(); i++)
+    {
+        destroy_dynamic_mesh(dynamicMeshes.get_handle(i));
+    }
+    dynamicMeshes.destroy_objs();
+
+    free_arena(&frameArena);
+    free_arena(&loadArena);
+
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
+
     Vulkan::free();
 
     SDL::destroy_window();
@@ -99,6 +172,9 @@ void Renderer::deinit()
 
 void Renderer::set_fullscreen(bool s)
 {
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
+
     SDL::set_fullscreen(s);
 }
 
@@ -118,18 +194,26 @@ s16 Renderer::render_mesh(MeshHandle mesh, MaterialHandle material, glm::vec3 po
 
     state.data[dataIndex] = data;
 
-    Transform transform;
-    transform.position = pos;
-    transform.rotation = rot;
-    transform.scale = scl;
+    TransformKernel::set_transform(transforms, transformIndex, pos, rot, scl);
 
-    state.transform[transformIndex] = transform;
+    RenderLayer layer = shaders[materials[material].shader].layer;
+    u64 depth = quantize_depth(pos, layer);
 
     DrawCall call{};
     call.sortingID += (dataIndex % 0x1000);
-    call.sortingID += (u64)mesh << 12;
-    call.sortingID += (u64)material << 20;
-    call.sortingID += (u64)shaders[materials[material].shader].layer << 56;
+    if (layerSortPolicies[layer] == SORT_DEPTH_FIRST)
+    {
+        call.sortingID += (u64)mesh << 12;
+        call.sortingID += (u64)material << 20;
+        call.sortingID += depth << 32;
+    }
+    else
+    {
+        call.sortingID += depth << 12;
+        call.sortingID += (u64)mesh << 36;
+        call.sortingID += (u64)material << 44;
+    }
+    call.sortingID += (u64)layer << 56;
 
     renderQueue[queueLength++] = call;
 
@@ -138,12 +222,83 @@ s16 Renderer::render_mesh(MeshHandle mesh, MaterialHandle material, glm::vec3 po
 
 void Renderer::sort_drawcalls()
 {
-	auto comp = [](const DrawCall &a, const DrawCall &b)
-	{
-	    return a.sortingID < b.sortingID;
-	};
+    ArenaScope scope(&frameArena);
+    DrawCall *scratch = arena_alloc_array<DrawCall>(&frameArena, queueLength);
+
+    radix_sort<DrawCall, drawcall_get_sort_key>(renderQueue, scratch, queueLength);
+
+    build_batches();
+}
+
+// Every drawcall gets one instance, so the queue always fits in the instance buffer
+static_assert(MAX_DRAWCALLS <= MAX_INSTANCE_COUNT, "Instance buffer is smaller than the render queue");
+
+void Renderer::build_batches()
+{
+    batchCount = 0;
+    instanceCount = 0;
+
+    for (u32 i = 0; i < queueLength; i++)
+    {
+        DrawCall call = renderQueue[i];
+        DrawCallData data = state.data[drawcall_get_data_index(call)];
+
+        if (batchCount > 0)
+        {
+            InstanceBatch &batch = state.batches[batchCount - 1];
+            DrawCall first = renderQueue[batch.firstCall];
+            DrawCallData firstData = state.data[drawcall_get_data_index(first)];
+
+            bool sameDraw = drawcall_get_mesh(call) == drawcall_get_mesh(first) &&
+                            drawcall_get_material(call) == drawcall_get_material(first) &&
+                            data.indexCount == firstData.indexCount &&
+                            data.firstIndex == firstData.firstIndex &&
+                            data.vertexOffset == firstData.vertexOffset;
+
+            if (sameDraw && batch.instanceCount < MAX_INSTANCES_PER_BATCH)
+            {
+                batch.instanceCount++;
+                instanceCount++;
+                continue;
+            }
+        }
+
+        InstanceBatch &batch = state.batches[batchCount++];
+        batch.firstCall = i;
+        batch.instanceCount = 1;
+        batch.firstInstance = instanceCount;
+        instanceCount++;
+    }
+}
+
+u32 Renderer::get_drawcall_count()
+{
+    return queueLength;
+}
+
+u32 Renderer::get_batch_count()
+{
+    return batchCount;
+}
+
+Renderer::BindStats Renderer::get_bind_stats()
+{
+    return frameBindStats;
+}
+
+GpuMemoryStats Renderer::get_gpu_memory_stats()
+{
+    if (backend == RENDERER_BACKEND_NULL)
+        return GpuMemoryStats{};
+
+    return Vulkan::get_memory_stats();
+}
+PipelineStats Renderer::get_pipeline_stats()
+{
+    if (backend == RENDERER_BACKEND_NULL)
+        return PipelineStats{};
 
-	std::sort(&renderQueue[0], &renderQueue[queueLength],comp);
+    return Vulkan::get_pipeline_stats();
 }
 
 void Renderer::set_camera_position(glm::vec3 pos)
@@ -154,165 +309,304 @@ void Renderer::set_camera_position(glm::vec3 pos)
 void Renderer::set_camera_rotation(Quaternion rot)
 {
     camRot = rot;
+    camForward = rot * glm::vec3(0,0,-1);
+}
+
+void Renderer::set_layer_sort_policy(RenderLayer layer, SortPolicy policy)
+{
+    layerSortPolicies[layer] = policy;
+}
+
+// View space depth of the object's origin in 24 bits, so nearer objects sort first
+u32 Renderer::quantize_depth(glm::vec3 pos, RenderLayer layer)
+{
+    r32 depth = glm::dot(pos - camPos, camForward) / SORT_DEPTH_RANGE;
+    depth = MIN(MAX(depth, 0.0f), 1.0f);
+
+    u32 quantized = depth * SORT_DEPTH_MAX;
+    if (layer == RENDER_LAYER_TRANSPARENT)
+        quantized = SORT_DEPTH_MAX - quantized;
+
+    return quantized;
 }
 
 void Renderer::set_light(glm::vec3 pos, glm::vec3 dir, glm::vec4 color)
 {
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
+
     Vulkan::update_lighting(pos, dir, color);
 }
 
 void Renderer::set_env_map(TextureHandle texture)
 {
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
+
     Vulkan::set_env_map(texture);
 }
 
 void Renderer::calculate_matrices()
 {
-    for (int i = 0; i < queueLength; i++)
+    // Matrices go straight to the mapped instance buffer in one pass. Instances are in queue order
+    AffineMatrix *matrices = state.matrices;
+    if (backend != RENDERER_BACKEND_NULL)
+        matrices = Vulkan::begin_transform_data();
+
+    ArenaScope scope(&frameArena);
+    u16 *transformIndices = arena_alloc_array<u16>(&frameArena, queueLength);
+    for (u32 i = 0; i < queueLength; i++)
     {
-        u32 dataIndex = drawcall_get_data_index(renderQueue[i]);
-
-        DrawCallData data = state.data[dataIndex];
-
-        Transform currentTransform = state.transform[data.transformIndex];
-
-        //std::cout << "{" << currentTransform.position.x << ", " << currentTransform.position.y << ", " << currentTransform.position.z << "}\n";
-
-        glm::vec3 finalPos = currentTransform.position;
-        Quaternion finalRotation = currentTransform.rotation;
-
-        glm::mat4 translation = glm::translate(glm::mat4(1.0f), finalPos);
-
-        glm::mat4 rotation;
-        rotation[0][0] = 1 - 2 * finalRotation.y * finalRotation.y - 2 * finalRotation.z * finalRotation.z;
-        rotation[0][1] = 2 * finalRotation.x * finalRotation.y + 2 * finalRotation.z * finalRotation.w;
-        rotation[0][2] = 2 * finalRotation.x * finalRotation.z - 2 * finalRotation.y * finalRotation.w;
-        rotation[0][3] = 0;
-        rotation[1][0] = 2 * finalRotation.x * finalRotation.y - 2 * finalRotation.z * finalRotation.w;
-        rotation[1][1] = 1 - 2 * finalRotation.x * finalRotation.x - 2 * finalRotation.z * finalRotation.z;
-        rotation[1][2] = 2 * finalRotation.y * finalRotation.z + 2 * finalRotation.x * finalRotation.w;
-        rotation[1][3] = 0;
-        rotation[2][0] = 2 * finalRotation.x * finalRotation.z + 2 * finalRotation.y * finalRotation.w;
-        rotation[2][1] = 2 * finalRotation.y * finalRotation.z - 2 * finalRotation.x * finalRotation.w;
-        rotation[2][2] = 1 - 2 * finalRotation.x * finalRotation.x - 2 * finalRotation.y * finalRotation.y;
-        rotation[2][3] = 0;
-        rotation[3][0] = 0;
-        rotation[3][1] = 0;
-        rotation[3][2] = 0;
-        rotation[3][3] = 1;
-
-        glm::mat4 scale = glm::scale(glm::mat4(1.0f), currentTransform.scale);
-
-        state.matrices[i] = translation * rotation * scale;
+        transformIndices[i] = state.data[drawcall_get_data_index(renderQueue[i])].transformIndex;
     }
 
-    if (queueLength > 0)
-        Vulkan::set_transform_data(state.matrices, queueLength);
+    TransformKernel::build_matrices(transforms, transformIndices, queueLength, matrices);
 }
 
 void Renderer::draw()
 {
     calculate_matrices();
 
+    if (backend == RENDERER_BACKEND_NULL)
+    {
+        meshes.destroy_objs();
+        materials.destroy_objs();
+        textures.destroy_objs();
+        shaders.destroy_objs();
+        return;
+    }
+
+    Vulkan::wait_for_shader_batch();
+
     //draw things
+    frameBindStats = {};
+    Vulkan::update_matrices(camPos, camRot);
     Vulkan::begin_rendering();
+
     Vulkan::begin_shadow_pass();
+    record_pass(Vulkan::RECORDING_PASS_SHADOW);
+    Vulkan::end_render_pass();
 
-    //shadowmap rendering
-    for (int i = 0; i < queueLength; i++)
-    {
-        DrawCall call = renderQueue[i];
+    Vulkan::begin_forward_render_pass();
+    record_pass(Vulkan::RECORDING_PASS_FORWARD);
+    Vulkan::end_render_pass();
 
-        MeshHandle meshHandle = drawcall_get_mesh(call);
+    Vulkan::render_post_process(get_mesh("Plane"));
+    if (Vulkan::begin_overlay())
+    {
+        for (u32 i = 0; i < dynamicMeshDrawCount; i++)
+        {
+            Vulkan::draw_dynamic_mesh(dynamicMeshDraws[i].mesh, dynamicMeshDraws[i].indexCount);
+        }
+        Vulkan::draw_dynamic_mesh(textMesh, textGlyphCount * 6);
+    }
+    Vulkan::end_render_pass();
 
-        MaterialHandle matHandle = drawcall_get_material(call);
-        Material mat = materials[matHandle];
+    Vulkan::stop_rendering();
 
-        if (mat.castShadows == false)
-            continue;
+    Vulkan::draw_frame();
 
-        Vulkan::set_shadow_instance_data(i);
-        Vulkan::bind_vertex_buffer(meshHandle, VERTEX_POSITION_BIT);
+    //Clear temporary meshes
+    meshes.destroy_objs();
+    materials.destroy_objs();
+    textures.destroy_objs();
+    shaders.destroy_objs();
+}
 
-        u32 dataIndex = drawcall_get_data_index(call);
-        DrawCallData data = state.data[dataIndex];
+// Splits the batches into contiguous slices, about one per job worker, and records them as jobs
+void Renderer::record_pass(Vulkan::RecordingPass pass)
+{
+    u32 sliceCount = MIN(Jobs::get_worker_count(), (u32)MAX_RECORDING_SLICES);
+    sliceCount = MIN(sliceCount, (u32)(batchCount + MIN_BATCHES_PER_SLICE - 1) / MIN_BATCHES_PER_SLICE);
+    if (sliceCount == 0)
+        return;
 
-        u32 drawCount;
-        if (data.indexCount == 0)
-            drawCount = Vulkan::get_index_count(meshHandle);
-        else drawCount = data.indexCount;
+    u32 sliceSize = (batchCount + sliceCount - 1) / sliceCount;
+    Jobs::parallel_for(batchCount, sliceSize, [pass, sliceSize](u32 first, u32 count)
+    {
+        record_batches(pass, first / sliceSize, first, count);
+    });
 
-        Vulkan::draw_elements(drawCount, data.firstIndex, data.vertexOffset);
+    sliceCount = (batchCount + sliceSize - 1) / sliceSize;
+    for (u32 slice = 0; slice < sliceCount; slice++)
+    {
+        BindStats stats = sliceBindStats[slice];
+        frameBindStats.pipelineBinds += stats.pipelineBinds;
+        frameBindStats.pipelineSkips += stats.pipelineSkips;
+        frameBindStats.descriptorSetBinds += stats.descriptorSetBinds;
+        frameBindStats.descriptorSetSkips += stats.descriptorSetSkips;
+        frameBindStats.vertexBufferBinds += stats.vertexBufferBinds;
+        frameBindStats.vertexBufferSkips += stats.vertexBufferSkips;
     }
 
-    Vulkan::end_render_pass();
-    Vulkan::begin_forward_render_pass();
+    Vulkan::execute_recordings(pass, sliceCount);
+}
+
+void Renderer::record_batches(Vulkan::RecordingPass pass, u32 slice, u32 firstBatch, u32 count)
+{
+    Vulkan::begin_recording(pass, slice);
 
-    //normal rendering
-    for (int i = 0; i < queueLength; i++)
+    // Secondary command buffers start with nothing bound, so the cache starts empty in every slice.
+    // Sorting puts calls with the same shader, material and mesh next to each other, most binds can be skipped
+    ShaderHandle boundShader = -1;
+    MaterialHandle boundMaterial = -1;
+    u32 boundBuffer = -1;
+
+    BindStats &stats = sliceBindStats[slice];
+    stats = {};
+
+    for (u32 i = firstBatch; i < firstBatch + count; i++)
     {
-        DrawCall call = renderQueue[i];
+        InstanceBatch batch = state.batches[i];
+        DrawCall call = renderQueue[batch.firstCall];
 
         MeshHandle meshHandle = drawcall_get_mesh(call);
 
         MaterialHandle matHandle = drawcall_get_material(call);
-        Material mat = materials[matHandle];
+        const Material &mat = materials[matHandle];
 
-        Vulkan::bind_shader(mat.shader);
-        Vulkan::bind_shader_data_block(mat.shader, matHandle, i);
-        Vulkan::bind_vertex_buffer(meshHandle, (VertexAttribFlags)(VERTEX_POSITION_BIT | VERTEX_TEXCOORD_0_BIT | VERTEX_NORMAL_BIT | VERTEX_TANGENT_BIT | VERTEX_COLOR_BIT));
+        if (pass == Vulkan::RECORDING_PASS_SHADOW)
+        {
+            if (mat.castShadows == false)
+                continue;
+        }
+        else
+        {
+            if (mat.shader != boundShader)
+            {
+                Vulkan::bind_shader(mat.shader);
+                boundShader = mat.shader;
+                stats.pipelineBinds++;
+            }
+            else stats.pipelineSkips++;
+
+            if (matHandle != boundMaterial)
+            {
+                Vulkan::bind_shader_data_block(mat.shader, matHandle);
+                boundMaterial = matHandle;
+                stats.descriptorSetBinds++;
+            }
+            else stats.descriptorSetSkips++;
+        }
+
+        // Meshes share their buffers, so this only binds once per slice
+        const Vulkan::MeshRecord &record = Vulkan::get_mesh_record(meshHandle);
+        if (record.buffer != boundBuffer)
+        {
+            if (pass == Vulkan::RECORDING_PASS_SHADOW)
+                Vulkan::bind_vertex_buffer(meshHandle, VERTEX_POSITION_BIT);
+            else Vulkan::bind_vertex_buffer(meshHandle, (VertexAttribFlags)(VERTEX_POSITION_BIT | VERTEX_TEXCOORD_0_BIT | VERTEX_NORMAL_BIT | VERTEX_TANGENT_BIT | VERTEX_COLOR_BIT));
+            boundBuffer = record.buffer;
+            stats.vertexBufferBinds++;
+        }
+        else stats.vertexBufferSkips++;
 
         u32 dataIndex = drawcall_get_data_index(call);
         DrawCallData data = state.data[dataIndex];
 
         u32 drawCount;
         if (data.indexCount == 0)
-            drawCount = Vulkan::get_index_count(meshHandle);
+            drawCount = record.indexCount;
         else drawCount = data.indexCount;
 
-        Vulkan::draw_elements(drawCount, data.firstIndex, data.vertexOffset);
+        Vulkan::draw_elements(drawCount, record.firstIndex + data.firstIndex, record.firstVertex + data.vertexOffset, batch.instanceCount, batch.firstInstance);
     }
 
-    Vulkan::end_render_pass();
+    Vulkan::end_recording();
+}
 
-    Vulkan::update_post_process_descriptor_set(); // TODO: Shouldn't need to update this more than once, but it fails for some reason. Make code better
-    Vulkan::render_post_process(get_mesh("Plane"));
-    Vulkan::end_render_pass();
+void Renderer::set_overlay_font(TextureHandle texture)
+{
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
 
-    Vulkan::stop_rendering();
+    Vulkan::set_overlay_texture(texture);
+}
 
-    Vulkan::draw_frame(camPos, camRot);
+void Renderer::draw_text(const char *s, glm::vec2 pos, r32 size, Color color)
+{
+    // Font texture is a 16x16 grid of ascii characters
+    const r32 letterWidth = 1.0 / 16.0;
+    const r32 letterHeight = 1.0 / 16.0;
+    glm::vec4 colorWithAlpha = {color.x, color.y, color.z, 1.0f};
 
-    //Clear temporary meshes
-    meshes.destroy_objs();
-    materials.destroy_objs();
-    textures.destroy_objs();
-    shaders.destroy_objs();
+    glm::vec2 cursor = pos;
+    for (const char *c = s; *c != 0; c++)
+    {
+        if (*c == '\n')
+        {
+            cursor = {pos.x, cursor.y + size};
+            continue;
+        }
+
+        if (textGlyphCount >= MAX_OVERLAY_GLYPHS)
+            return;
+
+        // char can be signed, bytes above 127 have to index the upper half of the grid
+        u32 xLetter = (u8)*c % 16;
+        u32 yLetter = (u8)*c / 16;
+
+        OverlayVertex v[4];
+        v[0] = {{cursor.x, cursor.y, 0}, {letterWidth*xLetter, letterHeight*yLetter}, colorWithAlpha};
+        v[1] = {{cursor.x, cursor.y + size, 0}, {letterWidth*xLetter, letterHeight*(yLetter+1)}, colorWithAlpha};
+        v[2] = {{cursor.x + size, cursor.y + size, 0}, {letterWidth*(xLetter+1), letterHeight*(yLetter+1)}, colorWithAlpha};
+        v[3] = {{cursor.x + size, cursor.y, 0}, {letterWidth*(xLetter+1), letterHeight*yLetter}, colorWithAlpha};
+
+        u16 first = textGlyphCount * 4;
+        u16 indices[6] = {first, (u16)(first + 1), (u16)(first + 2), first, (u16)(first + 2), (u16)(first + 3)};
+
+        update_dynamic_mesh(textMesh, textGlyphCount * 4, v, 4, textGlyphCount * 6, indices, 6);
+        textGlyphCount++;
+        cursor.x += size;
+    }
 }
 
 void Renderer::clear_queue()
 {
     queueLength = 0;
+    dynamicMeshDrawCount = 0;
+    textGlyphCount = 0;
 
     nextDataIndex = 0;
     nextTransformIndex = 0;
+
+    reset_arena(&frameArena);
 }
 
+Arena *Renderer::get_frame_arena()
+{
+    return &frameArena;
+}
+Arena *Renderer::get_load_arena()
+{
+    return &loadArena;
+}
+
+u64 Renderer::drawcall_get_sort_key(const DrawCall &call)
+{
+    return call.sortingID;
+}
 u8 Renderer::drawcall_get_layer(DrawCall call)
 {
     return call.sortingID >> 56;
 }
 u32 Renderer::drawcall_get_depth(DrawCall call)
 {
-    return (call.sortingID >> 32) % 0x1000000;
+    if (layerSortPolicies[drawcall_get_layer(call)] == SORT_DEPTH_FIRST)
+        return (call.sortingID >> 32) % 0x1000000;
+    return (call.sortingID >> 12) % 0x1000000;
 }
 u16 Renderer::drawcall_get_material(DrawCall call)
 {
-    return (call.sortingID >> 20) % 0x1000;
+    if (layerSortPolicies[drawcall_get_layer(call)] == SORT_DEPTH_FIRST)
+        return (call.sortingID >> 20) % 0x1000;
+    return (call.sortingID >> 44) % 0x1000;
 }
 u8 Renderer::drawcall_get_mesh(DrawCall call)
 {
-    return (call.sortingID >> 12) % 0x100;
+    if (layerSortPolicies[drawcall_get_layer(call)] == SORT_DEPTH_FIRST)
+        return (call.sortingID >> 12) % 0x100;
+    return (call.sortingID >> 36) % 0x100;
 }
 u16 Renderer::drawcall_get_data_index(DrawCall call)
 {
@@ -359,12 +653,15 @@ TextureHandle Renderer::create_texture(const char *name, const char *fname, Imag
     Texture *texture = textures.create(&handle);
     textureNames[handle] = name;
 
+    if (backend == RENDERER_BACKEND_NULL)
+        return handle;
+
+    ArenaScope scope(&loadArena);
     Image image;
     Image *imagePtr = &image;
 
-    ImageLoader::load_image(&image, fname, type);
+    ImageLoader::load_image(&image, fname, type, &loadArena);
     Vulkan::create_texture(handle, &imagePtr, texture, TEXTURE_2D, filter);
-    ImageLoader::free_image(&image);
 
     return handle;
 }
@@ -374,21 +671,19 @@ TextureHandle Renderer::create_cubemap_texture(const char *name, const char **fn
     Texture *texture = textures.create(&handle);
     textureNames[handle] = name;
 
+    if (backend == RENDERER_BACKEND_NULL)
+        return handle;
+
+    ArenaScope scope(&loadArena);
     Image cubeImages[6];
-    ImageLoader::load_image(&cubeImages[0], fnames[0]);
-    ImageLoader::load_image(&cubeImages[1], fnames[1]);
-    ImageLoader::load_image(&cubeImages[2], fnames[2]);
-    ImageLoader::load_image(&cubeImages[3], fnames[3]);
-    ImageLoader::load_image(&cubeImages[4], fnames[4]);
-    ImageLoader::load_image(&cubeImages[5], fnames[5]);
+    ImageLoader::load_image(&cubeImages[0], fnames[0], IMAGE_SRGB, &loadArena);
+    ImageLoader::load_image(&cubeImages[1], fnames[1], IMAGE_SRGB, &loadArena);
+    ImageLoader::load_image(&cubeImages[2], fnames[2], IMAGE_SRGB, &loadArena);
+    ImageLoader::load_image(&cubeImages[3], fnames[3], IMAGE_SRGB, &loadArena);
+    ImageLoader::load_image(&cubeImages[4], fnames[4], IMAGE_SRGB, &loadArena);
+    ImageLoader::load_image(&cubeImages[5], fnames[5], IMAGE_SRGB, &loadArena);
     Image *cubeImagePtrs[6] = {&cubeImages[0], &cubeImages[1], &cubeImages[2], &cubeImages[3], &cubeImages[4], &cubeImages[5]};
     Vulkan::create_texture(handle, cubeImagePtrs, texture, TEXTURE_CUBEMAP, filter);
-    ImageLoader::free_image(&cubeImages[0]);
-    ImageLoader::free_image(&cubeImages[1]);
-    ImageLoader::free_image(&cubeImages[2]);
-    ImageLoader::free_image(&cubeImages[3]);
-    ImageLoader::free_image(&cubeImages[4]);
-    ImageLoader::free_image(&cubeImages[5]);
 
     return handle;
 }
@@ -396,7 +691,8 @@ void Renderer::destroy_texture(TextureHandle handle)
 {
     Texture &texture = textures[handle];
     textures.mark_for_destruction(&texture, [](Texture* t, u32 handle) {
-        Vulkan::destroy_texture(handle);
+        if (backend != RENDERER_BACKEND_NULL)
+            Vulkan::destroy_texture(handle);
         });
 }
 
@@ -417,7 +713,8 @@ MeshHandle Renderer::create_mesh(const char *name, const char *fname)
     Mesh *mesh = meshes.create(&handle);
     meshNames[handle] = name;
 
-    MeshLoader::load_mesh(handle, fname);
+    if (backend != RENDERER_BACKEND_NULL)
+        MeshLoader::load_mesh(handle, fname, &loadArena);
 
     return handle;
 }
@@ -427,7 +724,8 @@ MeshHandle Renderer::create_mesh(const char *name, MeshData *data)
     Mesh *mesh = meshes.create(&handle);
     meshNames[handle] = name;
 
-    Vulkan::create_vertex_buffer(handle, data);
+    if (backend != RENDERER_BACKEND_NULL)
+        Vulkan::create_vertex_buffer(handle, data);
 
     return handle;
 }
@@ -435,7 +733,55 @@ void Renderer::destroy_mesh(MeshHandle handle)
 {
     Mesh &mesh = meshes[handle];
     meshes.mark_for_destruction(&mesh, [](Mesh* m, u32 handle) {
-        Vulkan::destroy_vertex_buffer(handle);
+        if (backend != RENDERER_BACKEND_NULL)
+            Vulkan::destroy_vertex_buffer(handle);
+        });
+}
+DynamicMeshHandle Renderer::create_dynamic_mesh(u32 vertexCapacity, u32 indexCapacity)
+{
+    DynamicMeshHandle handle;
+    DynamicMesh *mesh = dynamicMeshes.create(&handle);
+    if (mesh == nullptr)
+    {
+        std::cout << "Can't create more dynamic meshes!\n";
+        return -1;
+    }
+    mesh->vertexCapacity = vertexCapacity;
+    mesh->indexCapacity = indexCapacity;
+
+    if (backend != RENDERER_BACKEND_NULL)
+        Vulkan::create_dynamic_mesh(handle, vertexCapacity, indexCapacity);
+
+    return handle;
+}
+void Renderer::update_dynamic_mesh(DynamicMeshHandle handle, u32 firstVertex, const OverlayVertex *vertices, u32 vertexCount, u32 firstIndex, const u16 *indices, u32 indexCount)
+{
+    DynamicMesh &mesh = dynamicMeshes[handle];
+    if (firstVertex + vertexCount > mesh.vertexCapacity || firstIndex + indexCount > mesh.indexCapacity)
+    {
+        std::cout << "Dynamic mesh data doesn't fit, skipping update!\n";
+        return;
+    }
+
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
+
+    Vulkan::write_dynamic_vertices(handle, firstVertex, vertices, vertexCount);
+    Vulkan::write_dynamic_indices(handle, firstIndex, indices, indexCount);
+}
+void Renderer::draw_dynamic_mesh(DynamicMeshHandle handle, u32 indexCount)
+{
+    if (dynamicMeshDrawCount >= MAX_DYNAMIC_MESH_COUNT)
+        return;
+
+    dynamicMeshDraws[dynamicMeshDrawCount++] = {handle, MIN(indexCount, dynamicMeshes[handle].indexCapacity)};
+}
+void Renderer::destroy_dynamic_mesh(DynamicMeshHandle handle)
+{
+    DynamicMesh &mesh = dynamicMeshes[handle];
+    dynamicMeshes.mark_for_destruction(&mesh, [](DynamicMesh*, u32 handle) {
+        if (backend != RENDERER_BACKEND_NULL)
+            Vulkan::destroy_dynamic_mesh(handle);
         });
 }
 
@@ -464,16 +810,33 @@ ShaderHandle Renderer::create_shader(const char *name, const char *vertFname, co
     memcpy(shader->dataLayout.properties, dataLayout.properties, sizeof(ShaderPropertyInfo) * dataLayout.propertyCount);
     shader->samplerCount = samplerCount;
 
-    Vulkan::create_shader(handle, shader, vertFname, fragFname);
+    if (backend != RENDERER_BACKEND_NULL)
+        Vulkan::create_shader(handle, shader, vertFname, fragFname);
     return handle;
 }
 void Renderer::destroy_shader(ShaderHandle handle)
 {
     Shader &shader = shaders[handle];
     shaders.mark_for_destruction(&shader, [](Shader *s, u32 handle) {
-                                 Vulkan::destroy_shader(handle);
+                                 if (backend != RENDERER_BACKEND_NULL)
+                                     Vulkan::destroy_shader(handle);
                                  delete s->dataLayout.properties;});
 }
+void Renderer::begin_shader_batch()
+{
+    if (backend != RENDERER_BACKEND_NULL)
+        Vulkan::begin_shader_batch();
+}
+void Renderer::end_shader_batch()
+{
+    if (backend != RENDERER_BACKEND_NULL)
+        Vulkan::end_shader_batch();
+}
+void Renderer::wait_for_shaders()
+{
+    if (backend != RENDERER_BACKEND_NULL)
+        Vulkan::wait_for_shader_batch();
+}
 
 MaterialHandle Renderer::get_material(const char *name)
 {
@@ -503,6 +866,9 @@ MaterialHandle Renderer::create_material(const char *name, ShaderHandle shaderHa
     memcpy(material->textures, tex, sizeof(Texture*) * 8);
     material->castShadows = castShadows;
 
+    if (backend == RENDERER_BACKEND_NULL)
+        return handle;
+
     Vulkan::create_shader_data_block(handle, &material->dataBlock, shaderHandle);
     Vulkan::update_shader_data_block(handle, shaderHandle, material->dataBlock, shader->samplerCount, tex);
 
@@ -512,7 +878,8 @@ void Renderer::destroy_material(MaterialHandle handle)
 {
     Material &material = materials[handle];
     materials.mark_for_destruction(&material, [](Material *m, u32 handle) {
-                                   Vulkan::free_shader_data_block(handle, m->shader);});
+                                   if (backend != RENDERER_BACKEND_NULL)
+                                       Vulkan::free_shader_data_block(handle, m->shader);});
 }
 
 bool Renderer::set_material_float(MaterialHandle handle, const char* propertyName, u32 count, r32 *value)
@@ -723,5 +1090,9 @@ void Renderer::apply_material_changes(MaterialHandle handle)
 {
     Material &material = materials[handle];
     Shader &shader = shaders[material.shader];
+
+    if (backend == RENDERER_BACKEND_NULL)
+        return;
+
     Vulkan::update_shader_data_block(handle, material.shader, material.dataBlock, shader.samplerCount, material.textures);
 }
@@ -5,9 +5,11 @@
 #include "../util/typedef.h"
 #include "rendering_util.h"
 #include "material.h"
+#include "transform_kernel.h"
 
 struct Shader;
 struct ShaderPropertyInfo;
+struct Arena;
 
 namespace Renderer
 {
@@ -22,33 +24,71 @@ namespace Renderer
         s32 vertexOffset;
     };
 
+    // Sorting ID, from the highest bits: layer (8), then either depth (24), material (12), mesh (8)
+    // or material, mesh, depth depending on the layer's sort policy, and the data index (12) last
     struct DrawCall
     {
         u64 sortingID;
     };
 
+    enum SortPolicy
+    {
+        SORT_STATE_FIRST, //fewest state changes and longest instance batches, front to back within them
+        SORT_DEPTH_FIRST //strictly by depth, needed for blending
+    };
+
+    // Run of sorted drawcalls with the same mesh, material and index range, drawn as one instanced draw
+    struct InstanceBatch
+    {
+        u16 firstCall;
+        u16 instanceCount;
+        u32 firstInstance; //index of the first matrix
+    };
+
+    // Binds made and skipped by the state cache of the draw loop in the last frame, both passes together
+    struct BindStats
+    {
+        u32 pipelineBinds, pipelineSkips;
+        u32 descriptorSetBinds, descriptorSetSkips;
+        u32 vertexBufferBinds, vertexBufferSkips; //all vertex streams and the index buffer of a mesh
+    };
+
     struct RendererState
     {
         #define MAX_DRAWCALLS 0x1000
         DrawCallData data[MAX_DRAWCALLS]; //65536 drawcalls simultaneously should be enough
+        InstanceBatch batches[MAX_DRAWCALLS];
         #define MAX_TRANSFORMS 0x10000
-        Transform transform[MAX_TRANSFORMS];
-        glm::mat4x4 matrices[MAX_TRANSFORMS];
+        r32 transformComponents[TRANSFORM_COMPONENT_COUNT * MAX_TRANSFORMS]; //structure of arrays, see TransformKernel
+        AffineMatrix matrices[MAX_TRANSFORMS];
+    };
+
+    enum RendererBackend : u8
+    {
+        RENDERER_BACKEND_VULKAN,
+        RENDERER_BACKEND_NULL //no window or GPU, only the CPU side of drawing is done. For headless runs
     };
 
     //////////////////////////////////////
 
-    void init();
+    void init(RendererBackend backend = RENDERER_BACKEND_VULKAN);
     void deinit();
 
     void set_fullscreen(bool s);
 
     //drawcall stuff
     s16 render_mesh(MeshHandle mesh, MaterialHandle material, glm::vec3 pos, Quaternion rot, glm::vec3 scl, u32 c = 0, u32 i = 0, s32 v = 0);
-    void sort_drawcalls();
+    void sort_drawcalls(); //also groups them into instance batches
+    u32 get_drawcall_count();
+    u32 get_batch_count();
+    BindStats get_bind_stats();
+    GpuMemoryStats get_gpu_memory_stats();
+    PipelineStats get_pipeline_stats();
 
     void set_camera_position(glm::vec3 pos);
     void set_camera_rotation(Quaternion rot);
+    // Depth is front to back, except on the transparent layer where it's back to front
+    void set_layer_sort_policy(RenderLayer layer, SortPolicy policy);
     void set_light(glm::vec3 pos, glm::vec3 dir, glm::vec4 color);
     void set_env_map(TextureHandle texture);
 
@@ -56,8 +96,18 @@ namespace Renderer
 
     void draw();
 
+    // Screen space text, batched and drawn after post processing. Position is the top left corner in pixels
+    void set_overlay_font(TextureHandle texture);
+    void draw_text(const char *s, glm::vec2 pos, r32 size, Color color = {1,1,1});
+
     void clear_queue();
 
+    // Scratch memory that lives until the next clear_queue
+    Arena *get_frame_arena();
+    // Scratch memory for loading resources, free it with an ArenaScope
+    Arena *get_load_arena();
+
+    u64 drawcall_get_sort_key(const DrawCall &call);
     u8 drawcall_get_layer(DrawCall call);
     u32 drawcall_get_depth(DrawCall call);
     u16 drawcall_get_material(DrawCall call);
@@ -76,10 +126,21 @@ namespace Renderer
     MeshHandle create_mesh(const char *name, const char *fname);
     MeshHandle create_mesh(const char *name, MeshData *data);
     void destroy_mesh(MeshHandle mesh);
+    // Screen space geometry that changes every frame, like text. Updates are written in place without allocating
+    // and have to fit in the capacity. Draws go on the overlay with the font texture until the next clear_queue
+    DynamicMeshHandle create_dynamic_mesh(u32 vertexCapacity, u32 indexCapacity);
+    void update_dynamic_mesh(DynamicMeshHandle mesh, u32 firstVertex, const OverlayVertex *vertices, u32 vertexCount, u32 firstIndex, const u16 *indices, u32 indexCount);
+    void draw_dynamic_mesh(DynamicMeshHandle mesh, u32 indexCount);
+    void destroy_dynamic_mesh(DynamicMeshHandle mesh);
 
     ShaderHandle get_shader(const char *name);
     ShaderHandle create_shader(const char *name, const char *vertFname, const char *fragFname, RenderLayer layer, VertexAttribFlags vertexInputs, ShaderDataLayout dataLayout, u32 samplerCount);
     void destroy_shader(ShaderHandle shader);
+    // Shaders created between these two have their pipelines built in parallel on the job system.
+    // They can be used for materials right away, draw() waits for the pipelines if they aren't done yet
+    void begin_shader_batch();
+    void end_shader_batch();
+    void wait_for_shaders();
 
     MaterialHandle get_material(const char *name);
     MaterialHandle create_material(const char *name, ShaderHandle shaderHandle, void *shaderData, TextureHandle* texHandles, bool castShadows);
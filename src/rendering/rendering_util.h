@@ -20,6 +20,7 @@ typedef s32 ShaderHandle;
 typedef s32 TextureHandle;
 typedef s32 MaterialHandle;
 typedef s32 MeshHandle;
+typedef s32 DynamicMeshHandle;
 
 struct Triangle
 {
@@ -66,6 +67,20 @@ struct Mesh
     // Empty :c
 };
 
+// Screen space vertex, position is in pixels from the top left corner
+struct OverlayVertex
+{
+    glm::vec3 position;
+    glm::vec2 texcoord0;
+    glm::vec4 color;
+};
+
+struct DynamicMesh
+{
+    u32 vertexCapacity;
+    u32 indexCapacity;
+};
+
 ///////////////////////////////////////
 
 enum ImageType
@@ -100,11 +115,30 @@ struct Texture
 
 ////////////////////////////////////////
 
-struct Transform
+// Device memory usage of the renderer
+struct GpuMemoryStats
 {
-    glm::vec3 position;
-    Quaternion rotation;
-    glm::vec3 scale;
+    u32 blockCount; //device memory allocations, including ones too big to share a block
+    u32 allocationCount;
+    u64 reservedBytes; //size of all blocks
+    u64 usedBytes; //handed out, sizes rounded up to powers of two
+    u64 requestedBytes; //what the resources asked for
+    r32 fragmentation; //share of a block's free space outside its largest free piece, worst block
+};
+
+// Graphics pipeline creation so far, and whether it started from a pipeline cache saved by an earlier run
+struct PipelineStats
+{
+    u32 pipelineCount;
+    r64 creationMs;
+    bool warmCache;
+    u64 loadedCacheBytes;
+};
+
+// Top three rows of an affine model matrix, the last row is always 0, 0, 0, 1. Instance data layout on the GPU
+struct AffineMatrix
+{
+    glm::vec4 rows[3];
 };
 
 #endif // RENDERING_UTIL_H
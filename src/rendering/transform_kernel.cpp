@@ -0,0 +1,230 @@
+#include "transform_kernel.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRANSFORM_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+namespace TransformKernel
+{
+    KernelLevel supportedLevel = KERNEL_SCALAR;
+    KernelLevel currentLevel = KERNEL_SCALAR;
+
+    const char *levelNames[KERNEL_LEVEL_COUNT] = {"scalar", "SSE", "AVX2"};
+
+    void build_scalar(const TransformStreams &t, const u16 *indices, u32 count, AffineMatrix *out);
+#ifdef TRANSFORM_KERNEL_X86
+    __attribute__((target("sse2"))) void build_sse(const TransformStreams &t, const u16 *indices, u32 count, AffineMatrix *out);
+    __attribute__((target("avx2"))) void build_avx2(const TransformStreams &t, const u16 *indices, u32 count, AffineMatrix *out);
+#endif
+}
+
+// Same math as the SIMD kernels, also used for their leftover instances
+void TransformKernel::build_scalar(const TransformStreams &t, const u16 *indices, u32 count, AffineMatrix *out)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        u32 j = indices[i];
+        r32 x = t.rotX[j], y = t.rotY[j], z = t.rotZ[j], w = t.rotW[j];
+        r32 sx = t.sclX[j], sy = t.sclY[j], sz = t.sclZ[j];
+
+        r32 xx = 2 * x * x, yy = 2 * y * y, zz = 2 * z * z;
+        r32 xy = 2 * x * y, xz = 2 * x * z, yz = 2 * y * z;
+        r32 wx = 2 * w * x, wy = 2 * w * y, wz = 2 * w * z;
+
+        out[i].rows[0] = glm::vec4((1 - yy - zz) * sx, (xy - wz) * sy, (xz + wy) * sz, t.posX[j]);
+        out[i].rows[1] = glm::vec4((xy + wz) * sx, (1 - xx - zz) * sy, (yz - wx) * sz, t.posY[j]);
+        out[i].rows[2] = glm::vec4((xz - wy) * sx, (yz + wx) * sy, (1 - xx - yy) * sz, t.posZ[j]);
+    }
+}
+
+#ifdef TRANSFORM_KERNEL_X86
+#define GATHER4(stream) _mm_set_ps(stream[indices[i + 3]], stream[indices[i + 2]], stream[indices[i + 1]], stream[indices[i]])
+
+// 4 instances per iteration, one per lane. Rows come out with a 4x4 transpose
+void TransformKernel::build_sse(const TransformStreams &t, const u16 *indices, u32 count, AffineMatrix *out)
+{
+    const __m128 one = _mm_set1_ps(1.0f);
+
+    u32 i = 0;
+    for (; i + 4 <= count; i += 4)
+    {
+        __m128 x = GATHER4(t.rotX), y = GATHER4(t.rotY), z = GATHER4(t.rotZ), w = GATHER4(t.rotW);
+        __m128 sx = GATHER4(t.sclX), sy = GATHER4(t.sclY), sz = GATHER4(t.sclZ);
+
+        __m128 x2 = _mm_add_ps(x, x), y2 = _mm_add_ps(y, y), z2 = _mm_add_ps(z, z);
+        __m128 xx = _mm_mul_ps(x, x2), yy = _mm_mul_ps(y, y2), zz = _mm_mul_ps(z, z2);
+        __m128 xy = _mm_mul_ps(x, y2), xz = _mm_mul_ps(x, z2), yz = _mm_mul_ps(y, z2);
+        __m128 wx = _mm_mul_ps(w, x2), wy = _mm_mul_ps(w, y2), wz = _mm_mul_ps(w, z2);
+
+        __m128 r0 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(yy, zz)), sx);
+        __m128 r1 = _mm_mul_ps(_mm_sub_ps(xy, wz), sy);
+        __m128 r2 = _mm_mul_ps(_mm_add_ps(xz, wy), sz);
+        __m128 r3 = GATHER4(t.posX);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(&out[i].rows[0].x, r0);
+        _mm_storeu_ps(&out[i + 1].rows[0].x, r1);
+        _mm_storeu_ps(&out[i + 2].rows[0].x, r2);
+        _mm_storeu_ps(&out[i + 3].rows[0].x, r3);
+
+        r0 = _mm_mul_ps(_mm_add_ps(xy, wz), sx);
+        r1 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, zz)), sy);
+        r2 = _mm_mul_ps(_mm_sub_ps(yz, wx), sz);
+        r3 = GATHER4(t.posY);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(&out[i].rows[1].x, r0);
+        _mm_storeu_ps(&out[i + 1].rows[1].x, r1);
+        _mm_storeu_ps(&out[i + 2].rows[1].x, r2);
+        _mm_storeu_ps(&out[i + 3].rows[1].x, r3);
+
+        r0 = _mm_mul_ps(_mm_sub_ps(xz, wy), sx);
+        r1 = _mm_mul_ps(_mm_add_ps(yz, wx), sy);
+        r2 = _mm_mul_ps(_mm_sub_ps(one, _mm_add_ps(xx, yy)), sz);
+        r3 = GATHER4(t.posZ);
+        _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+        _mm_storeu_ps(&out[i].rows[2].x, r0);
+        _mm_storeu_ps(&out[i + 1].rows[2].x, r1);
+        _mm_storeu_ps(&out[i + 2].rows[2].x, r2);
+        _mm_storeu_ps(&out[i + 3].rows[2].x, r3);
+    }
+
+    build_scalar(t, indices + i, count - i, out + i);
+}
+
+// Transposes four 8 lane vectors within each 128 bit half: the low half of rk is the row of instance k, the high half that of instance k + 4
+#define TRANSPOSE4_256(r0, r1, r2, r3) \
+{ \
+    __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3); \
+    __m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3); \
+    r0 = _mm256_shuffle_ps(t0, t1, 0x44); \
+    r1 = _mm256_shuffle_ps(t0, t1, 0xee); \
+    r2 = _mm256_shuffle_ps(t2, t3, 0x44); \
+    r3 = _mm256_shuffle_ps(t2, t3, 0xee); \
+}
+
+// 8 instances per iteration with hardware gathers. Rows 0 and 1 of an instance are next to each other, so they go out as one 256 bit store
+void TransformKernel::build_avx2(const TransformStreams &t, const u16 *indices, u32 count, AffineMatrix *out)
+{
+    const __m256 one = _mm256_set1_ps(1.0f);
+
+    u32 i = 0;
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i idx = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(indices + i)));
+
+        __m256 x = _mm256_i32gather_ps(t.rotX, idx, 4), y = _mm256_i32gather_ps(t.rotY, idx, 4);
+        __m256 z = _mm256_i32gather_ps(t.rotZ, idx, 4), w = _mm256_i32gather_ps(t.rotW, idx, 4);
+        __m256 sx = _mm256_i32gather_ps(t.sclX, idx, 4), sy = _mm256_i32gather_ps(t.sclY, idx, 4);
+        __m256 sz = _mm256_i32gather_ps(t.sclZ, idx, 4);
+
+        __m256 x2 = _mm256_add_ps(x, x), y2 = _mm256_add_ps(y, y), z2 = _mm256_add_ps(z, z);
+        __m256 xx = _mm256_mul_ps(x, x2), yy = _mm256_mul_ps(y, y2), zz = _mm256_mul_ps(z, z2);
+        __m256 xy = _mm256_mul_ps(x, y2), xz = _mm256_mul_ps(x, z2), yz = _mm256_mul_ps(y, z2);
+        __m256 wx = _mm256_mul_ps(w, x2), wy = _mm256_mul_ps(w, y2), wz = _mm256_mul_ps(w, z2);
+
+        __m256 a0 = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx);
+        __m256 a1 = _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy);
+        __m256 a2 = _mm256_mul_ps(_mm256_add_ps(xz, wy), sz);
+        __m256 a3 = _mm256_i32gather_ps(t.posX, idx, 4);
+        TRANSPOSE4_256(a0, a1, a2, a3);
+
+        __m256 b0 = _mm256_mul_ps(_mm256_add_ps(xy, wz), sx);
+        __m256 b1 = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy);
+        __m256 b2 = _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz);
+        __m256 b3 = _mm256_i32gather_ps(t.posY, idx, 4);
+        TRANSPOSE4_256(b0, b1, b2, b3);
+
+        __m256 c0 = _mm256_mul_ps(_mm256_sub_ps(xz, wy), sx);
+        __m256 c1 = _mm256_mul_ps(_mm256_add_ps(yz, wx), sy);
+        __m256 c2 = _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz);
+        __m256 c3 = _mm256_i32gather_ps(t.posZ, idx, 4);
+        TRANSPOSE4_256(c0, c1, c2, c3);
+
+        __m256 rowsA[4] = {a0, a1, a2, a3};
+        __m256 rowsB[4] = {b0, b1, b2, b3};
+        __m256 rowsC[4] = {c0, c1, c2, c3};
+        for (u32 k = 0; k < 4; k++)
+        {
+            _mm256_storeu_ps(&out[i + k].rows[0].x, _mm256_permute2f128_ps(rowsA[k], rowsB[k], 0x20));
+            _mm_storeu_ps(&out[i + k].rows[2].x, _mm256_castps256_ps128(rowsC[k]));
+            _mm256_storeu_ps(&out[i + k + 4].rows[0].x, _mm256_permute2f128_ps(rowsA[k], rowsB[k], 0x31));
+            _mm_storeu_ps(&out[i + k + 4].rows[2].x, _mm256_extractf128_ps(rowsC[k], 1));
+        }
+    }
+
+    build_scalar(t, indices + i, count - i, out + i);
+}
+#endif
+
+void TransformKernel::init()
+{
+    supportedLevel = KERNEL_SCALAR;
+#ifdef TRANSFORM_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+        supportedLevel = KERNEL_SSE;
+    if (__builtin_cpu_supports("avx2"))
+        supportedLevel = KERNEL_AVX2;
+#endif
+    currentLevel = supportedLevel;
+}
+
+TransformKernel::TransformStreams TransformKernel::make_streams(r32 *storage, u32 capacity)
+{
+    TransformStreams streams;
+    r32 **components[TRANSFORM_COMPONENT_COUNT] = {&streams.posX, &streams.posY, &streams.posZ,
+                                                   &streams.rotX, &streams.rotY, &streams.rotZ, &streams.rotW,
+                                                   &streams.sclX, &streams.sclY, &streams.sclZ};
+    for (u32 i = 0; i < TRANSFORM_COMPONENT_COUNT; i++)
+    {
+        *components[i] = storage + i * capacity;
+    }
+    return streams;
+}
+
+void TransformKernel::set_transform(const TransformStreams &streams, u32 index, const glm::vec3 &pos, const Quaternion &rot, const glm::vec3 &scl)
+{
+    streams.posX[index] = pos.x;
+    streams.posY[index] = pos.y;
+    streams.posZ[index] = pos.z;
+    streams.rotX[index] = rot.x;
+    streams.rotY[index] = rot.y;
+    streams.rotZ[index] = rot.z;
+    streams.rotW[index] = rot.w;
+    streams.sclX[index] = scl.x;
+    streams.sclY[index] = scl.y;
+    streams.sclZ[index] = scl.z;
+}
+
+void TransformKernel::set_level(KernelLevel level)
+{
+    currentLevel = level <= supportedLevel ? level : supportedLevel;
+}
+
+TransformKernel::KernelLevel TransformKernel::get_level()
+{
+    return currentLevel;
+}
+
+const char *TransformKernel::get_level_name(KernelLevel level)
+{
+    return levelNames[level];
+}
+
+void TransformKernel::build_matrices(const TransformStreams &streams, const u16 *indices, u32 count, AffineMatrix *outMatrices)
+{
+    switch (currentLevel)
+    {
+#ifdef TRANSFORM_KERNEL_X86
+        case KERNEL_AVX2:
+            build_avx2(streams, indices, count, outMatrices);
+            break;
+        case KERNEL_SSE:
+            build_sse(streams, indices, count, outMatrices);
+            break;
+#endif
+        default:
+            build_scalar(streams, indices, count, outMatrices);
+            break;
+    }
+}
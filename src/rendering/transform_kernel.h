@@ -0,0 +1,42 @@
+#ifndef TRANSFORM_KERNEL_H
+#define TRANSFORM_KERNEL_H
+
+#include "../util/typedef.h"
+#include "rendering_util.h"
+
+// Builds model matrices from position, rotation and scale, 4 or 8 instances at a time with SSE or AVX2.
+// The widest kernel the CPU supports is picked at runtime, so the build doesn't need -mavx2
+namespace TransformKernel
+{
+    // Transforms as a structure of arrays, one array per component, so a kernel can load the same component of several instances at once
+    struct TransformStreams
+    {
+        r32 *posX, *posY, *posZ;
+        r32 *rotX, *rotY, *rotZ, *rotW;
+        r32 *sclX, *sclY, *sclZ;
+    };
+    #define TRANSFORM_COMPONENT_COUNT 10
+
+    enum KernelLevel
+    {
+        KERNEL_SCALAR,
+        KERNEL_SSE,
+        KERNEL_AVX2,
+        KERNEL_LEVEL_COUNT
+    };
+
+    void init();
+    // Storage needs TRANSFORM_COMPONENT_COUNT * capacity floats
+    TransformStreams make_streams(r32 *storage, u32 capacity);
+    void set_transform(const TransformStreams &streams, u32 index, const glm::vec3 &pos, const Quaternion &rot, const glm::vec3 &scl);
+
+    // Levels the CPU doesn't support fall back to the best one it does. For benchmarking
+    void set_level(KernelLevel level);
+    KernelLevel get_level();
+    const char *get_level_name(KernelLevel level);
+
+    // outMatrices[i] gets the matrix of transform indices[i]
+    void build_matrices(const TransformStreams &streams, const u16 *indices, u32 count, AffineMatrix *outMatrices);
+}
+
+#endif // TRANSFORM_KERNEL_H
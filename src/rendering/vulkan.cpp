@@ -2,8 +2,14 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <cstddef>
+#include <cstring>
 #include "image_loader.h"
 #include "../util/math.h"
+#include "../util/buddy.h"
+#include "../util/free_list.h"
+#include "../time/time.h"
+#include "../jobs/jobs.h"
 
 struct RenderPipeline
 {
@@ -39,7 +45,7 @@ namespace Vulkan
     #define CAMERA_DATA_BINDING 0
     VkDescriptorBufferInfo cameraDataInfo;
     VkBuffer cameraDataBuffer;
-    VkDeviceMemory cameraDataMemory;
+    MemoryAllocation cameraDataMemory;
 
     struct GlobalMatrices //should Renderer own this? Maybe
     {
@@ -54,7 +60,7 @@ namespace Vulkan
     #define LIGHTING_DATA_BINDING 1
     VkDescriptorBufferInfo lightingDataInfo;
     VkBuffer lightingDataBuffer;
-    VkDeviceMemory lightingDataMemory;
+    MemoryAllocation lightingDataMemory;
 
     struct LightingData
     {
@@ -69,16 +75,17 @@ namespace Vulkan
     #define PER_INSTANCE_DATA_BINDING 2
     VkDescriptorBufferInfo perInstanceInfo;
     VkBuffer perInstanceBuffer;
-    VkDeviceMemory perInstanceMemory;
-    u32 perInstanceDynamicOffset;
+    MemoryAllocation perInstanceMemory;
+    AffineMatrix *perInstanceMapping; //persistently mapped, a copy for each frame in flight
 
     VkDeviceSize minUniformBufferOffsetAlignment;
+    VkDeviceSize minStorageBufferOffsetAlignment;
 
     ///SHADER DATA///
     #define SHADER_DATA_BINDING 3
     VkDescriptorSet descriptorSets[MAX_MATERIAL_COUNT];
     VkBuffer shaderDataBuffer;
-    VkDeviceMemory shaderDataMemory;
+    MemoryAllocation shaderDataMemory;
 
     ///SWAPCHAIN///
     VkSwapchainKHR swapChain;
@@ -93,7 +100,7 @@ namespace Vulkan
     ///DEPTH TEXTURE///
     #define DEPTH_TEX_BINDING 15
     VkImage depthImage;
-    VkDeviceMemory depthImageMemory;
+    MemoryAllocation depthImageMemory;
     VkImageView depthImageView;
     VkSampler depthSampler;
 
@@ -102,7 +109,7 @@ namespace Vulkan
     #define SHADOW_RESOLUTION 4096
     #define SHADOW_AREA 25
     VkImage shadowImage;
-    VkDeviceMemory shadowImageMemory;
+    MemoryAllocation shadowImageMemory;
     VkImageView shadowImageView;
     VkSampler shadowSampler;
     VkFramebuffer shadowFramebuffer;
@@ -110,7 +117,7 @@ namespace Vulkan
     ///ENV MAP///
     #define CUBEMAP_DATA_BINDING 13
     VkImage noCubemapImage;
-    VkDeviceMemory noCubemapImageMemory;
+    MemoryAllocation noCubemapImageMemory;
     VkImageView noCubemapImageView;
     VkSampler noCubemapSampler;
 
@@ -119,17 +126,17 @@ namespace Vulkan
 
     ///MULTISAMPLING///
     VkImage msDepthImage;
-    VkDeviceMemory msDepthImageMemory;
+    MemoryAllocation msDepthImageMemory;
     VkImageView msDepthImageView;
 
     VkImage msImage;
-    VkDeviceMemory msImageMemory;
+    MemoryAllocation msImageMemory;
     VkImageView msImageView;
 
     ///COLOR TEXTURE///
     #define COLOR_TEX_BINDING 14
     VkImage colorImage;
-    VkDeviceMemory colorImageMemory;
+    MemoryAllocation colorImageMemory;
     VkImageView colorImageView;
     VkSampler colorSampler;
 
@@ -137,7 +144,7 @@ namespace Vulkan
     VkFramebuffer postProcessFramebuffer;
 
     VkImage noiseImage;
-    VkDeviceMemory noiseImageMemory;
+    MemoryAllocation noiseImageMemory;
     VkImageView noiseImageView;
     VkSampler noiseSampler;
 
@@ -177,16 +184,29 @@ namespace Vulkan
     DescriptorSetLayoutInfo gradingDescriptorSetLayoutInfo;
 
     ///COMMAND BUFFERS///
-    VkCommandPool commandPool;
-    VkCommandBuffer renderCommandBuffer;
+    // The CPU records the next frame while the GPU renders the previous one. Anything the CPU writes
+    // every frame has a copy per frame in flight, and a frame's fence is waited on before its copies are reused
+    #define FRAMES_IN_FLIGHT 2
+    VkCommandPool frameCommandPools[FRAMES_IN_FLIGHT];
+    VkCommandBuffer frameCommandBuffers[FRAMES_IN_FLIGHT];
+    VkFence frameFences[FRAMES_IN_FLIGHT];
+    u32 currentFrame = 0;
+
+    // Draws are recorded into secondary command buffers, one per slice and pass. Command pools can't be used
+    // from two threads at once, so each slice has its own for every frame in flight
+    VkCommandPool recordingCommandPools[FRAMES_IN_FLIGHT][MAX_RECORDING_SLICES];
+    VkCommandBuffer recordingCommandBuffers[FRAMES_IN_FLIGHT][MAX_RECORDING_SLICES][RECORDING_PASS_COUNT];
+
+    VkCommandBuffer primaryCommandBuffer; //the current frame's
+    thread_local VkCommandBuffer renderCommandBuffer; //what this thread records into, the primary one outside of recording
 
     ///SEMAPHORES///
-    VkSemaphore imageAvailableSemaphore;
-    VkSemaphore renderFinishedSemaphore;
+    VkSemaphore imageAvailableSemaphores[FRAMES_IN_FLIGHT];
+    VkSemaphore renderFinishedSemaphores[FRAMES_IN_FLIGHT];
 
     ///TEXTURES///
     VkImage textureImages[MAX_TEXTURE_COUNT];
-    VkDeviceMemory textureMemory[MAX_TEXTURE_COUNT];
+    MemoryAllocation textureMemory[MAX_TEXTURE_COUNT];
     VkImageView textureImageViews[MAX_TEXTURE_COUNT];
     VkSampler textureSamplers[MAX_TEXTURE_COUNT];
 
@@ -200,21 +220,140 @@ namespace Vulkan
     #define SAMPLER_BINDING7 11
 
     ///VERTEX BUFFERS///
-    u32 vertexCounts[MAX_VERTEX_BUFFER_COUNT];
-    VkBuffer vertexPositionBuffers[MAX_VERTEX_BUFFER_COUNT];
-    VkBuffer vertexTexcoord0Buffers[MAX_VERTEX_BUFFER_COUNT];
-    VkBuffer vertexNormalBuffers[MAX_VERTEX_BUFFER_COUNT];
-    VkBuffer vertexTangentBuffers[MAX_VERTEX_BUFFER_COUNT];
-    VkBuffer vertexColorBuffers[MAX_VERTEX_BUFFER_COUNT];
-    VkDeviceMemory vertexPositionBufferMemory[MAX_VERTEX_BUFFER_COUNT];
-    VkDeviceMemory vertexTexcoord0BufferMemory[MAX_VERTEX_BUFFER_COUNT];
-    VkDeviceMemory vertexNormalBufferMemory[MAX_VERTEX_BUFFER_COUNT];
-    VkDeviceMemory vertexTangentBufferMemory[MAX_VERTEX_BUFFER_COUNT];
-    VkDeviceMemory vertexColorBufferMemory[MAX_VERTEX_BUFFER_COUNT];
-
-    u32 indexCounts[MAX_VERTEX_BUFFER_COUNT];
-    VkBuffer indexBuffers[MAX_VERTEX_BUFFER_COUNT];
-    VkDeviceMemory indexBufferMemory[MAX_VERTEX_BUFFER_COUNT];
+    enum MeshStream
+    {
+        MESH_STREAM_POSITION,
+        MESH_STREAM_TEXCOORD_0,
+        MESH_STREAM_NORMAL,
+        MESH_STREAM_TANGENT,
+        MESH_STREAM_COLOR,
+        MESH_STREAM_INDEX,
+        MESH_STREAM_COUNT
+    };
+    const VkDeviceSize meshStreamStrides[MESH_STREAM_COUNT] = {sizeof(glm::vec3), sizeof(glm::vec2), sizeof(glm::vec3), sizeof(glm::vec4), sizeof(glm::vec4), sizeof(u16)};
+
+    MeshRecord meshRecords[MAX_VERTEX_BUFFER_COUNT];
+
+    // Static meshes are packed into shared buffers, one per stream, and a mesh is a range of vertices and indices in them.
+    // Freed ranges go back to a free list for later meshes
+    #define STATIC_VERTEX_CAPACITY (1 << 19)
+    #define STATIC_INDEX_CAPACITY (1 << 21)
+    VkBuffer staticGeometryBuffers[MESH_STREAM_COUNT];
+    MemoryAllocation staticGeometryMemory[MESH_STREAM_COUNT];
+    FreeRange staticVertexRanges[MAX_VERTEX_BUFFER_COUNT + 1];
+    FreeRange staticIndexRanges[MAX_VERTEX_BUFFER_COUNT + 1];
+    FreeList staticVertexList;
+    FreeList staticIndexList;
+
+    ///OVERLAY///
+    VkDescriptorPool overlayDescriptorPool;
+    VkDescriptorSetLayout overlayDescriptorSetLayout;
+    VkDescriptorSet overlayDescriptorSet;
+    VkPipelineLayout overlayPipelineLayout;
+    VkPipeline overlayPipeline;
+    bool overlayTextureSet = false;
+
+    VkBuffer overlayUniformBuffer;
+    MemoryAllocation overlayUniformMemory;
+    VkDescriptorBufferInfo overlayCameraDataInfo;
+    VkDescriptorBufferInfo overlayInstanceDataInfo;
+
+    ///DYNAMIC MESHES///
+    // Vertices and then indices of a dynamic mesh are in one persistently mapped buffer, with a copy for each frame in flight
+    VkBuffer dynamicMeshBuffers[MAX_DYNAMIC_MESH_COUNT];
+    MemoryAllocation dynamicMeshMemory[MAX_DYNAMIC_MESH_COUNT];
+    u8 *dynamicMeshMappings[MAX_DYNAMIC_MESH_COUNT];
+    VkDeviceSize dynamicMeshCopySizes[MAX_DYNAMIC_MESH_COUNT];
+    VkDeviceSize dynamicMeshIndexOffsets[MAX_DYNAMIC_MESH_COUNT];
+
+    ///MEMORY///
+    // Blocks of device memory, split up with a buddy allocator. Buffers and images never share a block,
+    // so bufferImageGranularity doesn't have to be minded. Allocations bigger than half a block get a block to themselves
+    struct MemoryBlock
+    {
+        VkDeviceMemory memory;
+        VkDeviceSize size;
+        u32 memoryTypeIndex;
+        bool image;
+        bool dedicated;
+        u8 *mapping; //host visible blocks are mapped for their whole lifetime
+        BuddyAllocator buddy;
+    };
+    #define MAX_MEMORY_BLOCKS 64
+    #define MEMORY_BLOCK_ORDER 25 //32MB
+    #define MEMORY_MIN_ALLOCATION_ORDER 8
+    MemoryBlock memoryBlocks[MAX_MEMORY_BLOCKS];
+    u32 memoryAllocationCount = 0;
+    VkDeviceSize memoryRequestedBytes = 0;
+
+    bool allocate_memory_block(u32 block, VkDeviceSize size, u32 memoryTypeIndex, bool image, bool dedicated);
+
+    ///PIPELINE CACHE///
+    #define PIPELINE_CACHE_FNAME "pipeline_cache.bin"
+    #define PIPELINE_CACHE_MAGIC 0x4e4b5043 //NKPC
+    // Written in front of the cache data. Vulkan's own header has no driver version, and a cache from a different driver is just dead weight
+    struct PipelineCacheFileHeader
+    {
+        u32 magic;
+        u32 vendorID;
+        u32 deviceID;
+        u32 driverVersion;
+        u8 pipelineCacheUUID[VK_UUID_SIZE];
+        u64 dataSize;
+    };
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    PipelineStats pipelineStats = {};
+
+    ///SHADER BATCH///
+    #define MAX_SHADER_PATH 128
+    struct PendingPipeline
+    {
+        u32 shaderIndex;
+        char vert[MAX_SHADER_PATH];
+        char frag[MAX_SHADER_PATH];
+        r64 finishTime; //written by the job that built it
+    };
+    PendingPipeline pendingPipelines[MAX_SHADER_COUNT];
+    u32 pendingPipelineCount = 0;
+    bool shaderBatchOpen = false;
+    bool shaderBatchRunning = false; //pipeline stats are summed up per batch while jobs are building
+    r64 shaderBatchStart;
+    Jobs::Counter shaderBatchCounter;
+
+    void build_pending_pipelines(void *data, u32 first, u32 count);
+
+    ///UPLOADS///
+    #define UPLOAD_BATCH_COUNT 4
+    #define UPLOAD_RING_SIZE (32 << 20)
+    #define UPLOAD_ALIGNMENT 16
+    #define MAX_UPLOAD_OVERSIZE_BUFFERS 16
+
+    // Batches are used round robin, so they finish and free their ring space in the order they were submitted
+    struct UploadBatch
+    {
+        VkCommandPool commandPool;
+        VkCommandBuffer commandBuffer;
+        VkFence fence;
+        u64 serial; //0 unless submitted and not retired yet
+        VkDeviceSize ringBytes; //including padding
+        u32 oversizeCount;
+        VkBuffer oversizeBuffers[MAX_UPLOAD_OVERSIZE_BUFFERS];
+        MemoryAllocation oversizeMemory[MAX_UPLOAD_OVERSIZE_BUFFERS]; //staging too big for the ring, freed with the batch
+    };
+    UploadBatch uploadBatches[UPLOAD_BATCH_COUNT];
+    u32 openUploadBatch = 0;
+    bool uploadBatchRecording = false;
+    u64 nextUploadSerial = 1;
+    u64 completedUploadSerial = 0;
+
+    VkBuffer uploadRingBuffer;
+    MemoryAllocation uploadRingMemory;
+    u8 *uploadRingMapping;
+    VkDeviceSize uploadRingHead = 0;
+    VkDeviceSize uploadRingUsed = 0; //the free space is the contiguous range after the head, wrapping around
+
+    void open_upload_batch();
+    bool retire_oldest_upload_batch(bool wait); //returns false if nothing was retired
 
     ///DEBUG///
     #ifdef NDEBUG
@@ -241,6 +380,7 @@ void Vulkan::find_physical_device()
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceInfo.properties);
     vkGetPhysicalDeviceMemoryProperties(physicalDevice, &physicalDeviceInfo.memProperties);
     minUniformBufferOffsetAlignment = physicalDeviceInfo.properties.limits.minUniformBufferOffsetAlignment;
+    minStorageBufferOffsetAlignment = physicalDeviceInfo.properties.limits.minStorageBufferOffsetAlignment;
 
     //print out device name just for funs
     std::cout << "Found device: " << physicalDeviceInfo.properties.deviceName << std::endl;
@@ -328,15 +468,20 @@ void Vulkan::free_logical_device()
 ///DESCRIPTOR POOLS///
 void Vulkan::create_descriptor_pool(VkDescriptorPool *pool, DescriptorSetLayoutInfo info)
 {
-    // Currently 3 built in uniform buffers (GlobalMatrices, LightingData, PerInstanceData)
+    // Currently 2 built in uniform buffers (GlobalMatrices, LightingData)
     VkDescriptorPoolSize uniformBufferPoolSize;
     uniformBufferPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     u32 uniformBufferCount = 0;
     uniformBufferCount += (info.flags & DSF_CAMERADATA) == DSF_CAMERADATA;
     uniformBufferCount += (info.flags & DSF_LIGHTINGDATA) == DSF_LIGHTINGDATA;
-    uniformBufferCount += (info.flags & DSF_INSTANCEDATA) == DSF_INSTANCEDATA;
     uniformBufferPoolSize.descriptorCount = uniformBufferCount * MAX_MATERIAL_COUNT;
 
+    // PerInstanceData is a storage buffer
+    VkDescriptorPoolSize instanceDataPoolSize;
+    instanceDataPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bool32 hasInstanceData = (info.flags & DSF_INSTANCEDATA) == DSF_INSTANCEDATA;
+    instanceDataPoolSize.descriptorCount = hasInstanceData * MAX_MATERIAL_COUNT;
+
     // 0-8 samplers depending on the shader, plus built in shadowmap and env cubemap
     VkDescriptorPoolSize samplerPoolSize;
     samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
@@ -348,14 +493,14 @@ void Vulkan::create_descriptor_pool(VkDescriptorPool *pool, DescriptorSetLayoutI
 
     samplerPoolSize.descriptorCount = textureCount * MAX_MATERIAL_COUNT;
 
-    // ShaderData is dynamic uniform buffer
+    // ShaderData is a uniform buffer
     VkDescriptorPoolSize shaderDataPoolSize;
-    shaderDataPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+    shaderDataPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     bool32 hasShaderData = (info.flags & DSF_SHADERDATA) == DSF_SHADERDATA;
     shaderDataPoolSize.descriptorCount = hasShaderData * MAX_MATERIAL_COUNT;
 
-    // 3 types of descriptors
-    VkDescriptorPoolSize poolSize[3];
+    // 4 types of descriptors
+    VkDescriptorPoolSize poolSize[4];
     u32 poolSizeIndex = 0;
 
     if (uniformBufferCount > 0)
@@ -364,6 +509,12 @@ void Vulkan::create_descriptor_pool(VkDescriptorPool *pool, DescriptorSetLayoutI
         poolSizeIndex++;
     }
 
+    if (hasInstanceData)
+    {
+        poolSize[poolSizeIndex] = instanceDataPoolSize;
+        poolSizeIndex++;
+    }
+
     if (textureCount > 0)
     {
         poolSize[poolSizeIndex] = samplerPoolSize;
@@ -427,7 +578,7 @@ void Vulkan::create_descriptor_set_layout(VkDescriptorSetLayout *layout, Descrip
     if ((info.flags & DSF_INSTANCEDATA) == DSF_INSTANCEDATA)
     {
         bindings[bindingIndex].binding = PER_INSTANCE_DATA_BINDING;
-        bindings[bindingIndex].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        bindings[bindingIndex].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         bindings[bindingIndex].descriptorCount = 1;
         bindings[bindingIndex].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
         bindings[bindingIndex].pImmutableSamplers = nullptr;
@@ -531,24 +682,14 @@ void Vulkan::create_camera_data_buffer()
     bufferInfo.pNext = nullptr;
     bufferInfo.flags = 0;
     bufferInfo.size = bufferSize;
-    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     bufferInfo.queueFamilyIndexCount = 0;
     bufferInfo.pQueueFamilyIndices = nullptr;
 
     vkCreateBuffer(device, &bufferInfo, nullptr, &cameraDataBuffer);
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, cameraDataBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    vkAllocateMemory(device, &allocInfo, nullptr, &cameraDataMemory);
-    vkBindBufferMemory(device, cameraDataBuffer, cameraDataMemory, 0);
+    allocate_buffer_memory(&cameraDataMemory, cameraDataBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     // Store info
     cameraDataInfo.buffer = cameraDataBuffer;
@@ -584,17 +725,13 @@ void Vulkan::update_matrices(glm::vec3 camPos, Quaternion camRot) //placeholder
     globalMatrices.proj = glm::perspective(glm::radians(41.12f), SCREEN_WIDTH / (float) SCREEN_HEIGHT, 0.01f, 100.0f);
     globalMatrices.proj[1][1] *= -1;
     globalMatrices.camPos = camPos;
-
-    void* data;
-    vkMapMemory(device, cameraDataMemory, 0, sizeof(GlobalMatrices), 0, &data);
-        memcpy(data, &globalMatrices, sizeof(GlobalMatrices));
-    vkUnmapMemory(device, cameraDataMemory);
+    //copied to the buffer when the frame is recorded
 }
 
 void Vulkan::destroy_camera_data_buffer()
 {
     vkDestroyBuffer(device, cameraDataBuffer, nullptr);
-    vkFreeMemory(device, cameraDataMemory, nullptr);
+    free_memory(&cameraDataMemory);
 }
 
 ///LIGHTING DATA///
@@ -607,24 +744,14 @@ void Vulkan::create_lighting_buffer()
     bufferInfo.pNext = nullptr;
     bufferInfo.flags = 0;
     bufferInfo.size = bufferSize;
-    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    bufferInfo.usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     bufferInfo.queueFamilyIndexCount = 0;
     bufferInfo.pQueueFamilyIndices = nullptr;
 
     vkCreateBuffer(device, &bufferInfo, nullptr, &lightingDataBuffer);
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, lightingDataBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    vkAllocateMemory(device, &allocInfo, nullptr, &lightingDataMemory);
-    vkBindBufferMemory(device, lightingDataBuffer, lightingDataMemory, 0);
+    allocate_buffer_memory(&lightingDataMemory, lightingDataBuffer, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     //Store info
     lightingDataInfo.buffer = lightingDataBuffer;
@@ -638,59 +765,39 @@ void Vulkan::update_lighting(glm::vec3 mainLightPos, glm::vec3 mainLightDir, glm
     lightingData.mainLightProjMat = glm::ortho(-SHADOW_AREA/2.0f, SHADOW_AREA/2.0f, SHADOW_AREA/2.0f, -SHADOW_AREA/2.0f, -1024.0f, 1024.0f);
     lightingData.mainLightDirection = -glm::vec4(mainLightDir, 0.0);
     lightingData.ambientColor = {0.25,0.25,0.5,0.0};
-
-    void* data;
-    vkMapMemory(device, lightingDataMemory, 0, sizeof(LightingData), 0, &data);
-        memcpy(data, &lightingData, sizeof(LightingData));
-    vkUnmapMemory(device, lightingDataMemory);
+    //copied to the buffer when the frame is recorded
 }
 void Vulkan::destroy_lighting_buffer()
 {
     vkDestroyBuffer(device, lightingDataBuffer, nullptr);
-    vkFreeMemory(device, lightingDataMemory, nullptr);
+    free_memory(&lightingDataMemory);
 }
 
 ///PER-INSTANCE DATA///
 void Vulkan::create_per_instance_buffer()
 {
-    u32 bufferSize = sizeof(glm::mat4) * 0x1000;
-    create_buffer(&perInstanceBuffer, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+    // Each frame in flight writes its own range, draws pick it with firstInstance so no descriptor offsets are needed
+    VkDeviceSize bufferSize = sizeof(AffineMatrix) * MAX_INSTANCE_COUNT * FRAMES_IN_FLIGHT;
+    create_buffer(&perInstanceBuffer, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, perInstanceBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    r32 multiplier = std::ceil((r32)memRequirements.alignment / minUniformBufferOffsetAlignment);
-    perInstanceDynamicOffset = multiplier * minUniformBufferOffsetAlignment;
+    allocate_buffer_memory(&perInstanceMemory, perInstanceBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-    vkAllocateMemory(device, &allocInfo, nullptr, &perInstanceMemory);
-    vkBindBufferMemory(device, perInstanceBuffer, perInstanceMemory, 0);
+    perInstanceMapping = (AffineMatrix*)get_memory_mapping(perInstanceMemory);
 
     // Store info
     perInstanceInfo.buffer = perInstanceBuffer;
     perInstanceInfo.offset = 0;
-    perInstanceInfo.range = 256 * 4;
+    perInstanceInfo.range = VK_WHOLE_SIZE;
 }
 void Vulkan::destroy_per_instance_buffer()
 {
     vkDestroyBuffer(device, perInstanceBuffer, nullptr);
-    vkFreeMemory(device, perInstanceMemory, nullptr);
+    free_memory(&perInstanceMemory);
 }
 
-void Vulkan::set_transform_data(glm::mat4x4 *matrices, u32 length)
+AffineMatrix *Vulkan::begin_transform_data()
 {
-    for (int i = 0; i < length; i++)
-    {
-        void* data;
-        vkMapMemory(device, perInstanceMemory, i * 256, sizeof(glm::mat4x4), 0, &data);
-        memcpy(data, &matrices[i], sizeof(glm::mat4x4));
-        vkUnmapMemory(device, perInstanceMemory);
-    }
+    return perInstanceMapping + MAX_INSTANCE_COUNT * currentFrame;
 }
 
 ///SHADER DATA///
@@ -752,7 +859,7 @@ void Vulkan::update_descriptor_set(VkDescriptorSet descriptorSet, DescriptorSetL
         descriptorWrite[bindingIndex].dstBinding = PER_INSTANCE_DATA_BINDING;
         descriptorWrite[bindingIndex].dstArrayElement = 0;
         descriptorWrite[bindingIndex].descriptorCount = 1;
-        descriptorWrite[bindingIndex].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+        descriptorWrite[bindingIndex].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
         descriptorWrite[bindingIndex].pBufferInfo = &perInstanceInfo;
         descriptorWrite[bindingIndex].pImageInfo = nullptr;
         descriptorWrite[bindingIndex].pTexelBufferView = nullptr;
@@ -899,12 +1006,12 @@ void Vulkan::update_descriptor_set(VkDescriptorSet descriptorSet, DescriptorSetL
 }
 void Vulkan::update_shader_data_block(u32 materialIndex, u32 shaderIndex, ShaderDataBlock dataBlock, u32 texCount, s32 *textures)
 {
+    // The buffer and descriptor set aren't per frame, so frames in flight can't be using them
+    wait_for_frames_in_flight();
+
     if (dataBlock.dataSize > 0 && dataBlock.data != nullptr)
     {
-        void* temp;
-        vkMapMemory(device, shaderDataMemory, materialIndex * MAX_SHADER_DATA_BLOCK_SIZE, dataBlock.dataSize, 0, &temp);
-        memcpy(temp, dataBlock.data, dataBlock.dataSize);
-        vkUnmapMemory(device, shaderDataMemory);
+        memcpy(get_memory_mapping(shaderDataMemory) + materialIndex * MAX_SHADER_DATA_BLOCK_SIZE, dataBlock.data, dataBlock.dataSize);
     }
 
     DescriptorSetLayoutInfo layoutInfo = descriptorSetLayoutInfos[shaderIndex];
@@ -912,6 +1019,7 @@ void Vulkan::update_shader_data_block(u32 materialIndex, u32 shaderIndex, Shader
 }
 void Vulkan::free_shader_data_block(u32 materialIndex, u32 shaderIndex)
 {
+    wait_for_frames_in_flight();
     vkFreeDescriptorSets(device, descriptorPools[shaderIndex], 1, &descriptorSets[materialIndex]);
 }
 void Vulkan::create_shader_data_buffer()
@@ -919,22 +1027,12 @@ void Vulkan::create_shader_data_buffer()
     u32 bufferSize = MAX_SHADER_DATA_BLOCK_SIZE * MAX_MATERIAL_COUNT;
     create_buffer(&shaderDataBuffer, bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
 
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, shaderDataBuffer, &memRequirements);
-
-    VkMemoryAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.allocationSize = memRequirements.size;
-    allocInfo.memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    vkAllocateMemory(device, &allocInfo, nullptr, &shaderDataMemory);
-    vkBindBufferMemory(device, shaderDataBuffer, shaderDataMemory, 0);
+    allocate_buffer_memory(&shaderDataMemory, shaderDataBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 }
 void Vulkan::destroy_shader_data_buffer()
 {
     vkDestroyBuffer(device, shaderDataBuffer, nullptr);
-    vkFreeMemory(device, shaderDataMemory, nullptr);
+    free_memory(&shaderDataMemory);
 }
 
 ///SWAPCHAIN///
@@ -1038,14 +1136,7 @@ void Vulkan::create_depth_texture()
 {
     create_image(&depthImage, SCREEN_WIDTH, SCREEN_HEIGHT, VK_FORMAT_D32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, TEXTURE_2D, 1, VK_SAMPLE_COUNT_1_BIT);
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, depthImage, &memRequirements);
-
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&depthImageMemory, memRequirements.size, memoryTypeIndex);
-
-    vkBindImageMemory(device, depthImage, depthImageMemory, 0);
+    allocate_image_memory(&depthImageMemory, depthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     create_image_view(&depthImageView, depthImage, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
 
@@ -1076,7 +1167,7 @@ void Vulkan::destroy_depth_texture()
     vkDestroySampler(device, depthSampler, nullptr);
     vkDestroyImageView(device, depthImageView, nullptr);
     vkDestroyImage(device, depthImage, nullptr);
-    vkFreeMemory(device, depthImageMemory, nullptr);
+    free_memory(&depthImageMemory);
 }
 
 ///SHADOW MAPPING///
@@ -1084,14 +1175,7 @@ void Vulkan::create_shadow_map()
 {
     create_image(&shadowImage, SHADOW_RESOLUTION, SHADOW_RESOLUTION, VK_FORMAT_D32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT);
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, shadowImage, &memRequirements);
-
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&shadowImageMemory, memRequirements.size, memoryTypeIndex);
-
-    vkBindImageMemory(device, shadowImage, shadowImageMemory, 0);
+    allocate_image_memory(&shadowImageMemory, shadowImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     create_image_view(&shadowImageView, shadowImage, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
 
@@ -1136,7 +1220,7 @@ void Vulkan::destroy_shadow_map()
     vkDestroySampler(device, shadowSampler, nullptr);
     vkDestroyImageView(device, shadowImageView, nullptr);
     vkDestroyImage(device, shadowImage, nullptr);
-    vkFreeMemory(device, shadowImageMemory, nullptr);
+    free_memory(&shadowImageMemory);
 }
 
 void Vulkan::create_shadow_pipeline()
@@ -1289,7 +1373,7 @@ void Vulkan::create_shadow_pipeline()
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &shadowPipeline);
+    create_graphics_pipeline(&pipelineInfo, &shadowPipeline);
 
     vkDestroyShaderModule(device, vertShader, nullptr);
 }
@@ -1303,17 +1387,9 @@ void Vulkan::destroy_shadow_pipeline()
 
 void Vulkan::create_placeholder_cubemap()
 {
-    // TODO: get rid of this horrible copypasta
     create_image(&noCubemapImage, 4, 4, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, TEXTURE_CUBEMAP, 1);
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, noCubemapImage, &memRequirements);
-
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&noCubemapImageMemory, memRequirements.size, memoryTypeIndex);
-
-    vkBindImageMemory(device, noCubemapImage, noCubemapImageMemory, 0);
+    allocate_image_memory(&noCubemapImageMemory, noCubemapImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     #define PLACEHOLDER_CUBEMAP_BYTES (4*4*4*6)
     VkDeviceSize imageBytes = PLACEHOLDER_CUBEMAP_BYTES;
@@ -1328,149 +1404,14 @@ void Vulkan::create_placeholder_cubemap()
         pixelData[4*i+3] = 255;
     }
     //copy pixels
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    create_buffer(&stagingBuffer, imageBytes, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-    VkMemoryRequirements stagingMemRequirements;
-    vkGetBufferMemoryRequirements(device, stagingBuffer, &stagingMemRequirements);
-    u32 stagingMemoryTypeIndex = get_device_memory_type_index(stagingMemRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
-
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageBytes, 0, &data);
-    memcpy(data, pixelData, imageBytes);
-    vkUnmapMemory(device, stagingBufferMemory);
+    StagingRange staging = reserve_staging(imageBytes);
+    memcpy(staging.data, pixelData, imageBytes);
 
-    //copy staging buffer to image
-    {
-        VkCommandBufferAllocateInfo allocInfo;
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer tempCmds;
-        vkAllocateCommandBuffers(device, &allocInfo, &tempCmds);
-
-        VkCommandBufferBeginInfo beginInfo;
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.pNext = nullptr;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        beginInfo.pInheritanceInfo = nullptr;
-
-        vkBeginCommandBuffer(tempCmds, &beginInfo);
-
-        //cmds
-        VkImageMemoryBarrier barrier;
-        barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        barrier.pNext = nullptr;
-        barrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        barrier.image = noCubemapImage;
-        barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        barrier.subresourceRange.baseMipLevel = 0;
-        barrier.subresourceRange.levelCount = 1;
-        barrier.subresourceRange.baseArrayLayer = 0;
-        barrier.subresourceRange.layerCount = 6;
-
-        vkCmdPipelineBarrier(tempCmds, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
-
-        VkBufferImageCopy region;
-        region.bufferOffset = 0;
-        region.bufferRowLength = 0;
-        region.bufferImageHeight = 0;
-        region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        region.imageSubresource.mipLevel = 0;
-        region.imageSubresource.baseArrayLayer = 0;
-        region.imageSubresource.layerCount = 6;
-        region.imageOffset = {0,0,0};
-        region.imageExtent = {4,4,1};
-
-        vkCmdCopyBufferToImage(tempCmds, stagingBuffer, noCubemapImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-        vkEndCommandBuffer(tempCmds);
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &tempCmds;
-
-        vkQueueSubmit(deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(deviceQueue);
-
-        vkFreeCommandBuffers(device, commandPool, 1, &tempCmds);
-    }
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    VkCommandBuffer cmds = get_upload_command_buffer();
+    copy_staging_buffer_to_texture(cmds, noCubemapImage, staging, 4, 4, 6, 1);
 
     //call this even if no mipmaps, because the texture needs to be converted to correct format
-    //generate mipmaps
-    {
-        VkCommandBufferAllocateInfo allocInfo;
-        allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        allocInfo.pNext = nullptr;
-        allocInfo.commandPool = commandPool;
-        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        allocInfo.commandBufferCount = 1;
-
-        VkCommandBuffer tempCmds;
-        vkAllocateCommandBuffers(device, &allocInfo, &tempCmds);
-
-        VkCommandBufferBeginInfo beginInfo;
-        beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-        beginInfo.pNext = nullptr;
-        beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-        beginInfo.pInheritanceInfo = nullptr;
-
-        vkBeginCommandBuffer(tempCmds, &beginInfo);
-
-        //generate mipmaps
-        VkImageMemoryBarrier mipBarrier;
-        mipBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-        mipBarrier.pNext = nullptr;
-        //mipBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        //mipBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        //mipBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-        //mipBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        mipBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        mipBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-        mipBarrier.image = noCubemapImage;
-        mipBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        //mipBarrier.subresourceRange.baseMipLevel = 0;
-        mipBarrier.subresourceRange.levelCount = 1;
-        mipBarrier.subresourceRange.baseArrayLayer = 0;
-        mipBarrier.subresourceRange.layerCount = 6;
-        mipBarrier.subresourceRange.baseMipLevel = 0;
-        mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-        mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-
-        vkCmdPipelineBarrier(tempCmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
-
-        vkEndCommandBuffer(tempCmds);
-
-        VkSubmitInfo submitInfo{};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &tempCmds;
-
-        vkQueueSubmit(deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        vkQueueWaitIdle(deviceQueue);
-
-        vkFreeCommandBuffers(device, commandPool, 1, &tempCmds);
-    }
+    generate_mipmaps(cmds, noCubemapImage, 4, 4, 6, 1);
 
     create_image_view(&noCubemapImageView, noCubemapImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT, TEXTURE_CUBEMAP, 1);
 
@@ -1504,7 +1445,7 @@ void Vulkan::destroy_placeholder_cubemap()
     vkDestroySampler(device, noCubemapSampler, nullptr);
     vkDestroyImageView(device, noCubemapImageView, nullptr);
     vkDestroyImage(device, noCubemapImage, nullptr);
-    vkFreeMemory(device, noCubemapImageMemory, nullptr);
+    free_memory(&noCubemapImageMemory);
 }
 
 void Vulkan::set_env_map(u32 textureIndex)
@@ -1518,27 +1459,14 @@ void Vulkan::create_multisampling_attachments()
     //color attachment
     create_image(&msImage, SCREEN_WIDTH, SCREEN_HEIGHT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT, TEXTURE_2D, 1, VK_SAMPLE_COUNT_8_BIT);
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, msImage, &memRequirements);
-
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&msImageMemory, memRequirements.size, memoryTypeIndex);
-
-    vkBindImageMemory(device, msImage, msImageMemory, 0);
+    allocate_image_memory(&msImageMemory, msImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     create_image_view(&msImageView, msImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
 
     //depth attachment
     create_image(&msDepthImage, SCREEN_WIDTH, SCREEN_HEIGHT, VK_FORMAT_D32_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, TEXTURE_2D, 1, VK_SAMPLE_COUNT_8_BIT);
 
-    vkGetImageMemoryRequirements(device, msDepthImage, &memRequirements);
-
-    memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&msDepthImageMemory, memRequirements.size, memoryTypeIndex);
-
-    vkBindImageMemory(device, msDepthImage, msDepthImageMemory, 0);
+    allocate_image_memory(&msDepthImageMemory, msDepthImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     create_image_view(&msDepthImageView, msDepthImage, VK_FORMAT_D32_SFLOAT, VK_IMAGE_ASPECT_DEPTH_BIT);
 }
@@ -1546,25 +1474,18 @@ void Vulkan::destroy_multisampling_attachments()
 {
     vkDestroyImageView(device, msImageView, nullptr);
     vkDestroyImage(device, msImage, nullptr);
-    vkFreeMemory(device, msImageMemory, nullptr);
+    free_memory(&msImageMemory);
 
     vkDestroyImageView(device, msDepthImageView, nullptr);
     vkDestroyImage(device, msDepthImage, nullptr);
-    vkFreeMemory(device, msDepthImageMemory, nullptr);
+    free_memory(&msDepthImageMemory);
 }
 
 void Vulkan::create_color_texture()
 {
     create_image(&colorImage, SCREEN_WIDTH, SCREEN_HEIGHT, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
 
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, colorImage, &memRequirements);
-
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&colorImageMemory, memRequirements.size, memoryTypeIndex);
-
-    vkBindImageMemory(device, colorImage, colorImageMemory, 0);
+    allocate_image_memory(&colorImageMemory, colorImage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     create_image_view(&colorImageView, colorImage, VK_FORMAT_R16G16B16A16_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT);
 
@@ -1595,7 +1516,7 @@ void Vulkan::destroy_color_texture()
     vkDestroySampler(device, colorSampler, nullptr);
     vkDestroyImageView(device, colorImageView, nullptr);
     vkDestroyImage(device, colorImage, nullptr);
-    vkFreeMemory(device, colorImageMemory, nullptr);
+    free_memory(&colorImageMemory);
 }
 
 ///POST PROCESSING///
@@ -1795,7 +1716,7 @@ void Vulkan::create_grading_pipeline()
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &colorGradingPipeline);
+    create_graphics_pipeline(&pipelineInfo, &colorGradingPipeline);
 
     vkDestroyShaderModule(device, vertShader, nullptr);
     vkDestroyShaderModule(device, fragShader, nullptr);
@@ -1808,161 +1729,511 @@ void Vulkan::destroy_grading_pipeline()
     destroy_descriptor_pool(&gradingDescriptorPool);
 }
 
-///RENDER PASSES///
-void Vulkan::create_shadow_render_pass()
+///OVERLAY///
+void Vulkan::create_overlay_buffers()
 {
-    DescriptorSetLayoutInfo info;
-    info.flags =(DescriptorSetLayoutFlags)(DSF_CAMERADATA | DSF_LIGHTINGDATA | DSF_INSTANCEDATA);
-    info.samplerCount = 0;
-    info.bindingCount = 3;
-    shadowPassDescriptorSetLayoutInfo = info;
-
-    create_descriptor_pool(&shadowPassDescriptorPool, info);
-    create_descriptor_set_layout(&shadowPassDescriptorSetLayout, info);
-
-    VkRenderPassCreateInfo createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-    createInfo.pNext = nullptr;
-    createInfo.attachmentCount = 1;
-
-    VkAttachmentDescription depthDescription{};
-    depthDescription.flags = 0;
-    depthDescription.format = VK_FORMAT_D32_SFLOAT;
-    depthDescription.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
-
-    createInfo.pAttachments = &depthDescription;
-    createInfo.subpassCount = 1;
-
-    VkAttachmentReference depthAttachmentReference;
-    depthAttachmentReference.attachment = 0;
-    depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
-
-    VkSubpassDescription subpassDescription{};
-    subpassDescription.inputAttachmentCount = 0; //I don't think texture sampling counts as input attachments here. We'll see
-    subpassDescription.pInputAttachments = nullptr;
-    subpassDescription.colorAttachmentCount = 0;
-    subpassDescription.pColorAttachments = nullptr;
-    subpassDescription.pResolveAttachments = nullptr;
-    subpassDescription.pDepthStencilAttachment = &depthAttachmentReference;
-    subpassDescription.preserveAttachmentCount = 0;
-    subpassDescription.pPreserveAttachments = nullptr;
+    //uniform data: camera data with an orthographic projection from pixels, and an identity model matrix as instance 0
+    VkDeviceSize alignment = MAX(minUniformBufferOffsetAlignment, minStorageBufferOffsetAlignment);
+    VkDeviceSize instanceDataOffset = (sizeof(GlobalMatrices) + alignment - 1) / alignment * alignment;
+
+    VkDeviceSize instanceDataSize = sizeof(AffineMatrix);
+    create_buffer(&overlayUniformBuffer, instanceDataOffset + instanceDataSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+    allocate_buffer_memory(&overlayUniformMemory, overlayUniformBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+    GlobalMatrices overlayMatrices;
+    overlayMatrices.view = glm::mat4(1.0f);
+    overlayMatrices.proj = glm::mat4(1.0f);
+    overlayMatrices.proj[0][0] = 2.0f / SCREEN_WIDTH;
+    overlayMatrices.proj[1][1] = 2.0f / SCREEN_HEIGHT;
+    overlayMatrices.proj[3][0] = -1.0f;
+    overlayMatrices.proj[3][1] = -1.0f;
+    overlayMatrices.camPos = glm::vec3(0.0f);
+    AffineMatrix model;
+    model.rows[0] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    model.rows[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+    model.rows[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+
+    u8 *data = get_memory_mapping(overlayUniformMemory);
+    memcpy(data, &overlayMatrices, sizeof(GlobalMatrices));
+    memcpy(data + instanceDataOffset, &model, sizeof(AffineMatrix));
+
+    overlayCameraDataInfo.buffer = overlayUniformBuffer;
+    overlayCameraDataInfo.offset = 0;
+    overlayCameraDataInfo.range = sizeof(GlobalMatrices);
+    overlayInstanceDataInfo.buffer = overlayUniformBuffer;
+    overlayInstanceDataInfo.offset = instanceDataOffset;
+    overlayInstanceDataInfo.range = instanceDataSize;
+}
+void Vulkan::create_overlay_pipeline()
+{
+    create_overlay_buffers();
+
+    //descriptors: same bindings as the ui shader expects
+    VkDescriptorSetLayoutBinding bindings[3]{};
+    bindings[0].binding = CAMERA_DATA_BINDING;
+    bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    bindings[0].descriptorCount = 1;
+    bindings[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[1].binding = PER_INSTANCE_DATA_BINDING;
+    bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    bindings[1].descriptorCount = 1;
+    bindings[1].stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+    bindings[2].binding = SAMPLER_BINDING0;
+    bindings[2].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    bindings[2].descriptorCount = 1;
+    bindings[2].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-    createInfo.pSubpasses = &subpassDescription;
-    createInfo.dependencyCount = 2;
+    VkDescriptorSetLayoutCreateInfo layoutInfo;
+    layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutInfo.pNext = nullptr;
+    layoutInfo.flags = 0;
+    layoutInfo.bindingCount = 3;
+    layoutInfo.pBindings = bindings;
 
-    VkSubpassDependency dependencies[2];
-    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[0].dstSubpass = 0;
-    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    vkCreateDescriptorSetLayout(device, &layoutInfo, nullptr, &overlayDescriptorSetLayout);
 
-    dependencies[1].srcSubpass = 0;
-    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
-    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+    VkDescriptorPoolSize poolSizes[3];
+    poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    poolSizes[0].descriptorCount = 1;
+    poolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    poolSizes[1].descriptorCount = 1;
+    poolSizes[2].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    poolSizes[2].descriptorCount = 1;
 
-    createInfo.pDependencies = dependencies;
+    VkDescriptorPoolCreateInfo poolInfo;
+    poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolInfo.pNext = nullptr;
+    poolInfo.flags = 0;
+    poolInfo.maxSets = 1;
+    poolInfo.poolSizeCount = 3;
+    poolInfo.pPoolSizes = poolSizes;
 
-    vkCreateRenderPass(device, &createInfo, nullptr, &shadowRenderPass);
+    vkCreateDescriptorPool(device, &poolInfo, nullptr, &overlayDescriptorPool);
 
-    //create descriptor set
     VkDescriptorSetAllocateInfo allocInfo;
     allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
     allocInfo.pNext = nullptr;
-    allocInfo.descriptorPool = shadowPassDescriptorPool;
+    allocInfo.descriptorPool = overlayDescriptorPool;
     allocInfo.descriptorSetCount = 1;
-    allocInfo.pSetLayouts = &shadowPassDescriptorSetLayout;
+    allocInfo.pSetLayouts = &overlayDescriptorSetLayout;
+
+    vkAllocateDescriptorSets(device, &allocInfo, &overlayDescriptorSet);
+
+    VkWriteDescriptorSet descriptorWrite[2];
+    descriptorWrite[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite[0].pNext = nullptr;
+    descriptorWrite[0].dstSet = overlayDescriptorSet;
+    descriptorWrite[0].dstBinding = CAMERA_DATA_BINDING;
+    descriptorWrite[0].dstArrayElement = 0;
+    descriptorWrite[0].descriptorCount = 1;
+    descriptorWrite[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptorWrite[0].pBufferInfo = &overlayCameraDataInfo;
+    descriptorWrite[0].pImageInfo = nullptr;
+    descriptorWrite[0].pTexelBufferView = nullptr;
+    descriptorWrite[1] = descriptorWrite[0];
+    descriptorWrite[1].dstBinding = PER_INSTANCE_DATA_BINDING;
+    descriptorWrite[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptorWrite[1].pBufferInfo = &overlayInstanceDataInfo;
+
+    vkUpdateDescriptorSets(device, 2, descriptorWrite, 0, nullptr);
 
-    vkAllocateDescriptorSets(device, &allocInfo, &shadowDescriptorSet);
-    update_shadow_descriptor_set();
-}
+    //create shader modules
+    VkShaderModule vertShader;
+    create_shader_module(&vertShader, "shaders/ui_vert.spv");
 
-void Vulkan::create_forward_render_pass()
-{
-    //the 2d render pass is used to draw 2d things like the background, tiles or sprites
-    //to a framebuffer that will later be used for post processing operations
-    //in other words, 2d things that are part of the game world.
-    VkRenderPassCreateInfo2 createInfo{};
-    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
-    createInfo.pNext = nullptr;
-    createInfo.attachmentCount = 4;
+    VkPipelineShaderStageCreateInfo vertShaderStageInfo;
+    vertShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vertShaderStageInfo.pNext = nullptr;
+    vertShaderStageInfo.flags = 0;
+    vertShaderStageInfo.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vertShaderStageInfo.module = vertShader;
+    vertShaderStageInfo.pName = "main";
+    vertShaderStageInfo.pSpecializationInfo = nullptr;
 
-    VkAttachmentDescription2 attachmentDescription{};
-    attachmentDescription.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-    attachmentDescription.pNext = nullptr;
-    attachmentDescription.flags = 0;
-    attachmentDescription.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    attachmentDescription.samples = VK_SAMPLE_COUNT_8_BIT;
-    attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; //temporary: clear before drawing. Change later to VK_ATTACHMENT_LOAD_OP_LOAD
-    attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    //attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    //attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; //this is also temporary for testing purposes
-    attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkShaderModule fragShader;
+    create_shader_module(&fragShader, "shaders/ui_frag.spv");
 
-    VkAttachmentDescription2 depthDescription{};
-    depthDescription.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-    depthDescription.pNext = nullptr;
-    depthDescription.flags = 0;
-    depthDescription.format = VK_FORMAT_D32_SFLOAT;
-    depthDescription.samples = VK_SAMPLE_COUNT_8_BIT;
-    depthDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthDescription.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+    VkPipelineShaderStageCreateInfo fragShaderStageInfo;
+    fragShaderStageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    fragShaderStageInfo.pNext = nullptr;
+    fragShaderStageInfo.flags = 0;
+    fragShaderStageInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    fragShaderStageInfo.module = fragShader;
+    fragShaderStageInfo.pName = "main";
+    fragShaderStageInfo.pSpecializationInfo = nullptr;
 
-    VkAttachmentDescription2 colorAttachmentResolve{};
-    colorAttachmentResolve.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-    colorAttachmentResolve.pNext = nullptr;
-    colorAttachmentResolve.flags = 0;
-    colorAttachmentResolve.format = VK_FORMAT_R16G16B16A16_SFLOAT;
-    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
 
-    VkAttachmentDescription2 depthAttachmentResolve{};
-    depthAttachmentResolve.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
-    depthAttachmentResolve.pNext = nullptr;
-    depthAttachmentResolve.flags = 0;
-    depthAttachmentResolve.format = VK_FORMAT_D32_SFLOAT;
-    depthAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
-    depthAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    depthAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-    depthAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-    depthAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    depthAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    //////////////////////////////////////////////////////
 
-    VkAttachmentDescription2 attachments[4] = {attachmentDescription, depthDescription, colorAttachmentResolve, depthAttachmentResolve};
+    //vertex input, interleaved in one binding
+    VkVertexInputBindingDescription vertDescription;
 
-    createInfo.pAttachments = attachments;
-    createInfo.subpassCount = 1;
+    vertDescription.binding = 0;
+    vertDescription.stride = sizeof(OverlayVertex);
+    vertDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-    VkAttachmentReference2 colorAttachmentReference;
-    colorAttachmentReference.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
-    colorAttachmentReference.pNext = nullptr;
-    colorAttachmentReference.attachment = 0;
-    colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    VkVertexInputAttributeDescription attributeDescriptions[3];
+
+    attributeDescriptions[0].binding = 0;
+    attributeDescriptions[0].location = 0;
+    attributeDescriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
+    attributeDescriptions[0].offset = offsetof(OverlayVertex, position);
+
+    attributeDescriptions[1].binding = 0;
+    attributeDescriptions[1].location = 1;
+    attributeDescriptions[1].format = VK_FORMAT_R32G32_SFLOAT;
+    attributeDescriptions[1].offset = offsetof(OverlayVertex, texcoord0);
+
+    attributeDescriptions[2].binding = 0;
+    attributeDescriptions[2].location = 4;
+    attributeDescriptions[2].format = VK_FORMAT_R32G32B32A32_SFLOAT;
+    attributeDescriptions[2].offset = offsetof(OverlayVertex, color);
+
+    VkPipelineVertexInputStateCreateInfo vertexInputInfo;
+    vertexInputInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    vertexInputInfo.pNext = nullptr;
+    vertexInputInfo.flags = 0;
+    vertexInputInfo.vertexBindingDescriptionCount = 1;
+    vertexInputInfo.pVertexBindingDescriptions = &vertDescription;
+    vertexInputInfo.vertexAttributeDescriptionCount = 3;
+    vertexInputInfo.pVertexAttributeDescriptions = attributeDescriptions;
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssembly;
+    inputAssembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssembly.pNext = nullptr;
+    inputAssembly.flags = 0;
+    inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssembly.primitiveRestartEnable = VK_FALSE;
+
+    ////////////////////////////////////////////////////////
+
+    VkViewport viewport;
+    viewport.x = 0.0f;
+    viewport.y = 0.0f;
+    viewport.width = (float)SCREEN_WIDTH;
+    viewport.height = (float)SCREEN_HEIGHT;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+
+    VkRect2D scissor;
+    scissor.offset = {(s32)viewport.x, (s32)viewport.y};
+    scissor.extent = {(u32)viewport.width, (u32)viewport.height};
+
+    VkPipelineViewportStateCreateInfo viewportState;
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.pNext = nullptr;
+    viewportState.flags = 0;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = &viewport;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = &scissor;
+
+    ////////////////////////////////////////////////////////
+
+    VkPipelineRasterizationStateCreateInfo rasterizer;
+    rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizer.pNext = nullptr;
+    rasterizer.flags = 0;
+    rasterizer.depthClampEnable = VK_FALSE;
+    rasterizer.rasterizerDiscardEnable = VK_FALSE;
+    rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizer.cullMode = VK_CULL_MODE_NONE;
+    rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+    rasterizer.depthBiasEnable = VK_FALSE;
+    rasterizer.depthBiasConstantFactor = 0.0f; // Optional
+    rasterizer.depthBiasClamp = 0.0f; // Optional
+    rasterizer.depthBiasSlopeFactor = 0.0f; // Optional
+    rasterizer.lineWidth = 1.0f;
+
+    ////////////////////////////////////////////////////////
+
+    VkPipelineMultisampleStateCreateInfo multisampling;
+    multisampling.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampling.pNext = nullptr;
+    multisampling.flags = 0;
+    multisampling.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampling.sampleShadingEnable = VK_FALSE;
+    multisampling.minSampleShading = 1.0f; // Optional
+    multisampling.pSampleMask = nullptr; // Optional
+    multisampling.alphaToCoverageEnable = VK_FALSE; // Optional
+    multisampling.alphaToOneEnable = VK_FALSE; // Optional
+
+    ////////////////////////////////////////////////////////
+
+    //ui shader outputs premultiplied alpha
+    VkPipelineColorBlendAttachmentState colorBlendAttachment;
+    colorBlendAttachment.blendEnable = VK_TRUE;
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+    VkPipelineColorBlendStateCreateInfo colorBlending;
+    colorBlending.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlending.pNext = nullptr;
+    colorBlending.flags = 0;
+    colorBlending.logicOpEnable = VK_FALSE;
+    colorBlending.logicOp = VK_LOGIC_OP_COPY; // Optional
+    colorBlending.attachmentCount = 1;
+    colorBlending.pAttachments = &colorBlendAttachment;
+    colorBlending.blendConstants[0] = 0.0f; // Optional
+    colorBlending.blendConstants[1] = 0.0f; // Optional
+    colorBlending.blendConstants[2] = 0.0f; // Optional
+    colorBlending.blendConstants[3] = 0.0f; // Optional
+
+    ////////////////////////////////////////////////////////
+
+    VkPipelineLayoutCreateInfo pipelineLayoutInfo;
+    pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineLayoutInfo.pNext = nullptr;
+    pipelineLayoutInfo.flags = 0;
+    pipelineLayoutInfo.setLayoutCount = 1;
+    pipelineLayoutInfo.pSetLayouts = &overlayDescriptorSetLayout;
+    pipelineLayoutInfo.pushConstantRangeCount = 0; // Optional
+    pipelineLayoutInfo.pPushConstantRanges = nullptr; // Optional
+
+    vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &overlayPipelineLayout);
+
+    ////////////////////////////////////////////////////////
+
+    //drawn in the post processing pass, after the full screen quad
+    VkGraphicsPipelineCreateInfo pipelineInfo;
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    pipelineInfo.pNext = nullptr;
+    pipelineInfo.flags = 0;
+    pipelineInfo.stageCount = 2;
+    pipelineInfo.pStages = shaderStages;
+    pipelineInfo.pVertexInputState = &vertexInputInfo;
+    pipelineInfo.pInputAssemblyState = &inputAssembly;
+    pipelineInfo.pViewportState = &viewportState;
+    pipelineInfo.pRasterizationState = &rasterizer;
+    pipelineInfo.pMultisampleState = &multisampling;
+    pipelineInfo.pDepthStencilState = nullptr;
+    pipelineInfo.pColorBlendState = &colorBlending;
+    pipelineInfo.pDynamicState = nullptr; // Optional
+    pipelineInfo.layout = overlayPipelineLayout;
+    pipelineInfo.renderPass = gradingRenderPass;
+    pipelineInfo.subpass = 0;
+    pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
+    pipelineInfo.basePipelineIndex = -1; // Optional
+
+    create_graphics_pipeline(&pipelineInfo, &overlayPipeline);
+
+    vkDestroyShaderModule(device, vertShader, nullptr);
+    vkDestroyShaderModule(device, fragShader, nullptr);
+}
+void Vulkan::destroy_overlay_pipeline()
+{
+    vkDestroyPipeline(device, overlayPipeline, nullptr);
+    vkDestroyPipelineLayout(device, overlayPipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, overlayDescriptorSetLayout, nullptr);
+    vkDestroyDescriptorPool(device, overlayDescriptorPool, nullptr);
+
+    vkDestroyBuffer(device, overlayUniformBuffer, nullptr);
+    free_memory(&overlayUniformMemory);
+}
+void Vulkan::set_overlay_texture(u32 textureIndex)
+{
+    VkDescriptorImageInfo textureInfo;
+    textureInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    textureInfo.imageView = textureImageViews[textureIndex];
+    textureInfo.sampler = textureSamplers[textureIndex];
+
+    VkWriteDescriptorSet descriptorWrite;
+    descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptorWrite.pNext = nullptr;
+    descriptorWrite.dstSet = overlayDescriptorSet;
+    descriptorWrite.dstBinding = SAMPLER_BINDING0;
+    descriptorWrite.dstArrayElement = 0;
+    descriptorWrite.descriptorCount = 1;
+    descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    descriptorWrite.pBufferInfo = nullptr;
+    descriptorWrite.pImageInfo = &textureInfo;
+    descriptorWrite.pTexelBufferView = nullptr;
+
+    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
+    overlayTextureSet = true;
+}
+bool Vulkan::begin_overlay()
+{
+    if (!overlayTextureSet)
+        return false;
+
+    vkCmdBindPipeline(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overlayPipeline);
+    vkCmdBindDescriptorSets(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, overlayPipelineLayout, 0, 1, &overlayDescriptorSet, 0, nullptr);
+    return true;
+}
+void Vulkan::draw_dynamic_mesh(u32 meshIndex, u32 indexCount)
+{
+    if (indexCount == 0)
+        return;
+
+    VkDeviceSize copyOffset = dynamicMeshCopySizes[meshIndex] * currentFrame;
+    vkCmdBindVertexBuffers(renderCommandBuffer, 0, 1, &dynamicMeshBuffers[meshIndex], &copyOffset);
+    vkCmdBindIndexBuffer(renderCommandBuffer, dynamicMeshBuffers[meshIndex], copyOffset + dynamicMeshIndexOffsets[meshIndex], VK_INDEX_TYPE_UINT16);
+
+    vkCmdDrawIndexed(renderCommandBuffer, indexCount, 1, 0, 0, 0);
+}
+
+///RENDER PASSES///
+void Vulkan::create_shadow_render_pass()
+{
+    DescriptorSetLayoutInfo info;
+    info.flags =(DescriptorSetLayoutFlags)(DSF_CAMERADATA | DSF_LIGHTINGDATA | DSF_INSTANCEDATA);
+    info.samplerCount = 0;
+    info.bindingCount = 3;
+    shadowPassDescriptorSetLayoutInfo = info;
+
+    create_descriptor_pool(&shadowPassDescriptorPool, info);
+    create_descriptor_set_layout(&shadowPassDescriptorSetLayout, info);
+
+    VkRenderPassCreateInfo createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+    createInfo.pNext = nullptr;
+    createInfo.attachmentCount = 1;
+
+    VkAttachmentDescription depthDescription{};
+    depthDescription.flags = 0;
+    depthDescription.format = VK_FORMAT_D32_SFLOAT;
+    depthDescription.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthDescription.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_READ_ONLY_OPTIMAL;
+
+    createInfo.pAttachments = &depthDescription;
+    createInfo.subpassCount = 1;
+
+    VkAttachmentReference depthAttachmentReference;
+    depthAttachmentReference.attachment = 0;
+    depthAttachmentReference.layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkSubpassDescription subpassDescription{};
+    subpassDescription.inputAttachmentCount = 0; //I don't think texture sampling counts as input attachments here. We'll see
+    subpassDescription.pInputAttachments = nullptr;
+    subpassDescription.colorAttachmentCount = 0;
+    subpassDescription.pColorAttachments = nullptr;
+    subpassDescription.pResolveAttachments = nullptr;
+    subpassDescription.pDepthStencilAttachment = &depthAttachmentReference;
+    subpassDescription.preserveAttachmentCount = 0;
+    subpassDescription.pPreserveAttachments = nullptr;
+
+    createInfo.pSubpasses = &subpassDescription;
+    createInfo.dependencyCount = 2;
+
+    VkSubpassDependency dependencies[2];
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
+
+    createInfo.pDependencies = dependencies;
+
+    vkCreateRenderPass(device, &createInfo, nullptr, &shadowRenderPass);
+
+    //create descriptor set
+    VkDescriptorSetAllocateInfo allocInfo;
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.pNext = nullptr;
+    allocInfo.descriptorPool = shadowPassDescriptorPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &shadowPassDescriptorSetLayout;
+
+    vkAllocateDescriptorSets(device, &allocInfo, &shadowDescriptorSet);
+    update_shadow_descriptor_set();
+}
+
+void Vulkan::create_forward_render_pass()
+{
+    //the 2d render pass is used to draw 2d things like the background, tiles or sprites
+    //to a framebuffer that will later be used for post processing operations
+    //in other words, 2d things that are part of the game world.
+    VkRenderPassCreateInfo2 createInfo{};
+    createInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO_2;
+    createInfo.pNext = nullptr;
+    createInfo.attachmentCount = 4;
+
+    VkAttachmentDescription2 attachmentDescription{};
+    attachmentDescription.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+    attachmentDescription.pNext = nullptr;
+    attachmentDescription.flags = 0;
+    attachmentDescription.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    attachmentDescription.samples = VK_SAMPLE_COUNT_8_BIT;
+    attachmentDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR; //temporary: clear before drawing. Change later to VK_ATTACHMENT_LOAD_OP_LOAD
+    attachmentDescription.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    attachmentDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    attachmentDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    //attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    //attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    attachmentDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; //this is also temporary for testing purposes
+    attachmentDescription.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentDescription2 depthDescription{};
+    depthDescription.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+    depthDescription.pNext = nullptr;
+    depthDescription.flags = 0;
+    depthDescription.format = VK_FORMAT_D32_SFLOAT;
+    depthDescription.samples = VK_SAMPLE_COUNT_8_BIT;
+    depthDescription.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depthDescription.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthDescription.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthDescription.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthDescription.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthDescription.finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+    VkAttachmentDescription2 colorAttachmentResolve{};
+    colorAttachmentResolve.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+    colorAttachmentResolve.pNext = nullptr;
+    colorAttachmentResolve.flags = 0;
+    colorAttachmentResolve.format = VK_FORMAT_R16G16B16A16_SFLOAT;
+    colorAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+    colorAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    colorAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    colorAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    colorAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    colorAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkAttachmentDescription2 depthAttachmentResolve{};
+    depthAttachmentResolve.sType = VK_STRUCTURE_TYPE_ATTACHMENT_DESCRIPTION_2;
+    depthAttachmentResolve.pNext = nullptr;
+    depthAttachmentResolve.flags = 0;
+    depthAttachmentResolve.format = VK_FORMAT_D32_SFLOAT;
+    depthAttachmentResolve.samples = VK_SAMPLE_COUNT_1_BIT;
+    depthAttachmentResolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachmentResolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    depthAttachmentResolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+    depthAttachmentResolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depthAttachmentResolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    depthAttachmentResolve.finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkAttachmentDescription2 attachments[4] = {attachmentDescription, depthDescription, colorAttachmentResolve, depthAttachmentResolve};
+
+    createInfo.pAttachments = attachments;
+    createInfo.subpassCount = 1;
+
+    VkAttachmentReference2 colorAttachmentReference;
+    colorAttachmentReference.sType = VK_STRUCTURE_TYPE_ATTACHMENT_REFERENCE_2;
+    colorAttachmentReference.pNext = nullptr;
+    colorAttachmentReference.attachment = 0;
+    colorAttachmentReference.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
     colorAttachmentReference.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
 
     VkAttachmentReference2 depthAttachmentReference;
@@ -2009,8 +2280,35 @@ void Vulkan::create_forward_render_pass()
     subpassDescription.pPreserveAttachments = nullptr;
 
     createInfo.pSubpasses = &subpassDescription;
-    createInfo.dependencyCount = 0;
-    createInfo.pDependencies = nullptr;
+    createInfo.dependencyCount = 2;
+
+    // Frames overlap and share these attachments. The last frame's grading pass has to be done reading the resolved
+    // color and depth, and its own attachment writes done, before this frame writes them again
+    VkSubpassDependency2 dependencies[2];
+    dependencies[0].sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+    dependencies[0].pNext = nullptr;
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dependencyFlags = 0;
+    dependencies[0].viewOffset = 0;
+
+    // The resolves have to land before the grading pass samples them
+    dependencies[1].sType = VK_STRUCTURE_TYPE_SUBPASS_DEPENDENCY_2;
+    dependencies[1].pNext = nullptr;
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[1].dependencyFlags = 0;
+    dependencies[1].viewOffset = 0;
+
+    createInfo.pDependencies = dependencies;
     createInfo.correlatedViewMaskCount = 0;
     createInfo.pCorrelatedViewMasks = nullptr;
 
@@ -2061,8 +2359,27 @@ void Vulkan::create_grading_render_pass()
     subpassDescription.pPreserveAttachments = nullptr;
 
     createInfo.pSubpasses = &subpassDescription;
-    createInfo.dependencyCount = 0;
-    createInfo.pDependencies = nullptr;
+    createInfo.dependencyCount = 2;
+
+    // Reads what the forward pass resolved, which the next frame's forward pass can only overwrite after this is done
+    VkSubpassDependency dependencies[2];
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[0].dependencyFlags = 0;
+
+    dependencies[1].srcSubpass = 0;
+    dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dependencyFlags = 0;
+
+    createInfo.pDependencies = dependencies;
 
     vkCreateRenderPass(device, &createInfo, nullptr, &gradingRenderPass);
 
@@ -2075,7 +2392,7 @@ void Vulkan::create_grading_render_pass()
     allocInfo.pSetLayouts = &gradingDescriptorSetLayout;
 
     vkAllocateDescriptorSets(device, &allocInfo, &gradingDescriptorSet);
-    //update_post_process_descriptor_set();
+    //updated in init, once the color texture exists
 }
 void Vulkan::create_render_passes()
 {
@@ -2090,6 +2407,110 @@ void Vulkan::destroy_render_passes()
     vkDestroyRenderPass(device, gradingRenderPass, nullptr);
 }
 
+///PIPELINE CACHE///
+void Vulkan::load_pipeline_cache()
+{
+    pipelineStats = {};
+
+    const VkPhysicalDeviceProperties &properties = physicalDeviceInfo.properties;
+    std::vector<char> data;
+
+    std::ifstream file(PIPELINE_CACHE_FNAME, std::ios::binary | std::ios::ate);
+    if (file.is_open())
+    {
+        u64 fileSize = (u64)file.tellg();
+        file.seekg(0, std::ios::beg);
+
+        PipelineCacheFileHeader header;
+        file.read((char*)&header, sizeof(header));
+
+        if (!file || header.magic != PIPELINE_CACHE_MAGIC)
+            std::cout << "Pipeline cache file is broken, starting cold\n";
+        else if (header.dataSize != fileSize - sizeof(header))
+            std::cout << "Pipeline cache size doesn't match the file, starting cold\n";
+        else if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID ||
+                 header.driverVersion != properties.driverVersion ||
+                 memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+            std::cout << "Pipeline cache is from another device or driver, starting cold\n";
+        else
+        {
+            data.resize(header.dataSize);
+            file.read(data.data(), header.dataSize);
+            if (!file)
+            {
+                std::cout << "Couldn't read the pipeline cache, starting cold\n";
+                data.clear();
+            }
+        }
+        file.close();
+    }
+
+    VkPipelineCacheCreateInfo cacheInfo;
+    cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheInfo.pNext = nullptr;
+    cacheInfo.flags = 0;
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+    if (vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache) != VK_SUCCESS)
+    {
+        // The driver can still reject the data, an empty cache is better than none
+        cacheInfo.initialDataSize = 0;
+        cacheInfo.pInitialData = nullptr;
+        data.clear();
+        vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+    }
+
+    pipelineStats.warmCache = !data.empty();
+    pipelineStats.loadedCacheBytes = data.size();
+}
+void Vulkan::save_pipeline_cache()
+{
+    size_t dataSize = 0;
+    vkGetPipelineCacheData(device, pipelineCache, &dataSize, nullptr);
+
+    std::vector<char> data(dataSize);
+    if (dataSize > 0 && vkGetPipelineCacheData(device, pipelineCache, &dataSize, data.data()) == VK_SUCCESS)
+    {
+        const VkPhysicalDeviceProperties &properties = physicalDeviceInfo.properties;
+
+        PipelineCacheFileHeader header;
+        header.magic = PIPELINE_CACHE_MAGIC;
+        header.vendorID = properties.vendorID;
+        header.deviceID = properties.deviceID;
+        header.driverVersion = properties.driverVersion;
+        memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE);
+        header.dataSize = dataSize;
+
+        std::ofstream file(PIPELINE_CACHE_FNAME, std::ios::binary | std::ios::trunc);
+        file.write((const char*)&header, sizeof(header));
+        file.write(data.data(), dataSize);
+        if (!file)
+            std::cout << "Couldn't write the pipeline cache!\n";
+        file.close();
+    }
+
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
+    pipelineCache = VK_NULL_HANDLE;
+}
+
+void Vulkan::create_graphics_pipeline(const VkGraphicsPipelineCreateInfo *pipelineInfo, VkPipeline *pPipeline)
+{
+    r64 start = Time::current_time_in_ms();
+    vkCreateGraphicsPipelines(device, pipelineCache, 1, pipelineInfo, nullptr, pPipeline);
+
+    if (shaderBatchRunning)
+        return;
+
+    pipelineStats.creationMs += Time::current_time_in_ms() - start;
+    pipelineStats.pipelineCount++;
+}
+
+PipelineStats Vulkan::get_pipeline_stats()
+{
+    return pipelineStats;
+}
+
 ///SHADER MODULES///
 void Vulkan::create_shader_module(VkShaderModule *module, const char* fname)
 {
@@ -2335,7 +2756,7 @@ void Vulkan::create_render_pipeline(u32 index, const char *vert, const char *fra
     pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
     pipelineInfo.basePipelineIndex = -1; // Optional
 
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipelines[index]);
+    create_graphics_pipeline(&pipelineInfo, &pipelines[index]);
 
     vkDestroyShaderModule(device, vertShader, nullptr);
     vkDestroyShaderModule(device, fragShader, nullptr);
@@ -2354,38 +2775,136 @@ void Vulkan::create_shader(u32 shaderIndex, Shader *shader, const char *vert, co
     create_descriptor_pool(pool, info);
     VkDescriptorSetLayout *layout = &descriptorSetLayouts[shaderIndex];
     create_descriptor_set_layout(layout, info);
+
+    if (shaderBatchOpen)
+    {
+        PendingPipeline &pending = pendingPipelines[pendingPipelineCount++];
+        pending.shaderIndex = shaderIndex;
+        strncpy(pending.vert, vert, MAX_SHADER_PATH - 1);
+        pending.vert[MAX_SHADER_PATH - 1] = 0;
+        strncpy(pending.frag, frag, MAX_SHADER_PATH - 1);
+        pending.frag[MAX_SHADER_PATH - 1] = 0;
+        return;
+    }
+
     create_render_pipeline(shaderIndex, vert, frag);
 }
 void Vulkan::destroy_shader(u32 shaderIndex)
 {
+    wait_for_shader_batch();
+    wait_for_frames_in_flight();
     vkDestroyPipelineLayout(device, pipelineLayouts[shaderIndex], nullptr);
     vkDestroyPipeline(device, pipelines[shaderIndex], nullptr);
     destroy_descriptor_set_layout(&descriptorSetLayouts[shaderIndex]);
     destroy_descriptor_pool(&descriptorPools[shaderIndex]);
 }
 
+void Vulkan::begin_shader_batch()
+{
+    wait_for_shader_batch();
+    shaderBatchOpen = true;
+}
+void Vulkan::end_shader_batch()
+{
+    shaderBatchOpen = false;
+    if (pendingPipelineCount == 0)
+        return;
+
+    // Every pipeline only touches its own shader index, so they can be built in any order
+    shaderBatchRunning = true;
+    shaderBatchStart = Time::current_time_in_ms();
+    Jobs::parallel_for(&build_pending_pipelines, nullptr, pendingPipelineCount, 1, &shaderBatchCounter);
+}
+void Vulkan::wait_for_shader_batch()
+{
+    if (!shaderBatchRunning)
+        return;
+
+    Jobs::wait(&shaderBatchCounter);
+    shaderBatchRunning = false;
+
+    // Wall time of the whole batch, from the start to the last pipeline done
+    r64 batchEnd = shaderBatchStart;
+    for (u32 i = 0; i < pendingPipelineCount; i++)
+    {
+        batchEnd = MAX(batchEnd, pendingPipelines[i].finishTime);
+    }
+    pipelineStats.creationMs += batchEnd - shaderBatchStart;
+    pipelineStats.pipelineCount += pendingPipelineCount;
+
+    pendingPipelineCount = 0;
+}
+void Vulkan::build_pending_pipelines(void *data, u32 first, u32 count)
+{
+    for (u32 i = first; i < first + count; i++)
+    {
+        PendingPipeline &pending = pendingPipelines[i];
+        create_render_pipeline(pending.shaderIndex, pending.vert, pending.frag);
+        pending.finishTime = Time::current_time_in_ms();
+    }
+}
+
 ///COMMAND BUFFERS///
 void Vulkan::create_command_pool()
 {
+    // A pool per frame in flight, reset as a whole instead of freeing command buffers
     VkCommandPoolCreateInfo poolInfo;
     poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
     poolInfo.pNext = nullptr;
-    poolInfo.flags = 0;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
     poolInfo.queueFamilyIndex = 0;
 
-    vkCreateCommandPool(device, &poolInfo, nullptr, &commandPool);
-}
-
-void Vulkan::begin_rendering()
-{
     VkCommandBufferAllocateInfo allocInfo;
     allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     allocInfo.pNext = nullptr;
-    allocInfo.commandPool = commandPool;
     allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
     allocInfo.commandBufferCount = 1;
 
-    vkAllocateCommandBuffers(device, &allocInfo, &renderCommandBuffer);
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkCreateCommandPool(device, &poolInfo, nullptr, &frameCommandPools[i]);
+
+        allocInfo.commandPool = frameCommandPools[i];
+        allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        allocInfo.commandBufferCount = 1;
+        vkAllocateCommandBuffers(device, &allocInfo, &frameCommandBuffers[i]);
+
+        for (u32 slice = 0; slice < MAX_RECORDING_SLICES; slice++)
+        {
+            vkCreateCommandPool(device, &poolInfo, nullptr, &recordingCommandPools[i][slice]);
+
+            allocInfo.commandPool = recordingCommandPools[i][slice];
+            allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+            allocInfo.commandBufferCount = RECORDING_PASS_COUNT;
+            vkAllocateCommandBuffers(device, &allocInfo, recordingCommandBuffers[i][slice]);
+        }
+    }
+}
+
+void Vulkan::destroy_command_pool()
+{
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkDestroyCommandPool(device, frameCommandPools[i], nullptr);
+        for (u32 slice = 0; slice < MAX_RECORDING_SLICES; slice++)
+        {
+            vkDestroyCommandPool(device, recordingCommandPools[i][slice], nullptr);
+        }
+    }
+}
+
+void Vulkan::begin_rendering()
+{
+    // The fence of this frame was waited on at the end of the previous one
+    vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &currentSwapchainImageIndex);
+
+    vkResetCommandPool(device, frameCommandPools[currentFrame], 0);
+    for (u32 slice = 0; slice < MAX_RECORDING_SLICES; slice++)
+    {
+        vkResetCommandPool(device, recordingCommandPools[currentFrame][slice], 0);
+    }
+    primaryCommandBuffer = frameCommandBuffers[currentFrame];
+    renderCommandBuffer = primaryCommandBuffer;
 
     VkCommandBufferBeginInfo beginInfo;
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -2394,6 +2913,26 @@ void Vulkan::begin_rendering()
     beginInfo.pInheritanceInfo = nullptr;
 
     vkBeginCommandBuffer(renderCommandBuffer, &beginInfo);
+
+    update_uniform_buffers();
+}
+
+void Vulkan::update_uniform_buffers()
+{
+    // Camera and lighting buffers are shared by all frames, so they're updated in queue order. Wait for
+    // shaders of the previous frame to finish reading before overwriting, and make the writes visible after
+    VkPipelineStageFlags shaderStages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+    vkCmdPipelineBarrier(renderCommandBuffer, shaderStages, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 0, nullptr);
+
+    vkCmdUpdateBuffer(renderCommandBuffer, cameraDataBuffer, 0, sizeof(GlobalMatrices), &globalMatrices);
+    vkCmdUpdateBuffer(renderCommandBuffer, lightingDataBuffer, 0, sizeof(LightingData), &lightingData);
+
+    VkMemoryBarrier barrier;
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_UNIFORM_READ_BIT;
+    vkCmdPipelineBarrier(renderCommandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, shaderStages, 0, 1, &barrier, 0, nullptr, 0, nullptr);
 }
 
 void Vulkan::begin_shadow_pass()
@@ -2410,16 +2949,7 @@ void Vulkan::begin_shadow_pass()
     renderPassInfo.clearValueCount = 1;
     renderPassInfo.pClearValues = &clearColor;
 
-    vkCmdBeginRenderPass(renderCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
-
-    vkCmdBindPipeline(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
-
-}
-
-void Vulkan::set_shadow_instance_data(u32 callIndex)
-{
-    u32 dynamicOffset = perInstanceDynamicOffset * callIndex;
-    vkCmdBindDescriptorSets(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipelineLayout, 0, 1, &shadowDescriptorSet, 1, &dynamicOffset);
+    vkCmdBeginRenderPass(renderCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 }
 void Vulkan::begin_forward_render_pass()
 {
@@ -2436,45 +2966,102 @@ void Vulkan::begin_forward_render_pass()
     renderPassInfo.pClearValues = clearColors;
 
     //begin render pass! yeyeyey
-    vkCmdBeginRenderPass(renderCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(renderCommandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
 }
 void Vulkan::end_render_pass()
 {
     vkCmdEndRenderPass(renderCommandBuffer);
 }
 
+void Vulkan::begin_recording(RecordingPass pass, u32 slice)
+{
+    VkCommandBufferInheritanceInfo inheritanceInfo;
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.pNext = nullptr;
+    inheritanceInfo.renderPass = pass == RECORDING_PASS_SHADOW ? shadowRenderPass : forwardRenderPass;
+    inheritanceInfo.subpass = 0;
+    inheritanceInfo.framebuffer = pass == RECORDING_PASS_SHADOW ? shadowFramebuffer : postProcessFramebuffer;
+    inheritanceInfo.occlusionQueryEnable = VK_FALSE;
+    inheritanceInfo.queryFlags = 0;
+    inheritanceInfo.pipelineStatistics = 0;
+
+    VkCommandBufferBeginInfo beginInfo;
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    renderCommandBuffer = recordingCommandBuffers[currentFrame][slice][pass];
+    vkBeginCommandBuffer(renderCommandBuffer, &beginInfo);
+
+    // Secondary command buffers don't inherit bound state
+    if (pass == RECORDING_PASS_SHADOW)
+    {
+        vkCmdBindPipeline(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipeline);
+        vkCmdBindDescriptorSets(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shadowPipelineLayout, 0, 1, &shadowDescriptorSet, 0, nullptr);
+    }
+}
+void Vulkan::end_recording()
+{
+    vkEndCommandBuffer(renderCommandBuffer);
+    renderCommandBuffer = primaryCommandBuffer;
+}
+void Vulkan::execute_recordings(RecordingPass pass, u32 sliceCount)
+{
+    if (sliceCount == 0)
+        return;
+
+    VkCommandBuffer commandBuffers[MAX_RECORDING_SLICES];
+    for (u32 slice = 0; slice < sliceCount; slice++)
+    {
+        commandBuffers[slice] = recordingCommandBuffers[currentFrame][slice][pass];
+    }
+
+    vkCmdExecuteCommands(primaryCommandBuffer, sliceCount, commandBuffers);
+}
+
 void Vulkan::bind_shader(u32 shaderIndex)
 {
     vkCmdBindPipeline(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[shaderIndex]);
 }
-void Vulkan::bind_shader_data_block(u32 shaderIndex, u32 materialIndex, u32 callIndex)
+void Vulkan::bind_shader_data_block(u32 shaderIndex, u32 materialIndex)
 {
-    u32 dynamicOffset = perInstanceDynamicOffset * callIndex;
-
-    vkCmdBindDescriptorSets(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[shaderIndex], 0, 1, &descriptorSets[materialIndex], 1, &dynamicOffset);
+    vkCmdBindDescriptorSets(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayouts[shaderIndex], 0, 1, &descriptorSets[materialIndex], 0, nullptr);
 }
 
 void Vulkan::bind_vertex_buffer(u32 meshIndex, VertexAttribFlags attribs)
 {
-    VkDeviceSize offset = 0;
+    const VkBuffer *buffers = staticGeometryBuffers;
+    VkDeviceSize offsets[MESH_STREAM_COUNT] = {};
+
+    // Binding i reads vertex stream i, so runs of consecutive streams go in one call. All of them or just positions are one run
+    const u32 streamAttribs[MESH_STREAM_INDEX] = {VERTEX_POSITION_BIT, VERTEX_TEXCOORD_0_BIT, VERTEX_NORMAL_BIT, VERTEX_TANGENT_BIT, VERTEX_COLOR_BIT};
+
+    u32 firstBinding = 0;
+    while (firstBinding < MESH_STREAM_INDEX)
+    {
+        if (!(attribs & streamAttribs[firstBinding]))
+        {
+            firstBinding++;
+            continue;
+        }
 
-    if (attribs & VERTEX_POSITION_BIT)
-        vkCmdBindVertexBuffers(renderCommandBuffer, 0, 1, &vertexPositionBuffers[meshIndex], &offset);
-    if (attribs & VERTEX_TEXCOORD_0_BIT)
-        vkCmdBindVertexBuffers(renderCommandBuffer, 1, 1, &vertexTexcoord0Buffers[meshIndex], &offset);
-    if (attribs & VERTEX_NORMAL_BIT)
-        vkCmdBindVertexBuffers(renderCommandBuffer, 2, 1, &vertexNormalBuffers[meshIndex], &offset);
-    if (attribs & VERTEX_TANGENT_BIT)
-        vkCmdBindVertexBuffers(renderCommandBuffer, 3, 1, &vertexTangentBuffers[meshIndex], &offset);
-    if (attribs & VERTEX_COLOR_BIT)
-        vkCmdBindVertexBuffers(renderCommandBuffer, 4, 1, &vertexColorBuffers[meshIndex], &offset);
+        u32 endBinding = firstBinding + 1;
+        while (endBinding < MESH_STREAM_INDEX && (attribs & streamAttribs[endBinding]))
+            endBinding++;
+
+        vkCmdBindVertexBuffers(renderCommandBuffer, firstBinding, endBinding - firstBinding, &buffers[firstBinding], &offsets[firstBinding]);
+        firstBinding = endBinding;
+    }
 
-    vkCmdBindIndexBuffer(renderCommandBuffer, indexBuffers[meshIndex], 0, VK_INDEX_TYPE_UINT16);
+    vkCmdBindIndexBuffer(renderCommandBuffer, buffers[MESH_STREAM_INDEX], offsets[MESH_STREAM_INDEX], VK_INDEX_TYPE_UINT16);
 }
 
-void Vulkan::draw_elements(u32 count, u32 firstIndex, s32 vertexOffset)
+void Vulkan::draw_elements(u32 count, u32 firstIndex, s32 vertexOffset, u32 instanceCount, u32 firstInstance)
 {
-    vkCmdDrawIndexed(renderCommandBuffer, count, 1, firstIndex, vertexOffset, 0);
+    // Instances are read from the range of the current frame
+    firstInstance += MAX_INSTANCE_COUNT * currentFrame;
+    vkCmdDrawIndexed(renderCommandBuffer, count, instanceCount, firstIndex, vertexOffset, firstInstance);
 }
 
 void Vulkan::update_post_process_descriptor_set()
@@ -2497,10 +3084,6 @@ void Vulkan::render_post_process(u32 meshIndex)
     renderPassInfo.renderArea.offset = {0, 0};
     renderPassInfo.renderArea.extent = {SCREEN_WIDTH,SCREEN_HEIGHT};
 
-    currentSwapchainImageIndex++;
-    if (currentSwapchainImageIndex >= SWAPCHAIN_IMAGE_COUNT)
-        currentSwapchainImageIndex = 0;
-
     VkClearValue clearColor = {0,0,0,1};
     renderPassInfo.clearValueCount = 1;
     renderPassInfo.pClearValues = &clearColor;
@@ -2511,11 +3094,10 @@ void Vulkan::render_post_process(u32 meshIndex)
 
     vkCmdBindDescriptorSets(renderCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, colorGradingPipelineLayout, 0, 1, &gradingDescriptorSet, 0, nullptr);
 
-    VkDeviceSize offset = 0;
-    vkCmdBindVertexBuffers(renderCommandBuffer, 0, 1, &vertexPositionBuffers[meshIndex], &offset);
-    vkCmdBindIndexBuffer(renderCommandBuffer, indexBuffers[meshIndex], 0, VK_INDEX_TYPE_UINT16);
+    bind_vertex_buffer(meshIndex, VERTEX_POSITION_BIT);
 
-    vkCmdDrawIndexed(renderCommandBuffer, 6, 1, 0, 0, 0);
+    const MeshRecord &record = meshRecords[meshIndex];
+    vkCmdDrawIndexed(renderCommandBuffer, 6, 1, record.firstIndex, record.firstVertex, 0);
 }
 
 void Vulkan::stop_rendering()
@@ -2532,36 +3114,49 @@ void Vulkan::create_semaphores()
     semaphoreInfo.pNext = nullptr;
     semaphoreInfo.flags = 0;
 
-    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphore);
-    vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphore);
+    // Signaled, so waiting on a frame that was never submitted returns right away
+    VkFenceCreateInfo fenceInfo;
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.pNext = nullptr;
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &imageAvailableSemaphores[i]);
+        vkCreateSemaphore(device, &semaphoreInfo, nullptr, &renderFinishedSemaphores[i]);
+        vkCreateFence(device, &fenceInfo, nullptr, &frameFences[i]);
+    }
+}
+
+void Vulkan::destroy_semaphores()
+{
+    for (u32 i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkDestroyFence(device, frameFences[i], nullptr);
+        vkDestroySemaphore(device, renderFinishedSemaphores[i], nullptr);
+        vkDestroySemaphore(device, imageAvailableSemaphores[i], nullptr);
+    }
 }
 
-void Vulkan::destroy_semaphores()
+void Vulkan::wait_for_frames_in_flight()
 {
-    vkDestroySemaphore(device, renderFinishedSemaphore, nullptr);
-    vkDestroySemaphore(device, imageAvailableSemaphore, nullptr);
+    vkWaitForFences(device, FRAMES_IN_FLIGHT, frameFences, VK_TRUE, UINT64_MAX);
 }
 
 ///TEXTURES///
 void Vulkan::allocate_texture_memory(u32 index)
 {
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, textureImages[index], &memRequirements);
-
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    allocate_memory(&textureMemory[index], memRequirements.size, memoryTypeIndex);
+    allocate_image_memory(&textureMemory[index], textureImages[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 }
 void Vulkan::free_texture_memory(u32 index)
 {
-    vkFreeMemory(device, textureMemory[index], nullptr);
+    free_memory(&textureMemory[index]);
 }
 void Vulkan::create_texture_image(u32 index, TextureType type, int width, int height, VkFormat format, int mipCount)
 {
     create_image(&textureImages[index], width, height, format, VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, type, mipCount);
 
     allocate_texture_memory(index);
-    vkBindImageMemory(device, textureImages[index], textureMemory[index], 0);
 
     std::cout << "Texture " << index << " created!\n";
 }
@@ -2589,26 +3184,8 @@ void Vulkan::create_texture_sampler(u32 index, int mipCount, TextureFilter filte
 
     vkCreateSampler(device, &samplerInfo, nullptr, &textureSamplers[index]);
 }
-void Vulkan::copy_staging_buffer_to_texture(u32 index, VkBuffer stagingBuffer, u32 width, u32 height, int layerCount, int mipCount)
+void Vulkan::copy_staging_buffer_to_texture(VkCommandBuffer cmds, VkImage image, StagingRange staging, u32 width, u32 height, int layerCount, int mipCount)
 {
-    VkCommandBufferAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer tempCmds;
-    vkAllocateCommandBuffers(device, &allocInfo, &tempCmds);
-
-    VkCommandBufferBeginInfo beginInfo;
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.pNext = nullptr;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    vkBeginCommandBuffer(tempCmds, &beginInfo);
-
     //cmds
     VkImageMemoryBarrier barrier;
     barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -2619,17 +3196,17 @@ void Vulkan::copy_staging_buffer_to_texture(u32 index, VkBuffer stagingBuffer, u
     barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = textureImages[index];
+    barrier.image = image;
     barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     barrier.subresourceRange.baseMipLevel = 0;
     barrier.subresourceRange.levelCount = mipCount;
     barrier.subresourceRange.baseArrayLayer = 0;
     barrier.subresourceRange.layerCount = layerCount;
 
-    vkCmdPipelineBarrier(tempCmds, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
 
     VkBufferImageCopy region;
-    region.bufferOffset = 0;
+    region.bufferOffset = staging.offset;
     region.bufferRowLength = 0;
     region.bufferImageHeight = 0;
     region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -2639,40 +3216,12 @@ void Vulkan::copy_staging_buffer_to_texture(u32 index, VkBuffer stagingBuffer, u
     region.imageOffset = {0,0,0};
     region.imageExtent = {width,height,1};
 
-    vkCmdCopyBufferToImage(tempCmds, stagingBuffer, textureImages[index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    vkEndCommandBuffer(tempCmds);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &tempCmds;
-
-    vkQueueSubmit(deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(deviceQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &tempCmds);
+    // Without staging memory the image is only moved to the right layout, its contents stay undefined
+    if (staging.data != nullptr)
+        vkCmdCopyBufferToImage(cmds, staging.buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
 }
-void Vulkan::generate_mipmaps(u32 index, int width, int height, int layerCount, int mipCount)
+void Vulkan::generate_mipmaps(VkCommandBuffer cmds, VkImage image, int width, int height, int layerCount, int mipCount)
 {
-    VkCommandBufferAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer tempCmds;
-    vkAllocateCommandBuffers(device, &allocInfo, &tempCmds);
-
-    VkCommandBufferBeginInfo beginInfo;
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.pNext = nullptr;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    vkBeginCommandBuffer(tempCmds, &beginInfo);
-
     //generate mipmaps
     VkImageMemoryBarrier mipBarrier;
     mipBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
@@ -2683,7 +3232,7 @@ void Vulkan::generate_mipmaps(u32 index, int width, int height, int layerCount,
     //mipBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     mipBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     mipBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    mipBarrier.image = textureImages[index];
+    mipBarrier.image = image;
     mipBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     //mipBarrier.subresourceRange.baseMipLevel = 0;
     mipBarrier.subresourceRange.levelCount = 1;
@@ -2701,7 +3250,7 @@ void Vulkan::generate_mipmaps(u32 index, int width, int height, int layerCount,
         mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
         mipBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
 
-        vkCmdPipelineBarrier(tempCmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
 
         VkImageBlit blit{};
         blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
@@ -2717,14 +3266,14 @@ void Vulkan::generate_mipmaps(u32 index, int width, int height, int layerCount,
         blit.dstOffsets[0] = { 0, 0, 0 };
         blit.dstOffsets[1] = { mipWidth > 1 ? mipWidth / 2 : 1, mipHeight > 1 ? mipHeight / 2 : 1, 1 };
 
-        vkCmdBlitImage(tempCmds, textureImages[index], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, textureImages[index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+        vkCmdBlitImage(cmds, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
 
         mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
         mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
         mipBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
         mipBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
 
-        vkCmdPipelineBarrier(tempCmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
+        vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
 
         if (mipWidth > 1)
             mipWidth /= 2;
@@ -2738,19 +3287,7 @@ void Vulkan::generate_mipmaps(u32 index, int width, int height, int layerCount,
     mipBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
     mipBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
 
-    vkCmdPipelineBarrier(tempCmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
-
-    vkEndCommandBuffer(tempCmds);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &tempCmds;
-
-    vkQueueSubmit(deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(deviceQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &tempCmds);
+    vkCmdPipelineBarrier(cmds, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &mipBarrier);
 }
 void Vulkan::create_texture(u32 textureIndex, Image **image, Texture *texture, TextureType type, TextureFilter filter, bool generateMips)
 {
@@ -2787,34 +3324,17 @@ void Vulkan::create_texture(u32 textureIndex, Image **image, Texture *texture, T
     create_texture_image(textureIndex, type, width, height, format, mipCount);
 
     //copy pixels
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
-
-    create_buffer(&stagingBuffer, imageBytes * layerCount, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-    VkMemoryRequirements memRequirements;
-    vkGetBufferMemoryRequirements(device, stagingBuffer, &memRequirements);
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    allocate_memory(&stagingBufferMemory, imageBytes * layerCount, memoryTypeIndex);
-
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
-
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, imageBytes * layerCount, 0, &data);
-    for (int i = 0; i < layerCount; i++)
+    StagingRange staging = reserve_staging(imageBytes * layerCount);
+    for (int i = 0; i < layerCount && staging.data != nullptr; i++)
     {
-        memcpy((char*)data + (imageBytes * i), image[i]->pixels, imageBytes);
+        memcpy(staging.data + (imageBytes * i), image[i]->pixels, imageBytes);
     }
-    vkUnmapMemory(device, stagingBufferMemory);
 
-    copy_staging_buffer_to_texture(textureIndex, stagingBuffer, width, height, layerCount, mipCount);
-
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    VkCommandBuffer cmds = get_upload_command_buffer();
+    copy_staging_buffer_to_texture(cmds, textureImages[textureIndex], staging, width, height, layerCount, mipCount);
 
     //call this even if no mipmaps, because the texture needs to be converted to correct format
-    generate_mipmaps(textureIndex, width, height, layerCount, mipCount);
+    generate_mipmaps(cmds, textureImages[textureIndex], width, height, layerCount, mipCount);
 
     create_image_view(&textureImageViews[textureIndex], textureImages[textureIndex], format, VK_IMAGE_ASPECT_COLOR_BIT, type, mipCount);
     create_texture_sampler(textureIndex, mipCount, filter);
@@ -2824,6 +3344,8 @@ void Vulkan::create_texture(u32 textureIndex, Image **image, Texture *texture, T
 
 void Vulkan::destroy_texture(u32 textureIndex)
 {
+    wait_for_frames_in_flight();
+    finish_uploads();
     vkDestroyImage(device, textureImages[textureIndex], nullptr);
     vkDestroyImageView(device, textureImageViews[textureIndex], nullptr);
     vkDestroySampler(device, textureSamplers[textureIndex], nullptr);
@@ -2831,202 +3353,373 @@ void Vulkan::destroy_texture(u32 textureIndex)
 }
 
 ///VERTEX BUFFERS///
-void Vulkan::create_index_buffer(u8 index, MeshData *meshData)
+void Vulkan::create_static_geometry_buffers()
+{
+    for (u32 i = 0; i < MESH_STREAM_COUNT; i++)
+    {
+        VkBufferUsageFlags usage = i == MESH_STREAM_INDEX ? VK_BUFFER_USAGE_INDEX_BUFFER_BIT : VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+        u32 capacity = i == MESH_STREAM_INDEX ? STATIC_INDEX_CAPACITY : STATIC_VERTEX_CAPACITY;
+        create_buffer(&staticGeometryBuffers[i], meshStreamStrides[i] * capacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage);
+        allocate_buffer_memory(&staticGeometryMemory[i], staticGeometryBuffers[i], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    }
+
+    init_free_list(&staticVertexList, staticVertexRanges, MAX_VERTEX_BUFFER_COUNT + 1, STATIC_VERTEX_CAPACITY);
+    init_free_list(&staticIndexList, staticIndexRanges, MAX_VERTEX_BUFFER_COUNT + 1, STATIC_INDEX_CAPACITY);
+}
+void Vulkan::destroy_static_geometry_buffers()
+{
+    for (u32 i = 0; i < MESH_STREAM_COUNT; i++)
+    {
+        vkDestroyBuffer(device, staticGeometryBuffers[i], nullptr);
+        free_memory(&staticGeometryMemory[i]);
+    }
+}
+
+void Vulkan::create_vertex_buffer(u32 meshIndex, MeshData *meshData)
 {
-    u32 bufferSize = sizeof(Triangle) * meshData->triangleCount;
+    MeshRecord &record = meshRecords[meshIndex];
+    record = {};
+    record.buffer = STATIC_GEOMETRY_BUFFER;
 
-    //staging bufffaaa
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    u32 vertexCount = meshData->vertexCount;
+    u32 indexCount = meshData->triangleCount * 3;
 
-    create_buffer(&stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+    u32 firstVertex = free_list_alloc(&staticVertexList, vertexCount);
+    if (firstVertex == FREE_LIST_NO_SPACE)
+    {
+        std::cout << "No room for " << vertexCount << " vertices in the static geometry buffers!\n";
+        return;
+    }
+    u32 firstIndex = free_list_alloc(&staticIndexList, indexCount);
+    if (firstIndex == FREE_LIST_NO_SPACE)
+    {
+        free_list_free(&staticVertexList, firstVertex, vertexCount);
+        std::cout << "No room for " << indexCount << " indices in the static geometry buffers!\n";
+        return;
+    }
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, meshData->triangles, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    // All streams go through one staging range, each copied to the mesh's range of its own buffer
+    const void *streamData[MESH_STREAM_COUNT] = {meshData->position, meshData->texcoord0, meshData->normal,
+                                                 meshData->tangent, meshData->color, meshData->triangles};
+    VkDeviceSize streamSizes[MESH_STREAM_COUNT];
+    VkDeviceSize stagingSize = 0;
+    for (u32 i = 0; i < MESH_STREAM_COUNT; i++)
+    {
+        streamSizes[i] = meshStreamStrides[i] * (i == MESH_STREAM_INDEX ? indexCount : vertexCount);
+        stagingSize += streamSizes[i];
+    }
 
-    create_buffer(&indexBuffers[index], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
-    allocate_buffer_memory(&indexBufferMemory[index], indexBuffers[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkBindBufferMemory(device, indexBuffers[index], indexBufferMemory[index], 0);
+    StagingRange staging = reserve_staging(stagingSize);
+    if (staging.data == nullptr)
+    {
+        free_list_free(&staticVertexList, firstVertex, vertexCount);
+        free_list_free(&staticIndexList, firstIndex, indexCount);
+        return;
+    }
 
-    copy_buffer(stagingBuffer, indexBuffers[index], bufferSize);
+    VkDeviceSize stagingOffset = 0;
+    for (u32 i = 0; i < MESH_STREAM_COUNT; i++)
+    {
+        if (streamSizes[i] == 0)
+            continue;
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+        u32 first = i == MESH_STREAM_INDEX ? firstIndex : firstVertex;
+        memcpy(staging.data + stagingOffset, streamData[i], streamSizes[i]);
+        copy_buffer(staging.buffer, staticGeometryBuffers[i], streamSizes[i], staging.offset + stagingOffset, meshStreamStrides[i] * first);
+        stagingOffset += streamSizes[i];
+    }
 
-    indexCounts[index] = meshData->triangleCount * 3;
+    record.firstVertex = firstVertex;
+    record.vertexCount = vertexCount;
+    record.firstIndex = firstIndex;
+    record.indexCount = indexCount;
 }
-
-void Vulkan::create_vertex_position_buffer(u8 index, u16 vertexCount, glm::vec3 *pos)
+void Vulkan::destroy_vertex_buffer(u32 meshIndex)
 {
-    u32 bufferSize = sizeof(glm::vec3) * vertexCount;
-
-    //staging bufffaaa
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    // A pending copy into the freed range could land after the next mesh's copy to it
+    wait_for_frames_in_flight();
+    finish_uploads();
+
+    MeshRecord &record = meshRecords[meshIndex];
+    free_list_free(&staticVertexList, record.firstVertex, record.vertexCount);
+    free_list_free(&staticIndexList, record.firstIndex, record.indexCount);
+    record = {};
+}
 
-    create_buffer(&stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+void Vulkan::create_dynamic_mesh(u32 meshIndex, u32 vertexCapacity, u32 indexCapacity)
+{
+    dynamicMeshIndexOffsets[meshIndex] = (sizeof(OverlayVertex) * vertexCapacity + 15) & ~15ull;
+    dynamicMeshCopySizes[meshIndex] = (dynamicMeshIndexOffsets[meshIndex] + sizeof(u16) * indexCapacity + 15) & ~15ull;
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, pos, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    create_buffer(&dynamicMeshBuffers[meshIndex], dynamicMeshCopySizes[meshIndex] * FRAMES_IN_FLIGHT, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT);
+    allocate_buffer_memory(&dynamicMeshMemory[meshIndex], dynamicMeshBuffers[meshIndex], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
 
-    create_buffer(&vertexPositionBuffers[index], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    allocate_buffer_memory(&vertexPositionBufferMemory[index], vertexPositionBuffers[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkBindBufferMemory(device, vertexPositionBuffers[index], vertexPositionBufferMemory[index], 0);
+    dynamicMeshMappings[meshIndex] = get_memory_mapping(dynamicMeshMemory[meshIndex]);
+}
+void Vulkan::write_dynamic_vertices(u32 meshIndex, u32 firstVertex, const OverlayVertex *vertices, u32 count)
+{
+    // The copy of this frame's slot, its fence was waited on at the end of the last frame
+    u8 *copy = dynamicMeshMappings[meshIndex] + dynamicMeshCopySizes[meshIndex] * currentFrame;
+    memcpy(copy + sizeof(OverlayVertex) * firstVertex, vertices, sizeof(OverlayVertex) * count);
+}
+void Vulkan::write_dynamic_indices(u32 meshIndex, u32 firstIndex, const u16 *indices, u32 count)
+{
+    u8 *copy = dynamicMeshMappings[meshIndex] + dynamicMeshCopySizes[meshIndex] * currentFrame;
+    memcpy(copy + dynamicMeshIndexOffsets[meshIndex] + sizeof(u16) * firstIndex, indices, sizeof(u16) * count);
+}
+void Vulkan::destroy_dynamic_mesh(u32 meshIndex)
+{
+    wait_for_frames_in_flight();
 
-    copy_buffer(stagingBuffer, vertexPositionBuffers[index], bufferSize);
+    vkDestroyBuffer(device, dynamicMeshBuffers[meshIndex], nullptr);
+    free_memory(&dynamicMeshMemory[meshIndex]);
+    dynamicMeshMappings[meshIndex] = nullptr;
+}
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+const Vulkan::MeshRecord &Vulkan::get_mesh_record(u32 meshIndex)
+{
+    return meshRecords[meshIndex];
 }
-void Vulkan::create_vertex_texcoord0_buffer(u8 index, u16 vertexCount, glm::vec2 *uv)
+u32 Vulkan::get_vertex_count(u32 meshIndex)
+{
+    return meshRecords[meshIndex].vertexCount;
+}
+u32 Vulkan::get_index_count(u32 meshIndex)
 {
-    u32 bufferSize = sizeof(glm::vec2) * vertexCount;
+    return meshRecords[meshIndex].indexCount;
+}
 
-    //staging bufffaaa
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+///UPLOADS///
+void Vulkan::create_upload_queue()
+{
+    create_buffer(&uploadRingBuffer, UPLOAD_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+    allocate_buffer_memory(&uploadRingMemory, uploadRingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    uploadRingMapping = get_memory_mapping(uploadRingMemory);
+    uploadRingHead = 0;
+    uploadRingUsed = 0;
 
-    create_buffer(&stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+    VkCommandPoolCreateInfo poolInfo;
+    poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    poolInfo.pNext = nullptr;
+    poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    poolInfo.queueFamilyIndex = 0;
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, uv, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    VkCommandBufferAllocateInfo allocInfo;
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.pNext = nullptr;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
 
-    create_buffer(&vertexTexcoord0Buffers[index], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    allocate_buffer_memory(&vertexTexcoord0BufferMemory[index], vertexTexcoord0Buffers[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkBindBufferMemory(device, vertexTexcoord0Buffers[index], vertexTexcoord0BufferMemory[index], 0);
+    VkFenceCreateInfo fenceInfo;
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    fenceInfo.pNext = nullptr;
+    fenceInfo.flags = 0;
 
-    copy_buffer(stagingBuffer, vertexTexcoord0Buffers[index], bufferSize);
+    for (u32 i = 0; i < UPLOAD_BATCH_COUNT; i++)
+    {
+        UploadBatch &batch = uploadBatches[i];
+        vkCreateCommandPool(device, &poolInfo, nullptr, &batch.commandPool);
+        allocInfo.commandPool = batch.commandPool;
+        vkAllocateCommandBuffers(device, &allocInfo, &batch.commandBuffer);
+        vkCreateFence(device, &fenceInfo, nullptr, &batch.fence);
+
+        batch.serial = 0;
+        batch.ringBytes = 0;
+        batch.oversizeCount = 0;
+    }
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    openUploadBatch = 0;
+    uploadBatchRecording = false;
 }
-void Vulkan::create_vertex_normal_buffer(u8 index, u16 vertexCount, glm::vec3 *nrm)
+void Vulkan::destroy_upload_queue()
 {
-    u32 bufferSize = sizeof(glm::vec3) * vertexCount;
+    finish_uploads();
 
-    //staging bufffaaa
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    for (u32 i = 0; i < UPLOAD_BATCH_COUNT; i++)
+    {
+        vkDestroyFence(device, uploadBatches[i].fence, nullptr);
+        vkDestroyCommandPool(device, uploadBatches[i].commandPool, nullptr);
+    }
 
-    create_buffer(&stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+    vkDestroyBuffer(device, uploadRingBuffer, nullptr);
+    free_memory(&uploadRingMemory);
+}
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, nrm, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+void Vulkan::open_upload_batch()
+{
+    UploadBatch &batch = uploadBatches[openUploadBatch];
 
-    create_buffer(&vertexNormalBuffers[index], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    allocate_buffer_memory(&vertexNormalBufferMemory[index], vertexNormalBuffers[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkBindBufferMemory(device, vertexNormalBuffers[index], vertexNormalBufferMemory[index], 0);
+    // Only reached when every batch is in flight, this one is the oldest
+    while (batch.serial != 0)
+        retire_oldest_upload_batch(true);
 
-    copy_buffer(stagingBuffer, vertexNormalBuffers[index], bufferSize);
+    vkResetCommandPool(device, batch.commandPool, 0);
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-void Vulkan::create_vertex_tangent_buffer(u8 index, u16 vertexCount, glm::vec4 *tan)
-{
-    u32 bufferSize = sizeof(glm::vec4) * vertexCount;
+    VkCommandBufferBeginInfo beginInfo;
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.pNext = nullptr;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = nullptr;
 
-    //staging bufffaaa
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+    vkBeginCommandBuffer(batch.commandBuffer, &beginInfo);
 
-    create_buffer(&stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+    batch.ringBytes = 0;
+    batch.oversizeCount = 0;
+    uploadBatchRecording = true;
+}
+bool Vulkan::retire_oldest_upload_batch(bool wait)
+{
+    UploadBatch *oldest = nullptr;
+    for (u32 i = 0; i < UPLOAD_BATCH_COUNT; i++)
+    {
+        UploadBatch &batch = uploadBatches[i];
+        if (batch.serial != 0 && (oldest == nullptr || batch.serial < oldest->serial))
+            oldest = &batch;
+    }
+    if (oldest == nullptr)
+        return false;
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, tan, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    if (wait)
+        vkWaitForFences(device, 1, &oldest->fence, VK_TRUE, UINT64_MAX);
+    else if (vkGetFenceStatus(device, oldest->fence) != VK_SUCCESS)
+        return false;
 
-    create_buffer(&vertexTangentBuffers[index], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    allocate_buffer_memory(&vertexTangentBufferMemory[index], vertexTangentBuffers[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkBindBufferMemory(device, vertexTangentBuffers[index],vertexTangentBufferMemory[index], 0);
+    uploadRingUsed -= oldest->ringBytes;
+    if (uploadRingUsed == 0)
+        uploadRingHead = 0;
 
-    copy_buffer(stagingBuffer, vertexTangentBuffers[index], bufferSize);
+    for (u32 i = 0; i < oldest->oversizeCount; i++)
+    {
+        vkDestroyBuffer(device, oldest->oversizeBuffers[i], nullptr);
+        free_memory(&oldest->oversizeMemory[i]);
+    }
+    oldest->oversizeCount = 0;
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
+    completedUploadSerial = oldest->serial;
+    oldest->serial = 0;
+    return true;
 }
-void Vulkan::create_vertex_color_buffer(u8 index, u16 vertexCount, glm::vec4 *clr)
-{
-    u32 bufferSize = sizeof(glm::vec4) * vertexCount;
 
-    //staging bufffaaa
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingBufferMemory;
+Vulkan::StagingRange Vulkan::reserve_staging(VkDeviceSize size)
+{
+    if (!uploadBatchRecording)
+        open_upload_batch();
 
-    create_buffer(&stagingBuffer, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    allocate_buffer_memory(&stagingBufferMemory, stagingBuffer, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    vkBindBufferMemory(device, stagingBuffer, stagingBufferMemory, 0);
+    StagingRange range;
 
-    void *data;
-    vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);
-    memcpy(data, clr, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    // Too big for the ring, gets a buffer of its own for the lifetime of the batch
+    if (size > UPLOAD_RING_SIZE / 2)
+    {
+        if (uploadBatches[openUploadBatch].oversizeCount == MAX_UPLOAD_OVERSIZE_BUFFERS)
+        {
+            submit_uploads();
+            open_upload_batch();
+        }
 
-    create_buffer(&vertexColorBuffers[index], bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
-    allocate_buffer_memory(&vertexColorBufferMemory[index], vertexColorBuffers[index], VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-    vkBindBufferMemory(device, vertexColorBuffers[index],vertexColorBufferMemory[index], 0);
+        UploadBatch &batch = uploadBatches[openUploadBatch];
+        u32 index = batch.oversizeCount++;
+        create_buffer(&batch.oversizeBuffers[index], size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+        if (!allocate_buffer_memory(&batch.oversizeMemory[index], batch.oversizeBuffers[index], VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT))
+        {
+            vkDestroyBuffer(device, batch.oversizeBuffers[index], nullptr);
+            batch.oversizeCount--;
 
-    copy_buffer(stagingBuffer, vertexColorBuffers[index], bufferSize);
+            range.data = nullptr;
+            range.buffer = VK_NULL_HANDLE;
+            range.offset = 0;
+            return range;
+        }
 
-    vkDestroyBuffer(device, stagingBuffer, nullptr);
-    vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
+        range.data = get_memory_mapping(batch.oversizeMemory[index]);
+        range.buffer = batch.oversizeBuffers[index];
+        range.offset = 0;
+        return range;
+    }
 
-void Vulkan::create_vertex_buffer(u32 meshIndex, MeshData *meshData)
-{
-    u32 vertexCount = meshData->vertexCount;
-    create_vertex_position_buffer(meshIndex, vertexCount, meshData->position);
-    create_vertex_texcoord0_buffer(meshIndex, vertexCount, meshData->texcoord0);
-    create_vertex_normal_buffer(meshIndex, vertexCount, meshData->normal);
-    create_vertex_tangent_buffer(meshIndex, vertexCount, meshData->tangent);
-    create_vertex_color_buffer(meshIndex, vertexCount, meshData->color);
+    while (true)
+    {
+        // Doesn't fit before the end of the ring, skip what's left and start over at 0
+        VkDeviceSize offset = (uploadRingHead + UPLOAD_ALIGNMENT - 1) & ~(VkDeviceSize)(UPLOAD_ALIGNMENT - 1);
+        VkDeviceSize consumed = offset - uploadRingHead + size;
+        if (offset + size > UPLOAD_RING_SIZE)
+        {
+            offset = 0;
+            consumed = UPLOAD_RING_SIZE - uploadRingHead + size;
+        }
 
-    create_index_buffer(meshIndex, meshData);
+        if (consumed <= UPLOAD_RING_SIZE - uploadRingUsed)
+        {
+            uploadBatches[openUploadBatch].ringBytes += consumed;
+            uploadRingUsed += consumed;
+            uploadRingHead = offset + size;
+
+            range.data = uploadRingMapping + offset;
+            range.buffer = uploadRingBuffer;
+            range.offset = offset;
+            return range;
+        }
 
-    vertexCounts[meshIndex] = vertexCount;
+        // Wait for older batches to free up space. If the open batch has all of it, send it off first
+        if (!retire_oldest_upload_batch(true))
+        {
+            submit_uploads();
+            open_upload_batch();
+        }
+    }
 }
-void Vulkan::destroy_vertex_buffer(u32 meshIndex)
+VkCommandBuffer Vulkan::get_upload_command_buffer()
 {
-    vkFreeMemory(device, indexBufferMemory[meshIndex], nullptr);
-    vkDestroyBuffer(device, indexBuffers[meshIndex], nullptr);
-    vkFreeMemory(device, vertexPositionBufferMemory[meshIndex], nullptr);
-    vkDestroyBuffer(device, vertexPositionBuffers[meshIndex], nullptr);
-    vkFreeMemory(device, vertexTexcoord0BufferMemory[meshIndex], nullptr);
-    vkDestroyBuffer(device, vertexTexcoord0Buffers[meshIndex], nullptr);
-    vkFreeMemory(device, vertexNormalBufferMemory[meshIndex], nullptr);
-    vkDestroyBuffer(device, vertexNormalBuffers[meshIndex], nullptr);
-    vkFreeMemory(device, vertexTangentBufferMemory[meshIndex], nullptr);
-    vkDestroyBuffer(device, vertexTangentBuffers[meshIndex], nullptr);
-    vkFreeMemory(device, vertexColorBufferMemory[meshIndex], nullptr);
-    vkDestroyBuffer(device, vertexColorBuffers[meshIndex], nullptr);
+    if (!uploadBatchRecording)
+        open_upload_batch();
+    return uploadBatches[openUploadBatch].commandBuffer;
 }
 
-u32 Vulkan::get_vertex_count(u32 meshIndex)
+u64 Vulkan::submit_uploads()
 {
-    return vertexCounts[meshIndex];
+    if (!uploadBatchRecording)
+        return 0;
+
+    UploadBatch &batch = uploadBatches[openUploadBatch];
+
+    // Everything submitted later waits for the copies before reading any of it
+    VkMemoryBarrier barrier;
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.pNext = nullptr;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT | VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(batch.commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+    vkEndCommandBuffer(batch.commandBuffer);
+
+    VkSubmitInfo submitInfo{};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.commandBuffer;
+
+    vkResetFences(device, 1, &batch.fence);
+    vkQueueSubmit(deviceQueue, 1, &submitInfo, batch.fence);
+
+    u64 serial = nextUploadSerial++;
+    batch.serial = serial;
+    uploadBatchRecording = false;
+    openUploadBatch = (openUploadBatch + 1) % UPLOAD_BATCH_COUNT;
+
+    // Free the space of whatever has finished in the meantime
+    while (retire_oldest_upload_batch(false));
+
+    return serial;
 }
-u32 Vulkan::get_index_count(u32 meshIndex)
+bool Vulkan::is_upload_complete(u64 serial)
+{
+    while (completedUploadSerial < serial && retire_oldest_upload_batch(false));
+    return completedUploadSerial >= serial;
+}
+void Vulkan::finish_uploads()
 {
-    return indexCounts[meshIndex];
+    submit_uploads();
+    while (retire_oldest_upload_batch(true));
 }
 
 ///MAIN///
@@ -3096,6 +3789,7 @@ void Vulkan::init(u32 extensionCount, const char** extensionNames, void (*surfac
     //device
     find_physical_device();
     create_logical_device();
+    load_pipeline_cache();
     //uniform buffers
     create_camera_data_buffer();
     create_lighting_buffer();
@@ -3117,53 +3811,62 @@ void Vulkan::init(u32 extensionCount, const char** extensionNames, void (*surfac
     create_shadow_pipeline();
     //post processing
     create_grading_pipeline();
+    create_overlay_pipeline();
     //framebuffers
     create_pp_framebuffer();
     create_swapchain_framebuffers();
     //command pool
     create_command_pool();
+    create_upload_queue();
+
+    //static meshes
+    create_static_geometry_buffers();
+
     //cubemap
     create_placeholder_cubemap();
 
     //semaphores
     create_semaphores();
+
+    //everything it samples exists now
+    update_post_process_descriptor_set();
 }
-void Vulkan::draw_frame(glm::vec3 camPos, Quaternion camRot) //placeholder function
+void Vulkan::draw_frame()
 {
-    update_matrices(camPos, camRot);
-
-    u32 imageIndex;
-    vkAcquireNextImageKHR(device, swapChain, UINT64_MAX, imageAvailableSemaphore, VK_NULL_HANDLE, &imageIndex);
-
     VkSubmitInfo submitInfo;
     submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submitInfo.pNext = nullptr;
 
     VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
     submitInfo.waitSemaphoreCount = 1;
-    submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
+    submitInfo.pWaitSemaphores = &imageAvailableSemaphores[currentFrame];
     submitInfo.pWaitDstStageMask = &waitStage;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &renderCommandBuffer;
     submitInfo.signalSemaphoreCount = 1;
-    submitInfo.pSignalSemaphores = &renderFinishedSemaphore;
+    submitInfo.pSignalSemaphores = &renderFinishedSemaphores[currentFrame];
+
+    // Uploads recorded up to now go first, so this frame can use them
+    submit_uploads();
 
-    vkQueueSubmit(deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
+    vkResetFences(device, 1, &frameFences[currentFrame]);
+    vkQueueSubmit(deviceQueue, 1, &submitInfo, frameFences[currentFrame]);
 
     VkPresentInfoKHR presentInfo;
     presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
     presentInfo.pNext = nullptr;
     presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &renderFinishedSemaphore;
+    presentInfo.pWaitSemaphores = &renderFinishedSemaphores[currentFrame];
     presentInfo.swapchainCount = 1;
     presentInfo.pSwapchains = &swapChain;
-    presentInfo.pImageIndices = &imageIndex;
+    presentInfo.pImageIndices = &currentSwapchainImageIndex;
     presentInfo.pResults = nullptr;
 
     vkQueuePresentKHR(deviceQueue, &presentInfo);
-    vkQueueWaitIdle(deviceQueue);
 
-    vkFreeCommandBuffers(device, commandPool, 1, &renderCommandBuffer);
+    // Only wait for the frame whose copies the next one is going to overwrite
+    currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
+    vkWaitForFences(device, 1, &frameFences[currentFrame], VK_TRUE, UINT64_MAX);
 }
 
 void Vulkan::free()
@@ -3175,7 +3878,8 @@ void Vulkan::free()
     destroy_semaphores();
 
     //command pool
-    vkDestroyCommandPool(device, commandPool, nullptr);
+    destroy_upload_queue();
+    destroy_command_pool();
 
     //render passes
     destroy_render_passes();
@@ -3186,6 +3890,7 @@ void Vulkan::free()
 
     //post processing
     destroy_grading_pipeline();
+    destroy_overlay_pipeline();
 
     //cubemap
     destroy_placeholder_cubemap();
@@ -3203,12 +3908,18 @@ void Vulkan::free()
     //swapchain
     vkDestroySwapchainKHR(device, swapChain, nullptr);
 
+    //static meshes
+    destroy_static_geometry_buffers();
+
     //uniform buffers
     destroy_camera_data_buffer();
     destroy_lighting_buffer();
     destroy_per_instance_buffer();
     destroy_shader_data_buffer();
 
+    free_memory_blocks();
+
+    save_pipeline_cache();
     free_logical_device();
     vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
@@ -3229,68 +3940,221 @@ void Vulkan::create_buffer(VkBuffer *pBuffer, VkDeviceSize size, VkBufferUsageFl
 
     vkCreateBuffer(device, &bufferInfo, nullptr, pBuffer);
 }
-void Vulkan::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size)
+void Vulkan::copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
 {
-    VkCommandBufferAllocateInfo allocInfo;
-    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    allocInfo.pNext = nullptr;
-    allocInfo.commandPool = commandPool;
-    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    allocInfo.commandBufferCount = 1;
-
-    VkCommandBuffer tempCmds;
-    vkAllocateCommandBuffers(device, &allocInfo, &tempCmds);
-
-    VkCommandBufferBeginInfo beginInfo;
-    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.pNext = nullptr;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
-    beginInfo.pInheritanceInfo = nullptr;
-
-    vkBeginCommandBuffer(tempCmds, &beginInfo);
-
     VkBufferCopy copyRegion;
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
     copyRegion.size = size;
 
-    vkCmdCopyBuffer(tempCmds, src, dst, 1, &copyRegion);
-
-    vkEndCommandBuffer(tempCmds);
-
-    VkSubmitInfo submitInfo{};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &tempCmds;
-
-    vkQueueSubmit(deviceQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(deviceQueue);
-
-    vkFreeCommandBuffers(device, commandPool, 1, &tempCmds);
-
+    vkCmdCopyBuffer(get_upload_command_buffer(), src, dst, 1, &copyRegion);
 }
 void Vulkan::free_buffer(VkBuffer *pBuffer)
 {
     vkDestroyBuffer(device, *pBuffer, nullptr);
 }
-void Vulkan::allocate_memory(VkDeviceMemory *pMemory, VkDeviceSize size, u32 memoryTypeIndex)
+bool Vulkan::allocate_memory_block(u32 block, VkDeviceSize size, u32 memoryTypeIndex, bool image, bool dedicated)
 {
+    MemoryBlock &memoryBlock = memoryBlocks[block];
+
     VkMemoryAllocateInfo allocInfo;
     allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     allocInfo.pNext = nullptr;
     allocInfo.allocationSize = size;
     allocInfo.memoryTypeIndex = memoryTypeIndex;
 
-    vkAllocateMemory(device, &allocInfo, nullptr, pMemory);
+    if (vkAllocateMemory(device, &allocInfo, nullptr, &memoryBlock.memory) != VK_SUCCESS)
+    {
+        std::cout << "Failed to allocate " << size << " bytes of device memory!\n";
+        memoryBlock.memory = VK_NULL_HANDLE;
+        return false;
+    }
+
+    memoryBlock.size = size;
+    memoryBlock.memoryTypeIndex = memoryTypeIndex;
+    memoryBlock.image = image;
+    memoryBlock.dedicated = dedicated;
+    memoryBlock.mapping = nullptr;
+    memoryBlock.buddy.tree = nullptr;
+
+    if (physicalDeviceInfo.memProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    {
+        void *data;
+        vkMapMemory(device, memoryBlock.memory, 0, VK_WHOLE_SIZE, 0, &data);
+        memoryBlock.mapping = (u8*)data;
+    }
+
+    if (!dedicated && !init_buddy(&memoryBlock.buddy, MEMORY_MIN_ALLOCATION_ORDER, MEMORY_BLOCK_ORDER))
+    {
+        std::cout << "Failed to set up the allocator of a device memory block!\n";
+        // Freeing the memory unmaps it too
+        vkFreeMemory(device, memoryBlock.memory, nullptr);
+        memoryBlock.memory = VK_NULL_HANDLE;
+        return false;
+    }
+    return true;
+}
+
+bool Vulkan::allocate_memory(MemoryAllocation *pAllocation, VkMemoryRequirements requirements, VkMemoryPropertyFlags propertyFlags, bool image)
+{
+    pAllocation->memory = VK_NULL_HANDLE;
+
+    u32 memoryTypeIndex = get_device_memory_type_index(requirements.memoryTypeBits, propertyFlags);
+    bool dedicated = requirements.size > (1ull << (MEMORY_BLOCK_ORDER - 1));
+
+    u32 freeBlock = MAX_MEMORY_BLOCKS;
+    for (u32 block = 0; block < MAX_MEMORY_BLOCKS; block++)
+    {
+        MemoryBlock &memoryBlock = memoryBlocks[block];
+        if (memoryBlock.memory == VK_NULL_HANDLE)
+        {
+            freeBlock = MIN(freeBlock, block);
+            continue;
+        }
+        if (dedicated || memoryBlock.dedicated || memoryBlock.memoryTypeIndex != memoryTypeIndex || memoryBlock.image != image)
+            continue;
+
+        VkDeviceSize offset = buddy_alloc(&memoryBlock.buddy, requirements.size, requirements.alignment);
+        if (offset == BUDDY_NO_SPACE)
+            continue;
+
+        pAllocation->memory = memoryBlock.memory;
+        pAllocation->offset = offset;
+        pAllocation->size = requirements.size;
+        pAllocation->block = block;
+        memoryAllocationCount++;
+        memoryRequestedBytes += requirements.size;
+        return true;
+    }
+
+    // No room in the existing blocks, get a new one
+    if (freeBlock == MAX_MEMORY_BLOCKS)
+    {
+        std::cout << "Out of device memory blocks!\n";
+        return false;
+    }
+
+    VkDeviceSize blockSize = dedicated ? requirements.size : 1ull << MEMORY_BLOCK_ORDER;
+    if (!allocate_memory_block(freeBlock, blockSize, memoryTypeIndex, image, dedicated))
+    {
+        // A whole shared block might not fit when the allocation alone still does
+        if (dedicated || !allocate_memory_block(freeBlock, requirements.size, memoryTypeIndex, image, true))
+            return false;
+        dedicated = true;
+    }
+
+    pAllocation->memory = memoryBlocks[freeBlock].memory;
+    pAllocation->offset = dedicated ? 0 : buddy_alloc(&memoryBlocks[freeBlock].buddy, requirements.size, requirements.alignment);
+    pAllocation->size = requirements.size;
+    pAllocation->block = freeBlock;
+    memoryAllocationCount++;
+    memoryRequestedBytes += requirements.size;
+    return true;
 }
 
-void Vulkan::allocate_buffer_memory(VkDeviceMemory *pMemory, VkBuffer buffer, VkMemoryPropertyFlags propertyFlags)
+bool Vulkan::allocate_buffer_memory(MemoryAllocation *pAllocation, VkBuffer buffer, VkMemoryPropertyFlags propertyFlags)
 {
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
-    u32 memoryTypeIndex = get_device_memory_type_index(memRequirements.memoryTypeBits, propertyFlags);
 
-    allocate_memory(pMemory, memRequirements.size, memoryTypeIndex);
+    if (!allocate_memory(pAllocation, memRequirements, propertyFlags, false))
+    {
+        std::cout << "No memory for a buffer of " << memRequirements.size << " bytes, it's left unbound!\n";
+        return false;
+    }
+
+    vkBindBufferMemory(device, buffer, pAllocation->memory, pAllocation->offset);
+    return true;
+}
+
+bool Vulkan::allocate_image_memory(MemoryAllocation *pAllocation, VkImage image, VkMemoryPropertyFlags propertyFlags)
+{
+    VkMemoryRequirements memRequirements;
+    vkGetImageMemoryRequirements(device, image, &memRequirements);
+
+    if (!allocate_memory(pAllocation, memRequirements, propertyFlags, true))
+    {
+        std::cout << "No memory for an image of " << memRequirements.size << " bytes, it's left unbound!\n";
+        return false;
+    }
+
+    vkBindImageMemory(device, image, pAllocation->memory, pAllocation->offset);
+    return true;
+}
+
+void Vulkan::free_memory(MemoryAllocation *pAllocation)
+{
+    if (pAllocation->memory == VK_NULL_HANDLE)
+        return;
+
+    MemoryBlock &memoryBlock = memoryBlocks[pAllocation->block];
+    memoryAllocationCount--;
+    memoryRequestedBytes -= pAllocation->size;
+
+    // Emptied shared blocks are kept around for the next allocations, dedicated ones go right away
+    if (memoryBlock.dedicated)
+    {
+        vkFreeMemory(device, memoryBlock.memory, nullptr);
+        memoryBlock.memory = VK_NULL_HANDLE;
+    }
+    else buddy_free(&memoryBlock.buddy, pAllocation->offset);
+
+    pAllocation->memory = VK_NULL_HANDLE;
+}
+
+u8 *Vulkan::get_memory_mapping(const MemoryAllocation &allocation)
+{
+    return memoryBlocks[allocation.block].mapping + allocation.offset;
+}
+
+void Vulkan::free_memory_blocks()
+{
+    for (u32 block = 0; block < MAX_MEMORY_BLOCKS; block++)
+    {
+        MemoryBlock &memoryBlock = memoryBlocks[block];
+        if (memoryBlock.memory == VK_NULL_HANDLE)
+            continue;
+
+        // Freeing the memory unmaps it too
+        vkFreeMemory(device, memoryBlock.memory, nullptr);
+        memoryBlock.memory = VK_NULL_HANDLE;
+        if (!memoryBlock.dedicated)
+            free_buddy(&memoryBlock.buddy);
+    }
+    memoryAllocationCount = 0;
+    memoryRequestedBytes = 0;
+}
+
+GpuMemoryStats Vulkan::get_memory_stats()
+{
+    GpuMemoryStats stats = {};
+    stats.allocationCount = memoryAllocationCount;
+    stats.requestedBytes = memoryRequestedBytes;
+
+    for (u32 block = 0; block < MAX_MEMORY_BLOCKS; block++)
+    {
+        MemoryBlock &memoryBlock = memoryBlocks[block];
+        if (memoryBlock.memory == VK_NULL_HANDLE)
+            continue;
+
+        stats.blockCount++;
+        stats.reservedBytes += memoryBlock.size;
+        if (memoryBlock.dedicated)
+        {
+            stats.usedBytes += memoryBlock.size;
+            continue;
+        }
+
+        u64 freeBytes = memoryBlock.buddy.freeBytes;
+        stats.usedBytes += memoryBlock.size - freeBytes;
+        if (freeBytes > 0)
+        {
+            r32 fragmentation = 1.0f - (r32)buddy_largest_free(&memoryBlock.buddy) / freeBytes;
+            stats.fragmentation = MAX(stats.fragmentation, fragmentation);
+        }
+    }
+
+    return stats;
 }
 
 u32 Vulkan::get_device_memory_type_index(u32 typeFilter, VkMemoryPropertyFlags propertyFlags)
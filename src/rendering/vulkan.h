@@ -17,6 +17,15 @@ struct Image;
 
 #define MAX_BINDING_COUNT 32
 
+#define MAX_DYNAMIC_MESH_COUNT 16
+#define MAX_OVERLAY_GLYPHS 4096
+
+// Instance matrices are read from a storage buffer by gl_InstanceIndex, so batches only need a first instance
+#define MAX_INSTANCES_PER_BATCH 0xffff
+#define MAX_INSTANCE_COUNT 0x10000
+
+#define MAX_RECORDING_SLICES 8
+
 namespace Vulkan
 {
     ///FUNCTIONS///
@@ -52,6 +61,35 @@ namespace Vulkan
         u8 bindingCount;
     };
 
+    // Piece of a device memory block, see allocate_memory
+    struct MemoryAllocation
+    {
+        VkDeviceMemory memory;
+        VkDeviceSize offset;
+        VkDeviceSize size; //as requested
+        u32 block;
+    };
+
+    // Mapped staging memory for an upload, see reserve_staging
+    struct StagingRange
+    {
+        u8 *data;
+        VkBuffer buffer;
+        VkDeviceSize offset;
+    };
+
+    // Where a mesh's geometry is. Meshes all share one set of buffers, STATIC_GEOMETRY_BUFFER.
+    // Draws add firstIndex and firstVertex to their index and vertex offsets
+    #define STATIC_GEOMETRY_BUFFER MAX_VERTEX_BUFFER_COUNT
+    struct MeshRecord
+    {
+        u32 buffer; //meshes with the same buffer can be drawn without binding again
+        u32 firstVertex;
+        u32 vertexCount;
+        u32 firstIndex;
+        u32 indexCount;
+    };
+
     ///DESCRIPTOR POOLS///
     void create_descriptor_pool(VkDescriptorPool *pool, DescriptorSetLayoutInfo info);
     void destroy_descriptor_pool(VkDescriptorPool *pool);
@@ -73,7 +111,7 @@ namespace Vulkan
     ///PER-INSTANCE DATA///
     void create_per_instance_buffer();
     void destroy_per_instance_buffer();
-    void set_transform_data(glm::mat4x4 *matrices, u32 length);
+    AffineMatrix *begin_transform_data(); //returns MAX_INSTANCE_COUNT matrices to write this frame's instances to
 
     ///SHADER DATA///
     void create_shader_data_block(u32 materialIndex, ShaderDataBlock *dataBlock, u32 shaderIndex);
@@ -119,6 +157,14 @@ namespace Vulkan
     void create_grading_pipeline();
     void destroy_grading_pipeline();
 
+    ///OVERLAY///
+    void create_overlay_buffers();
+    void create_overlay_pipeline();
+    void destroy_overlay_pipeline();
+    void set_overlay_texture(u32 textureIndex);
+    bool begin_overlay(); //call inside the post processing pass, false if there's no font to draw with
+    void draw_dynamic_mesh(u32 meshIndex, u32 indexCount); //after begin_overlay
+
     ///RENDER PASSES///
     void create_shadow_render_pass();
     void create_forward_render_pass();
@@ -126,6 +172,14 @@ namespace Vulkan
     void create_render_passes();
     void destroy_render_passes();
 
+    ///PIPELINE CACHE///
+    // Loaded at init and saved at free, so later runs don't compile every pipeline from scratch.
+    // The file is only used on the device and driver version that wrote it
+    void load_pipeline_cache();
+    void save_pipeline_cache();
+    void create_graphics_pipeline(const VkGraphicsPipelineCreateInfo *pipelineInfo, VkPipeline *pPipeline); //through the cache, timed
+    PipelineStats get_pipeline_stats();
+
     ///SHADER MODULES///
     void create_shader_module(VkShaderModule *module, const char* fname);
 
@@ -134,17 +188,41 @@ namespace Vulkan
     void create_shader(u32 shaderIndex, Shader *shader, const char *vert, const char *frag);
     void destroy_shader(u32 shaderIndex);
 
+    // Between begin_shader_batch and end_shader_batch, create_shader only sets up the descriptor set layout and pool
+    // and queues the pipeline. end_shader_batch starts building the queued pipelines as jobs, reading SPIR-V and
+    // compiling on all threads at once through the shared pipeline cache, and returns without waiting.
+    // Materials can use the shaders right away, drawing with them has to wait for wait_for_shader_batch
+    void begin_shader_batch();
+    void end_shader_batch();
+    void wait_for_shader_batch();
+
     ///COMMAND BUFFERS///
     void create_command_pool();
-    void begin_rendering();
+    void destroy_command_pool();
+    void begin_rendering(); //waits for the swapchain image, so camera and lighting have to be updated before
+    void update_uniform_buffers();
     void begin_shadow_pass();
-    void set_shadow_instance_data(u32 callIndex);
     void begin_forward_render_pass();
     void end_render_pass();
+
+    // Draws of the shadow and forward passes are recorded in slices, each into its own secondary command buffer,
+    // and the primary command buffer executes them in slice order. Slices can be recorded on different threads:
+    // between begin_recording and end_recording, the bind and draw functions below record into the slice
+    // the calling thread began
+    enum RecordingPass
+    {
+        RECORDING_PASS_SHADOW,
+        RECORDING_PASS_FORWARD,
+        RECORDING_PASS_COUNT
+    };
+    void begin_recording(RecordingPass pass, u32 slice);
+    void end_recording();
+    void execute_recordings(RecordingPass pass, u32 sliceCount);
+
     void bind_shader(u32 shaderIndex);
-    void bind_shader_data_block(u32 shaderIndex, u32 materialIndex, u32 callIndex);
+    void bind_shader_data_block(u32 shaderIndex, u32 materialIndex);
     void bind_vertex_buffer(u32 meshIndex, VertexAttribFlags attribs);
-    void draw_elements(u32 count, u32 firstIndex = 0, s32 vertexOffset = 0);
+    void draw_elements(u32 count, u32 firstIndex = 0, s32 vertexOffset = 0, u32 instanceCount = 1, u32 firstInstance = 0);
     void update_post_process_descriptor_set();
     void update_shadow_descriptor_set();
     void render_post_process(u32 meshIndex);
@@ -153,41 +231,68 @@ namespace Vulkan
     ///SEMAPHORES///
     void create_semaphores();
     void destroy_semaphores();
+    void wait_for_frames_in_flight(); //before changing or destroying anything that isn't buffered per frame
 
     ///TEXTURES///
     void allocate_texture_memory(u32 index);
     void free_texture_memory(u32 index);
     void create_texture_image(u32 index, TextureType type, int width, int height, VkFormat format, int mipCount);
     void create_texture_sampler(u32 index, int mipCount, TextureFilter filter);
-    void copy_staging_buffer_to_texture(u32 index, VkBuffer stagingBuffer, u32 width, u32 height, int layerCount, int mipCount);
-    void generate_mipmaps(u32 index, int width, int height, int layerCount, int mipCount);
+    void copy_staging_buffer_to_texture(VkCommandBuffer cmds, VkImage image, StagingRange staging, u32 width, u32 height, int layerCount, int mipCount);
+    void generate_mipmaps(VkCommandBuffer cmds, VkImage image, int width, int height, int layerCount, int mipCount); //also moves all mips to shader read layout
     void create_texture(u32 textureIndex, Image **image, Texture *texture, TextureType type, TextureFilter filter = (TextureFilter)VK_FILTER_LINEAR, bool generateMips = true);
     void destroy_texture(u32 textureIndex);
 
     ///VERTEX BUFFERS///
-    void create_index_buffer(u8 index, MeshData *meshData);
-    void create_vertex_position_buffer(u8 index, u16 vertexCount, glm::vec3 *pos);
-    void create_vertex_texcoord0_buffer(u8 index, u16 vertexCount, glm::vec2 *uv);
-    void create_vertex_normal_buffer(u8 index, u16 vertexCount, glm::vec3 *nrm);
-    void create_vertex_tangent_buffer(u8 index, u16 vertexCount, glm::vec4 *tan);
-    void create_vertex_color_buffer(u8 index, u16 vertexCount, glm::vec4 *clr);
+    void create_static_geometry_buffers();
+    void destroy_static_geometry_buffers();
     void create_vertex_buffer(u32 meshIndex, MeshData *meshData);
     void destroy_vertex_buffer(u32 meshIndex);
 
+    // Host visible overlay geometry with a copy for each frame in flight, written in place without allocating.
+    // Writes go to the copy of the current frame, so a mesh has to be written again every frame it's drawn
+    void create_dynamic_mesh(u32 meshIndex, u32 vertexCapacity, u32 indexCapacity);
+    void write_dynamic_vertices(u32 meshIndex, u32 firstVertex, const OverlayVertex *vertices, u32 count);
+    void write_dynamic_indices(u32 meshIndex, u32 firstIndex, const u16 *indices, u32 count);
+    void destroy_dynamic_mesh(u32 meshIndex);
+
+    const MeshRecord &get_mesh_record(u32 meshIndex);
     u32 get_vertex_count(u32 meshIndex);
     u32 get_index_count(u32 meshIndex);
 
+    ///UPLOADS///
+    // Copies into device local resources are recorded into an upload batch instead of each waiting on the queue.
+    // The batch goes out with the next frame, or earlier when staging space runs out, and ends with a barrier,
+    // so anything submitted after it sees the data. Staging space comes from a persistently mapped ring,
+    // reused once the batch that read it has signaled its fence
+    void create_upload_queue();
+    void destroy_upload_queue();
+    // Can submit the open batch, so get the command buffer after this, and record the copies from a range before reserving another.
+    // data is null when there was no memory for the range, the upload has to be skipped then
+    StagingRange reserve_staging(VkDeviceSize size);
+    VkCommandBuffer get_upload_command_buffer();
+    u64 submit_uploads(); //returns the serial of the batch, 0 if nothing was recorded
+    bool is_upload_complete(u64 serial);
+    void finish_uploads(); //submits and waits for all of them
+
     ///MAIN///
     void init(u32 extensionCount, const char** extensionNames, void (*surfaceCallback)(VkSurfaceKHR*));
-    void draw_frame(glm::vec3 camPos, Quaternion camRot); //placeholder function for early testing
+    void draw_frame(); //submits and presents, then waits until the next frame's resources are free
     void free();
 
     ///UTIL///
     void create_buffer(VkBuffer *pBuffer, VkDeviceSize size, VkBufferUsageFlags usage);
-    void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size);
+    void copy_buffer(VkBuffer src, VkBuffer dst, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0); //recorded into the upload batch
     void free_buffer(VkBuffer *pBuffer);
-    void allocate_memory(VkDeviceMemory *pMemory, VkDeviceSize size, u32 memoryTypeIndex);
-    void allocate_buffer_memory(VkDeviceMemory *pMemory, VkBuffer buffer, VkMemoryPropertyFlags propertyFlags);
+    // Sub-allocates from large blocks per memory type instead of a vkAllocateMemory per resource.
+    // When a new block can't be allocated, the allocation gets one of its own size instead
+    bool allocate_memory(MemoryAllocation *pAllocation, VkMemoryRequirements requirements, VkMemoryPropertyFlags propertyFlags, bool image);
+    bool allocate_buffer_memory(MemoryAllocation *pAllocation, VkBuffer buffer, VkMemoryPropertyFlags propertyFlags); //also binds, false if there was no memory
+    bool allocate_image_memory(MemoryAllocation *pAllocation, VkImage image, VkMemoryPropertyFlags propertyFlags); //also binds, false if there was no memory
+    void free_memory(MemoryAllocation *pAllocation);
+    u8 *get_memory_mapping(const MemoryAllocation &allocation); //host visible blocks stay mapped, so this is always valid for them
+    void free_memory_blocks();
+    GpuMemoryStats get_memory_stats();
     u32 get_device_memory_type_index(u32 typeFilter, VkMemoryPropertyFlags propertyFlags);
     void create_image(VkImage *image, u32 w, u32 h, VkFormat format, VkImageTiling tiling, int usage, TextureType type = TEXTURE_2D, int mipCount = 1, VkSampleCountFlagBits numSamples = VK_SAMPLE_COUNT_1_BIT);
     void create_image_view(VkImageView *imageView, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, TextureType type = TEXTURE_2D, int mipCount = 1);
@@ -0,0 +1,83 @@
+#include "arena.h"
+#include "math.h"
+#include <cstdlib>
+
+struct OverflowBlock
+{
+    OverflowBlock *next;
+    u64 padding; //keeps the data 16 byte aligned
+};
+
+static void free_overflow(Arena *arena, void *until)
+{
+    while (arena->overflow != until)
+    {
+        OverflowBlock *block = (OverflowBlock*)arena->overflow;
+        arena->overflow = block->next;
+        free(block);
+    }
+}
+
+void init_arena(Arena *arena, u64 size)
+{
+    arena->memory = (u8*)malloc(size);
+    arena->size = arena->memory != nullptr ? size : 0;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->allocCount = 0;
+    arena->heapAllocCount = 0;
+    arena->overflow = nullptr;
+}
+
+void free_arena(Arena *arena)
+{
+    free_overflow(arena, nullptr);
+    free(arena->memory);
+    arena->memory = nullptr;
+    arena->size = 0;
+    arena->used = 0;
+}
+
+void *arena_alloc(Arena *arena, u64 size, u64 alignment)
+{
+    arena->allocCount++;
+
+    u64 start = (arena->used + alignment - 1) & ~(alignment - 1);
+    if (start + size <= arena->size)
+    {
+        arena->used = start + size;
+        arena->peak = MAX(arena->peak, arena->used);
+        return arena->memory + start;
+    }
+
+    // Doesn't fit, fall back to the heap. Alignment above 16 isn't supported here
+    OverflowBlock *block = (OverflowBlock*)malloc(sizeof(OverflowBlock) + size);
+    if (block == nullptr)
+        return nullptr;
+
+    block->next = (OverflowBlock*)arena->overflow;
+    arena->overflow = block;
+    arena->heapAllocCount++;
+    return block + 1;
+}
+
+void reset_arena(Arena *arena)
+{
+    free_overflow(arena, nullptr);
+    arena->used = 0;
+    arena->allocCount = 0;
+    arena->heapAllocCount = 0;
+}
+
+ArenaScope::ArenaScope(Arena *a)
+{
+    arena = a;
+    mark = a->used;
+    overflowMark = a->overflow;
+}
+
+ArenaScope::~ArenaScope()
+{
+    free_overflow(arena, overflowMark);
+    arena->used = mark;
+}
@@ -0,0 +1,43 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "typedef.h"
+
+// Linear allocator: allocating bumps a pointer and everything is freed at once by resetting.
+// Allocations that don't fit go to the heap and get freed on reset too, heapAllocCount tells if that happens.
+struct Arena
+{
+    u8 *memory;
+    u64 size;
+    u64 used;
+    u64 peak;
+
+    u32 allocCount; //since last reset
+    u32 heapAllocCount; //since last reset
+    void *overflow; //heap blocks, newest first
+};
+
+void init_arena(Arena *arena, u64 size);
+void free_arena(Arena *arena);
+
+void *arena_alloc(Arena *arena, u64 size, u64 alignment = 16);
+void reset_arena(Arena *arena);
+
+template <class T>
+T *arena_alloc_array(Arena *arena, u64 count)
+{
+    return (T*)arena_alloc(arena, sizeof(T) * count, alignof(T));
+}
+
+// Frees everything allocated from the arena during its lifetime
+struct ArenaScope
+{
+    Arena *arena;
+    u64 mark;
+    void *overflowMark;
+
+    ArenaScope(Arena *a);
+    ~ArenaScope();
+};
+
+#endif // ARENA_H
@@ -0,0 +1,120 @@
+#include "buddy.h"
+#include <cstdlib>
+
+// The tree is stored level by level, the children of node n are 2n + 1 and 2n + 2.
+// A node value of level + 1 means the whole piece is free, 0 that it's allocated or full
+
+static void update_parents(BuddyAllocator *buddy, u32 node, u8 level)
+{
+    while (node > 0)
+    {
+        node = (node - 1) / 2;
+        u8 left = buddy->tree[node * 2 + 1];
+        u8 right = buddy->tree[node * 2 + 2];
+
+        // Two free halves merge back into one free piece
+        if (left == level + 1 && right == level + 1)
+            buddy->tree[node] = level + 2;
+        else buddy->tree[node] = left > right ? left : right;
+        level++;
+    }
+}
+
+bool init_buddy(BuddyAllocator *buddy, u32 minOrder, u32 maxOrder)
+{
+    u32 levels = maxOrder - minOrder;
+    buddy->tree = (u8*)malloc((2ull << levels) - 1);
+    if (buddy->tree == nullptr)
+        return false;
+
+    buddy->minOrder = minOrder;
+    buddy->maxOrder = maxOrder;
+    buddy->freeBytes = 1ull << maxOrder;
+
+    for (u32 depth = 0; depth <= levels; depth++)
+    {
+        u32 first = (1u << depth) - 1;
+        for (u32 node = first; node < first * 2 + 1; node++)
+        {
+            buddy->tree[node] = levels - depth + 1;
+        }
+    }
+    return true;
+}
+
+void free_buddy(BuddyAllocator *buddy)
+{
+    free(buddy->tree);
+    buddy->tree = nullptr;
+}
+
+u64 buddy_alloc(BuddyAllocator *buddy, u64 size, u64 alignment)
+{
+    // Pieces are aligned to their size, so the alignment only rounds the size up
+    u64 need = size > alignment ? size : alignment;
+    u32 order = buddy->minOrder;
+    while ((1ull << order) < need)
+        order++;
+
+    if (order > buddy->maxOrder)
+        return BUDDY_NO_SPACE;
+
+    u8 target = order - buddy->minOrder + 1;
+    if (buddy->tree[0] < target)
+        return BUDDY_NO_SPACE;
+
+    // Go down into the child with the smallest piece that still fits, to keep large pieces whole
+    u32 node = 0;
+    u8 level = buddy->maxOrder - buddy->minOrder + 1;
+    while (level != target)
+    {
+        u8 left = buddy->tree[node * 2 + 1];
+        u8 right = buddy->tree[node * 2 + 2];
+        if (left >= target && (right < target || left <= right))
+            node = node * 2 + 1;
+        else node = node * 2 + 2;
+        level--;
+    }
+
+    buddy->tree[node] = 0;
+    update_parents(buddy, node, target - 1);
+
+    u32 depth = buddy->maxOrder - order;
+    u64 index = node - ((1u << depth) - 1);
+    buddy->freeBytes -= 1ull << order;
+    return index << order;
+}
+
+u64 buddy_free(BuddyAllocator *buddy, u64 offset)
+{
+    // The allocated piece is the lowest node above the offset's leaf that is marked used
+    u32 levels = buddy->maxOrder - buddy->minOrder;
+    u32 node = (u32)(offset >> buddy->minOrder) + (1u << levels) - 1;
+    u8 level = 0;
+    while (buddy->tree[node] != 0)
+    {
+        if (node == 0)
+            return 0; //wasn't allocated
+        node = (node - 1) / 2;
+        level++;
+    }
+
+    buddy->tree[node] = level + 1;
+    update_parents(buddy, node, level);
+
+    u64 size = 1ull << (level + buddy->minOrder);
+    buddy->freeBytes += size;
+    return size;
+}
+
+u64 buddy_largest_free(const BuddyAllocator *buddy)
+{
+    if (buddy->tree[0] == 0)
+        return 0;
+    return 1ull << (buddy->tree[0] - 1 + buddy->minOrder);
+}
+
+bool buddy_empty(const BuddyAllocator *buddy)
+{
+    return buddy->freeBytes == 1ull << buddy->maxOrder;
+}
@@ -0,0 +1,29 @@
+#ifndef BUDDY_H
+#define BUDDY_H
+
+#include "typedef.h"
+
+// Buddy allocator for a range of 2^maxOrder bytes. Hands out power of two sized pieces, from 2^minOrder up,
+// each aligned to its own size. It only tracks offsets and owns none of the memory, so it works for GPU memory too.
+struct BuddyAllocator
+{
+    u8 *tree; //per node, 1 + order of the largest free piece below it relative to minOrder, 0 if there is none
+    u32 minOrder;
+    u32 maxOrder;
+    u64 freeBytes;
+};
+
+#define BUDDY_NO_SPACE 0xffffffffffffffffull
+
+bool init_buddy(BuddyAllocator *buddy, u32 minOrder, u32 maxOrder);
+void free_buddy(BuddyAllocator *buddy);
+
+// Returns the offset, or BUDDY_NO_SPACE
+u64 buddy_alloc(BuddyAllocator *buddy, u64 size, u64 alignment);
+// Returns how many bytes were freed, the rounded up size
+u64 buddy_free(BuddyAllocator *buddy, u64 offset);
+
+u64 buddy_largest_free(const BuddyAllocator *buddy);
+bool buddy_empty(const BuddyAllocator *buddy);
+
+#endif // BUDDY_H
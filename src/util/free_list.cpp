@@ -0,0 +1,96 @@
+#include "free_list.h"
+#include <cstring>
+#include <iostream>
+
+void init_free_list(FreeList *list, FreeRange *ranges, u32 rangeCapacity, u32 size)
+{
+    list->ranges = ranges;
+    list->rangeCapacity = rangeCapacity;
+    list->size = size;
+    list->freeCount = size;
+
+    list->ranges[0] = {0, size};
+    list->rangeCount = size > 0 ? 1 : 0;
+}
+
+u32 free_list_alloc(FreeList *list, u32 count)
+{
+    if (count == 0)
+        return 0;
+
+    for (u32 i = 0; i < list->rangeCount; i++)
+    {
+        FreeRange &range = list->ranges[i];
+        if (range.count < count)
+            continue;
+
+        u32 first = range.first;
+        range.first += count;
+        range.count -= count;
+
+        if (range.count == 0)
+        {
+            memmove(&list->ranges[i], &list->ranges[i + 1], sizeof(FreeRange) * (list->rangeCount - i - 1));
+            list->rangeCount--;
+        }
+
+        list->freeCount -= count;
+        return first;
+    }
+    return FREE_LIST_NO_SPACE;
+}
+
+void free_list_free(FreeList *list, u32 first, u32 count)
+{
+    if (count == 0)
+        return;
+
+    // Index of the first free range after the freed one
+    u32 next = 0;
+    while (next < list->rangeCount && list->ranges[next].first < first)
+        next++;
+
+    bool mergePrev = next > 0 && list->ranges[next - 1].first + list->ranges[next - 1].count == first;
+    bool mergeNext = next < list->rangeCount && first + count == list->ranges[next].first;
+
+    if (mergePrev && mergeNext)
+    {
+        list->ranges[next - 1].count += count + list->ranges[next].count;
+        memmove(&list->ranges[next], &list->ranges[next + 1], sizeof(FreeRange) * (list->rangeCount - next - 1));
+        list->rangeCount--;
+    }
+    else if (mergePrev)
+    {
+        list->ranges[next - 1].count += count;
+    }
+    else if (mergeNext)
+    {
+        list->ranges[next].first = first;
+        list->ranges[next].count += count;
+    }
+    else
+    {
+        if (list->rangeCount == list->rangeCapacity)
+        {
+            std::cout << "Free list is out of ranges, leaking " << count << " units!\n";
+            return;
+        }
+
+        memmove(&list->ranges[next + 1], &list->ranges[next], sizeof(FreeRange) * (list->rangeCount - next));
+        list->ranges[next] = {first, count};
+        list->rangeCount++;
+    }
+
+    list->freeCount += count;
+}
+
+u32 free_list_largest_free(const FreeList *list)
+{
+    u32 largest = 0;
+    for (u32 i = 0; i < list->rangeCount; i++)
+    {
+        if (list->ranges[i].count > largest)
+            largest = list->ranges[i].count;
+    }
+    return largest;
+}
@@ -0,0 +1,34 @@
+#ifndef FREE_LIST_H
+#define FREE_LIST_H
+
+#include "typedef.h"
+
+// Hands out ranges of a linear space of size units, first fit. Free ranges are kept sorted,
+// and a freed range merges with the free ranges next to it. Like the buddy allocator it only tracks offsets
+struct FreeRange
+{
+    u32 first;
+    u32 count;
+};
+
+struct FreeList
+{
+    FreeRange *ranges; //sorted by first
+    u32 rangeCount;
+    u32 rangeCapacity;
+    u32 size;
+    u32 freeCount;
+};
+
+#define FREE_LIST_NO_SPACE 0xffffffff
+
+// ranges needs room for rangeCapacity items. n allocations split the space into at most n + 1 free ranges
+void init_free_list(FreeList *list, FreeRange *ranges, u32 rangeCapacity, u32 size);
+
+// Returns the first unit, or FREE_LIST_NO_SPACE
+u32 free_list_alloc(FreeList *list, u32 count);
+void free_list_free(FreeList *list, u32 first, u32 count);
+
+u32 free_list_largest_free(const FreeList *list);
+
+#endif // FREE_LIST_H
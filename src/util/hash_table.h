@@ -0,0 +1,124 @@
+#ifndef HASH_TABLE_H
+#define HASH_TABLE_H
+
+#include "typedef.h"
+
+// Open addressing hash table with linear probing for small values keyed by u64.
+// Removing shifts the following entries back instead of leaving tombstones, so probe lengths don't grow over time.
+template <class T, u32 capacity>
+struct HashTable
+{
+    static_assert((capacity & (capacity - 1)) == 0, "Capacity must be a power of two");
+
+private:
+    u64 keys[capacity];
+    T values[capacity];
+    bool occupied[capacity];
+    u32 count;
+
+    static u32 get_slot(u64 key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        return (u32)key & (capacity - 1);
+    }
+
+    s32 find_slot(u64 key) const
+    {
+        u32 slot = get_slot(key);
+        while (occupied[slot])
+        {
+            if (keys[slot] == key)
+                return slot;
+            slot = (slot + 1) & (capacity - 1);
+        }
+        return -1;
+    }
+public:
+    HashTable()
+    {
+        clear();
+    }
+
+    void clear()
+    {
+        for (u32 i = 0; i < capacity; i++)
+        {
+            occupied[i] = false;
+        }
+        count = 0;
+    }
+
+    T *find(u64 key)
+    {
+        s32 slot = find_slot(key);
+        if (slot < 0)
+            return nullptr;
+
+        return &values[slot];
+    }
+
+    // Returns false if the key is there already or the table is full
+    bool insert(u64 key, T value)
+    {
+        // Always leave one slot empty so probing for a missing key terminates
+        if (count >= capacity - 1)
+            return false;
+
+        u32 slot = get_slot(key);
+        while (occupied[slot])
+        {
+            if (keys[slot] == key)
+                return false;
+            slot = (slot + 1) & (capacity - 1);
+        }
+
+        keys[slot] = key;
+        values[slot] = value;
+        occupied[slot] = true;
+        count++;
+        return true;
+    }
+
+    bool remove(u64 key)
+    {
+        s32 found = find_slot(key);
+        if (found < 0)
+            return false;
+
+        u32 hole = found;
+        occupied[hole] = false;
+        count--;
+
+        // Move back entries that probed past the hole, stop at the first empty slot
+        u32 slot = hole;
+        while (true)
+        {
+            slot = (slot + 1) & (capacity - 1);
+            if (!occupied[slot])
+                break;
+
+            // Entry can stay if its home slot is cyclically within (hole, slot]
+            u32 home = get_slot(keys[slot]);
+            bool stays = hole <= slot ? (hole < home && home <= slot) : (hole < home || home <= slot);
+            if (stays)
+                continue;
+
+            keys[hole] = keys[slot];
+            values[hole] = values[slot];
+            occupied[hole] = true;
+            occupied[slot] = false;
+            hole = slot;
+        }
+
+        return true;
+    }
+
+    u32 get_count() const
+    {
+        return count;
+    }
+};
+
+#endif // HASH_TABLE_H
@@ -0,0 +1,135 @@
+#include "mapped_file.h"
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static bool map_file(MappedFile *file)
+{
+    HANDLE mapping = CreateFileMappingA((HANDLE)file->fileHandle, nullptr, PAGE_READWRITE, (DWORD)(file->size >> 32), (DWORD)file->size, nullptr);
+    if (mapping == nullptr)
+        return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, file->size);
+    if (view == nullptr)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    file->mappingHandle = mapping;
+    file->data = (u8*)view;
+    return true;
+}
+
+static void unmap_file(MappedFile *file)
+{
+    if (file->data != nullptr)
+        UnmapViewOfFile(file->data);
+    if (file->mappingHandle != nullptr)
+        CloseHandle((HANDLE)file->mappingHandle);
+
+    file->data = nullptr;
+    file->mappingHandle = nullptr;
+}
+
+bool open_mapped_file(MappedFile *file, const char *fname, u64 size)
+{
+    file->data = nullptr;
+    file->size = size;
+    file->mappingHandle = nullptr;
+    file->fileHandle = CreateFileA(fname, GENERIC_READ | GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+    if (file->fileHandle == INVALID_HANDLE_VALUE || !map_file(file))
+    {
+        std::cout << "Failed to map file " << fname << "!\n";
+        return false;
+    }
+
+    return true;
+}
+
+bool resize_mapped_file(MappedFile *file, u64 size)
+{
+    // The mapping sets the file size, so it's enough to map it again with the new size
+    unmap_file(file);
+    file->size = size;
+
+    if (!map_file(file))
+    {
+        std::cout << "Failed to resize mapped file!\n";
+        return false;
+    }
+
+    return true;
+}
+
+void close_mapped_file(MappedFile *file)
+{
+    unmap_file(file);
+    if (file->fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle((HANDLE)file->fileHandle);
+}
+#else
+bool open_mapped_file(MappedFile *file, const char *fname, u64 size)
+{
+    file->data = nullptr;
+    file->size = size;
+    file->fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (file->fd < 0 || ftruncate(file->fd, size) != 0)
+    {
+        std::cout << "Failed to map file " << fname << "!\n";
+        return false;
+    }
+
+    void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (view == MAP_FAILED)
+    {
+        std::cout << "Failed to map file " << fname << "!\n";
+        return false;
+    }
+
+    file->data = (u8*)view;
+    return true;
+}
+
+bool resize_mapped_file(MappedFile *file, u64 size)
+{
+    munmap(file->data, file->size);
+    file->data = nullptr;
+    file->size = size;
+
+    if (ftruncate(file->fd, size) != 0)
+    {
+        std::cout << "Failed to resize mapped file!\n";
+        return false;
+    }
+
+    void *view = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+    if (view == MAP_FAILED)
+    {
+        std::cout << "Failed to resize mapped file!\n";
+        return false;
+    }
+
+    file->data = (u8*)view;
+    return true;
+}
+
+void close_mapped_file(MappedFile *file)
+{
+    if (file->data != nullptr)
+        munmap(file->data, file->size);
+    if (file->fd >= 0)
+        close(file->fd);
+
+    file->data = nullptr;
+}
+#endif
@@ -0,0 +1,25 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include "typedef.h"
+
+// File mapped into memory for reading and writing. Growing it remaps, so don't hold on to pointers into data across resize.
+struct MappedFile
+{
+    u8 *data;
+    u64 size;
+
+#ifdef _WIN32
+    void *fileHandle;
+    void *mappingHandle;
+#else
+    s32 fd;
+#endif
+};
+
+// Creates the file (truncating any existing one) with the given size. Close it even if opening or resizing fails
+bool open_mapped_file(MappedFile *file, const char *fname, u64 size);
+bool resize_mapped_file(MappedFile *file, u64 size);
+void close_mapped_file(MappedFile *file);
+
+#endif // MAPPED_FILE_H
@@ -30,6 +30,7 @@ struct Quaternion
     {
         return Quaternion(0,0,0,1);
     }
+    inline static Quaternion nlerp(const Quaternion& a, const Quaternion& b, r32 t);
     inline static Quaternion euler(glm::vec3 angles);
     inline static Quaternion euler(r32 x, r32 y, r32 z)
     {
@@ -67,6 +68,21 @@ inline glm::vec3 operator*(const Quaternion& q, const glm::vec3& v)
     return {qResult.x, qResult.y, qResult.z};
 }
 
+inline Quaternion Quaternion::nlerp(const Quaternion& a, const Quaternion& b, r32 t)
+{
+    //take the shorter way around, q and -q are the same rotation
+    r32 dot = a.x*b.x + a.y*b.y + a.z*b.z + a.w*b.w;
+    r32 sign = dot < 0.0f ? -1.0f : 1.0f;
+
+    Quaternion result(a.x + (b.x*sign - a.x)*t,
+                      a.y + (b.y*sign - a.y)*t,
+                      a.z + (b.z*sign - a.z)*t,
+                      a.w + (b.w*sign - a.w)*t);
+
+    r32 length = std::sqrt(result.x*result.x + result.y*result.y + result.z*result.z + result.w*result.w);
+    return Quaternion(result.x/length, result.y/length, result.z/length, result.w/length);
+}
+
 inline Quaternion Quaternion::euler(glm::vec3 angles)
 {
     //rotation order ZYX
@@ -0,0 +1,63 @@
+#ifndef RADIX_SORT_H
+#define RADIX_SORT_H
+
+#include <cstring>
+#include "typedef.h"
+
+#define RADIX_DIGIT_BITS 8
+#define RADIX_BUCKET_COUNT (1 << RADIX_DIGIT_BITS)
+#define RADIX_DIGIT_COUNT (64 / RADIX_DIGIT_BITS)
+
+// Stable LSD radix sort by a u64 key, one pass per 8-bit digit. Histograms of all digits are counted in one go
+// and digits that are the same for every item (unused key bits) are skipped. scratch needs room for count items.
+template <class T, u64 (*key)(const T&)>
+void radix_sort(T *items, T *scratch, u32 count)
+{
+    u32 histograms[RADIX_DIGIT_COUNT][RADIX_BUCKET_COUNT];
+    memset(histograms, 0, sizeof(histograms));
+
+    for (u32 i = 0; i < count; i++)
+    {
+        u64 k = key(items[i]);
+        for (u32 digit = 0; digit < RADIX_DIGIT_COUNT; digit++)
+        {
+            histograms[digit][(k >> (digit * RADIX_DIGIT_BITS)) & (RADIX_BUCKET_COUNT - 1)]++;
+        }
+    }
+
+    T *src = items;
+    T *dst = scratch;
+    for (u32 digit = 0; digit < RADIX_DIGIT_COUNT; digit++)
+    {
+        u32 *histogram = histograms[digit];
+        const u32 shift = digit * RADIX_DIGIT_BITS;
+
+        // Every item in one bucket, this pass wouldn't move anything
+        if (count == 0 || histogram[(key(src[0]) >> shift) & (RADIX_BUCKET_COUNT - 1)] == count)
+            continue;
+
+        // Counts to starting offsets
+        u32 offset = 0;
+        for (u32 bucket = 0; bucket < RADIX_BUCKET_COUNT; bucket++)
+        {
+            u32 bucketCount = histogram[bucket];
+            histogram[bucket] = offset;
+            offset += bucketCount;
+        }
+
+        for (u32 i = 0; i < count; i++)
+        {
+            u32 bucket = (key(src[i]) >> shift) & (RADIX_BUCKET_COUNT - 1);
+            dst[histogram[bucket]++] = src[i];
+        }
+
+        T *temp = src;
+        src = dst;
+        dst = temp;
+    }
+
+    if (src != items)
+        memcpy(items, src, sizeof(T) * count);
+}
+
+#endif // RADIX_SORT_H
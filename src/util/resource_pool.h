@@ -1,17 +1,38 @@
 #ifndef RESOURCE_POOL_H
 #define RESOURCE_POOL_H
 
+// Handle that can tell whether the object it was taken from has been destroyed since
+struct GenerationalHandle
+{
+    u32 handle;
+    u32 generation;
+};
+
+// Slot map: handles index objs directly and never move, handles[0..count) lists the live ones densely
+// and indices[] maps back from a handle to its place in that list, so destroying is O(1)
 template <class T, u32 poolSize>
 struct ResourcePool
 {
 private:
     T objs[poolSize];
     u32 handles[poolSize];
+    u32 indices[poolSize];
+    u32 generations[poolSize]; //incremented every time the slot is destroyed
+    bool marked[poolSize];
     u32 count;
 
     T *objsToDelete[poolSize];
     void (*deleteCallbacks[poolSize])(T*,u32);
     u32 objsToDeleteCount;
+
+    u32 take_handle()
+    {
+        u32 handle = handles[count];
+        indices[handle] = count;
+        marked[handle] = false;
+        count++;
+        return handle;
+    }
 public:
     ResourcePool()
     {
@@ -21,6 +42,9 @@ public:
         for (u32 i = 0; i < poolSize; i++)
         {
             handles[i] = i;
+            indices[i] = i;
+            generations[i] = 0;
+            marked[i] = false;
         }
     }
 
@@ -29,7 +53,7 @@ public:
         if (count >= poolSize)
             return nullptr;
 
-        u32 handle = handles[count++];
+        u32 handle = take_handle();
         return &objs[handle];
     }
 
@@ -41,7 +65,7 @@ public:
             return nullptr;
         }
 
-        u32 handle = handles[count++];
+        u32 handle = take_handle();
         *outHandle = handle;
         return &objs[handle];
     }
@@ -64,8 +88,33 @@ public:
         return count;
     }
 
+    bool is_alive(u32 handle) const
+    {
+        return handle < poolSize && indices[handle] < count;
+    }
+
+    GenerationalHandle get_generational_handle(u32 handle) const
+    {
+        return {handle, generations[handle]};
+    }
+
+    // nullptr if the object has been destroyed, even if the slot has been reused since
+    T *get(GenerationalHandle handle)
+    {
+        if (!is_alive(handle.handle) || generations[handle.handle] != handle.generation)
+            return nullptr;
+
+        return &objs[handle.handle];
+    }
+
+    // Marking an object more than once, or one that's not alive, does nothing
     void mark_for_destruction(T *obj, void (*callback)(T*,u32) = nullptr)
     {
+        const u32 handle = obj - objs;
+        if (!is_alive(handle) || marked[handle])
+            return;
+        marked[handle] = true;
+
         u32 index = objsToDeleteCount++;
         objsToDelete[index] = obj;
         deleteCallbacks[index] = callback;
@@ -73,28 +122,29 @@ public:
 
     void destroy_obj(T *obj, void (*callback)(T*,u32) = nullptr)
     {
-        //find it
-        for (int i = 0; i < count; i++)
-        {
-            const u32 handle = handles[i];
-            T* found = &objs[handle];
-            if (found != obj)
-                continue;
+        const u32 handle = obj - objs;
+        if (!is_alive(handle))
+            return;
 
-            count--;
-            handles[i] = handles[count];
-            handles[count] = handle;
+        // Swap the last live handle into its place
+        const u32 index = indices[handle];
+        count--;
+        const u32 last = handles[count];
+        handles[index] = last;
+        indices[last] = index;
+        handles[count] = handle;
+        indices[handle] = count;
 
-            if (callback != nullptr)
-                callback(obj,handle);
+        generations[handle]++;
+        marked[handle] = false;
 
-            return;
-        }
+        if (callback != nullptr)
+            callback(obj,handle);
     }
 
     void destroy_objs()
     {
-        for(int i = 0; i < objsToDeleteCount; i++)
+        for(u32 i = 0; i < objsToDeleteCount; i++)
         {
             destroy_obj(objsToDelete[i], deleteCallbacks[i]);
         }
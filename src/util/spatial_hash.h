@@ -0,0 +1,140 @@
+#ifndef SPATIAL_HASH_H
+#define SPATIAL_HASH_H
+
+#include <cmath>
+#include <glm/glm.hpp>
+#include "typedef.h"
+
+// Uniform grid on the X/Z plane (the game is planar), hashed into a fixed number of buckets.
+// Entries are inserted once per tick and sorted into their buckets with a counting sort,
+// so building is O(n) and the entries of a bucket are contiguous in memory.
+template <u32 maxEntries, u32 bucketCount>
+struct SpatialHash
+{
+    static_assert((bucketCount & (bucketCount - 1)) == 0, "Bucket count must be a power of two");
+
+private:
+    r32 invCellSize;
+    u32 count;
+
+    s32 cellX[maxEntries];
+    s32 cellZ[maxEntries];
+    u32 buckets[maxEntries];
+
+    u32 bucketStart[bucketCount + 1];
+    u32 sorted[maxEntries];
+
+    u32 get_bucket(s32 x, s32 z) const
+    {
+        u32 hash = ((u32)x * 73856093u) ^ ((u32)z * 19349663u);
+        return hash & (bucketCount - 1);
+    }
+public:
+    SpatialHash()
+    {
+        invCellSize = 1.0f;
+        count = 0;
+    }
+
+    // Cell size should be at least the largest collision diameter, then all overlapping pairs are in neighbouring cells
+    void begin(r32 cellSize)
+    {
+        invCellSize = 1.0f / cellSize;
+        count = 0;
+
+        for (u32 i = 0; i <= bucketCount; i++)
+        {
+            bucketStart[i] = 0;
+        }
+    }
+
+    // Returns the index of the entry, which is the same index the candidate queries use
+    s32 insert(glm::vec3 pos)
+    {
+        if (count >= maxEntries)
+            return -1;
+
+        u32 index = count++;
+        cellX[index] = (s32)std::floor(pos.x * invCellSize);
+        cellZ[index] = (s32)std::floor(pos.z * invCellSize);
+        buckets[index] = get_bucket(cellX[index], cellZ[index]);
+        bucketStart[buckets[index] + 1]++;
+
+        return index;
+    }
+
+    void end()
+    {
+        for (u32 i = 0; i < bucketCount; i++)
+        {
+            bucketStart[i + 1] += bucketStart[i];
+        }
+
+        // Scatter, using the start offsets as write cursors and shifting them back afterwards
+        for (u32 i = 0; i < count; i++)
+        {
+            sorted[bucketStart[buckets[i]]++] = i;
+        }
+        for (u32 i = bucketCount; i > 0; i--)
+        {
+            bucketStart[i] = bucketStart[i - 1];
+        }
+        bucketStart[0] = 0;
+    }
+
+    u32 get_count() const
+    {
+        return count;
+    }
+
+    // Calls callback(other) for every entry in the 3x3 cell neighbourhood with other > index,
+    // so iterating over all indices reports every candidate pair exactly once
+    template <typename F>
+    void for_each_candidate(u32 index, F callback) const
+    {
+        const s32 x = cellX[index];
+        const s32 z = cellZ[index];
+
+        u32 visited[9];
+        u32 visitedCount = 0;
+
+        for (s32 dz = -1; dz <= 1; dz++)
+        {
+            for (s32 dx = -1; dx <= 1; dx++)
+            {
+                u32 bucket = get_bucket(x + dx, z + dz);
+
+                // Different cells can hash to the same bucket, don't walk it twice
+                bool seen = false;
+                for (u32 v = 0; v < visitedCount; v++)
+                {
+                    if (visited[v] == bucket)
+                    {
+                        seen = true;
+                        break;
+                    }
+                }
+                if (seen)
+                    continue;
+                visited[visitedCount++] = bucket;
+
+                for (u32 i = bucketStart[bucket]; i < bucketStart[bucket + 1]; i++)
+                {
+                    u32 other = sorted[i];
+                    if (other <= index)
+                        continue;
+
+                    // Filter out hash collisions with cells that aren't actually neighbours
+                    s32 cdx = cellX[other] - x;
+                    s32 cdz = cellZ[other] - z;
+                    if (cdx < -1 || cdx > 1 || cdz < -1 || cdz > 1)
+                        continue;
+
+                    callback(other);
+                }
+            }
+        }
+    }
+};
+
+#endif // SPATIAL_HASH_H